@@ -0,0 +1,930 @@
+#include <algorithm>
+#include <atomic>
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <libyuv.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "args.h"
+#include "benchmark.h"
+#include "capturer/shm_capturer.h"
+#include "capturer/synthetic_capturer.h"
+#include "common/frame_tracer.h"
+#include "common/interface/subject.h"
+#include "encoder/encoder_calibration.h"
+#include "encoder/libav_encoder.hpp"
+#include "encoder/static_frame_detector.h"
+#include "loopback_peer.h"
+#include "producer/shm_producer.h"
+#include "rtc/bitrate_controller.h"
+#include "signaling/http_service.h"
+#include "v4l2_webrtc.h"
+
+namespace bpo = boost::program_options;
+
+namespace {
+
+struct Resolution {
+  int width;
+  int height;
+};
+
+const std::vector<Resolution> kResolutions = {{640, 480}, {1280, 720}, {1920, 1080}};
+const std::vector<std::pair<std::string, uint32_t>> kFormats = {
+        {"i420", V4L2_PIX_FMT_YUV420}, {"yuyv", V4L2_PIX_FMT_YUYV}, {"mjpeg", V4L2_PIX_FMT_MJPEG}};
+const std::vector<std::string> kPresets = {"ultrafast", "superfast", "veryfast"};
+const std::vector<std::string> kThreadTypes = {"slice", "frame"};
+const std::vector<int> kSubscriberCounts = {1, 4, 16, 64};
+const std::vector<std::pair<std::string, AVCodecID>> kCodecs = {
+        {"h264", AV_CODEC_ID_H264}, {"vp8", AV_CODEC_ID_VP8}, {"vp9", AV_CODEC_ID_VP9}, {"av1", AV_CODEC_ID_AV1}};
+const std::vector<int> kQualityBitrates = {500, 1000, 2000};
+
+const char *kSampleOffer = "v=0\r\n"
+                           "o=- 4215775240449105457 2 IN IP4 127.0.0.1\r\n"
+                           "s=-\r\n"
+                           "t=0 0\r\n"
+                           "a=group:BUNDLE 0\r\n"
+                           "a=msid-semantic: WMS\r\n"
+                           "m=video 9 UDP/TLS/RTP/SAVPF 96 97 102 103\r\n"
+                           "c=IN IP4 0.0.0.0\r\n"
+                           "a=rtcp:9 IN IP4 0.0.0.0\r\n"
+                           "a=candidate:1 1 udp 2122260223 192.168.1.10 54321 typ host generation 0\r\n"
+                           "a=candidate:2 1 udp 1686052607 203.0.113.7 54321 typ srflx raddr 192.168.1.10 "
+                           "rport 54321 generation 0\r\n"
+                           "a=candidate:3 1 tcp 1518280447 192.168.1.10 9 typ host tcptype active generation 0\r\n"
+                           "a=ice-ufrag:abcd\r\n"
+                           "a=ice-pwd:0123456789abcdefghijklmn\r\n"
+                           "a=ice-options:trickle\r\n"
+                           "a=fingerprint:sha-256 "
+                           "AB:CD:EF:01:23:45:67:89:AB:CD:EF:01:23:45:67:89:AB:CD:EF:01:23:45:67:89:AB:CD:EF:01:23:45:"
+                           "67:89\r\n"
+                           "a=setup:actpass\r\n"
+                           "a=mid:0\r\n"
+                           "a=extmap:1 urn:ietf:params:rtp-hdrext:toffset\r\n"
+                           "a=extmap:3 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+                           "a=recvonly\r\n"
+                           "a=rtcp-mux\r\n"
+                           "a=rtcp-rsize\r\n"
+                           "a=rtpmap:96 VP8/90000\r\n"
+                           "a=rtcp-fb:96 goog-remb\r\n"
+                           "a=rtcp-fb:96 nack\r\n"
+                           "a=rtcp-fb:96 nack pli\r\n"
+                           "a=rtpmap:97 rtx/90000\r\n"
+                           "a=fmtp:97 apt=96\r\n"
+                           "a=rtpmap:102 H264/90000\r\n"
+                           "a=rtcp-fb:102 goog-remb\r\n"
+                           "a=rtcp-fb:102 nack\r\n"
+                           "a=rtcp-fb:102 nack pli\r\n"
+                           "a=fmtp:102 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n"
+                           "a=rtpmap:103 rtx/90000\r\n"
+                           "a=fmtp:103 apt=102\r\n";
+
+std::string ResolutionName(const Resolution &r) { return std::to_string(r.width) + "x" + std::to_string(r.height); }
+
+Args BenchArgs(const Resolution &r, uint32_t format) {
+  Args args;
+  args.camera = "synthetic:0";
+  args.device_type = "synthetic";
+  args.width = r.width;
+  args.height = r.height;
+  args.format = format;
+  return args;
+}
+
+// Exposes the protected encode entry point so frames can be pushed without a capture thread.
+class BenchEncoder : public LibAvEncoder {
+public:
+  using LibAvEncoder::EncodeBuffer;
+  using LibAvEncoder::LibAvEncoder;
+};
+
+void BenchToI420(BenchmarkRunner &runner) {
+  for (const auto &[format_name, format]: kFormats) {
+    for (const auto &resolution: kResolutions) {
+      std::string name = "to_i420/" + format_name + "/" + ResolutionName(resolution);
+      if (!runner.Enabled(name)) {
+        continue;
+      }
+      SyntheticCapturer source(BenchArgs(resolution, format));
+      runner.Run(name, [&source] { source.GenerateFrame()->ToI420(); });
+    }
+  }
+}
+
+// A centred 720p region of a 1080p capture rotated by 90 degrees, for comparison with
+// converting the full frame above.
+void BenchToI420Transform(BenchmarkRunner &runner) {
+  const Resolution resolution = {1920, 1080};
+  for (const auto &[format_name, format]: kFormats) {
+    std::string name = "to_i420_transform/" + format_name + "/" + ResolutionName(resolution) + "/crop720_rotate90";
+    if (!runner.Enabled(name)) {
+      continue;
+    }
+    Args args = BenchArgs(resolution, format);
+    args.crop = ParseCropRect("1280x720");
+    args.rotation = 90;
+    SyntheticCapturer source(args);
+    runner.Run(name, [&source] { source.GenerateFrame()->ToI420(); });
+  }
+}
+
+void BenchStaticDetect(BenchmarkRunner &runner) {
+  for (const auto &resolution: kResolutions) {
+    for (bool moving: {false, true}) {
+      std::string name = std::string("static_detect/") + (moving ? "moving/" : "static/") + ResolutionName(resolution);
+      if (!runner.Enabled(name)) {
+        continue;
+      }
+      // Consecutive synthetic frames differ, a moving scene also refreshes the reference each time.
+      SyntheticCapturer source(BenchArgs(resolution, V4L2_PIX_FMT_YUV420));
+      auto first = source.GenerateFrame()->ToI420();
+      auto second = source.GenerateFrame()->ToI420();
+      StaticFrameDetector detector(moving ? 0 : 1e9, 1000000);
+      int64_t ts_us = 0;
+      uint64_t frames = 0;
+      runner.Run(name, [&] {
+        ts_us += 33333;
+        detector.IsStatic(frames++ % 2 ? *second : *first, ts_us);
+      });
+    }
+  }
+}
+
+void BenchShmInput(BenchmarkRunner &runner) {
+  const std::vector<std::pair<std::string, uint32_t>> formats = {
+          {"i420", V4L2_PIX_FMT_YUV420}, {"nv12", V4L2_PIX_FMT_NV12}, {"yuyv", V4L2_PIX_FMT_YUYV}};
+  for (const auto &[format_name, format]: formats) {
+    for (const auto &resolution: kResolutions) {
+      std::string name = "shm_input/" + format_name + "/" + ResolutionName(resolution);
+      if (!runner.Enabled(name)) {
+        continue;
+      }
+      Args args = BenchArgs(resolution, V4L2_PIX_FMT_YUV420);
+      args.device_type = "shm";
+      args.shm_socket = "/tmp/webrtc-ros-bench-" + std::to_string(getpid()) + ".sock";
+      auto capturer = ShmCapturer::Create(args);
+
+      // Delivery includes ToI420(), the first thing the encoder does with a frame.
+      std::mutex mtx;
+      std::condition_variable cv;
+      uint64_t delivered = 0;
+      auto observer = capturer->AsFrameBufferObservable();
+      observer->Subscribe([&](std::shared_ptr<V4L2FrameBuffer> buffer) {
+        buffer->ToI420();
+        std::lock_guard<std::mutex> lock(mtx);
+        delivered++;
+        cv.notify_one();
+      });
+      auto send_and_wait = [&](ShmProducer &producer, const ShmProducer::Plane *planes,
+                               std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mtx);
+        const uint64_t target = delivered + 1;
+        lock.unlock();
+        if (!producer.Send(planes, FrameTracer::NowUs())) {
+          return false;
+        }
+        lock.lock();
+        return cv.wait_for(lock, timeout, [&] { return delivered >= target; });
+      };
+
+      // Source planes packed at their row widths, the producer restrides them into its slots.
+      const int w = resolution.width;
+      const int h = resolution.height;
+      const int cw = (w + 1) / 2;
+      const int ch = (h + 1) / 2;
+      std::vector<std::vector<uint8_t>> data;
+      std::vector<ShmProducer::Plane> planes;
+      if (format == V4L2_PIX_FMT_YUV420) {
+        data = {std::vector<uint8_t>(w * h, 128), std::vector<uint8_t>(cw * ch, 96),
+                std::vector<uint8_t>(cw * ch, 160)};
+        planes = {{data[0].data(), w}, {data[1].data(), cw}, {data[2].data(), cw}};
+      } else if (format == V4L2_PIX_FMT_NV12) {
+        data = {std::vector<uint8_t>(w * h, 128), std::vector<uint8_t>(cw * 2 * ch, 112)};
+        planes = {{data[0].data(), w}, {data[1].data(), cw * 2}};
+      } else {
+        data = {std::vector<uint8_t>(cw * 4 * h, 128)};
+        planes = {{data[0].data(), cw * 4}};
+      }
+
+      ShmProducer producer(args.shm_socket, format, w, h);
+      // The capturer picks the producer up asynchronously, frames before that are not seen.
+      bool connected = false;
+      for (int i = 0; i < 100 && !connected; i++) {
+        connected = send_and_wait(producer, planes.data(), std::chrono::milliseconds(20));
+      }
+      if (!connected) {
+        std::cerr << name << ": the capturer never took a frame" << std::endl;
+        continue;
+      }
+
+      uint64_t dropped = 0;
+      auto result = runner.Run(name, [&] {
+        if (!send_and_wait(producer, planes.data(), std::chrono::seconds(1))) {
+          dropped++;
+        }
+      });
+      result->counters["frames_per_sec"] = 1e6 / result->Mean();
+      result->counters["dropped"] = dropped;
+    }
+  }
+}
+
+void BenchEncode(BenchmarkRunner &runner) {
+  const Resolution resolution = {1280, 720};
+  for (const auto &preset: kPresets) {
+    for (const auto &thread_type: kThreadTypes) {
+      std::string name = "encode/" + preset + "/" + thread_type + "/" + ResolutionName(resolution);
+      if (!runner.Enabled(name)) {
+        continue;
+      }
+      Args args = BenchArgs(resolution, V4L2_PIX_FMT_YUV420);
+      args.encoder_preset = preset;
+      args.encoder_thread_type = thread_type;
+
+      SyntheticCapturer source(args);
+      BenchEncoder encoder(args);
+      uint64_t frames = 0;
+      uint64_t bytes = 0;
+      auto observer = encoder.AsFrameBufferObservable();
+      observer->Subscribe([&](std::shared_ptr<EncodedFrameBuffer> buffer) {
+        frames++;
+        bytes += buffer->size();
+      });
+
+      auto result = runner.Run(name, [&] { encoder.EncodeBuffer(source.GenerateFrame()); });
+      result->counters["bytes_per_frame"] = frames ? static_cast<double>(bytes) / frames : 0;
+    }
+  }
+}
+
+// The mean luma and chroma PSNR of `encoded` decoded again, each frame against the
+// source with its frame ID. 0 when the decoder is missing.
+double DecodedPsnr(AVCodecID codec_id, const std::vector<std::shared_ptr<EncodedFrameBuffer>> &encoded,
+                   const std::vector<std::shared_ptr<I420Buffer>> &sources) {
+  const AVCodec *codec = avcodec_find_decoder(codec_id);
+  AVCodecContext *ctx = codec ? avcodec_alloc_context3(codec) : nullptr;
+  if (!ctx || avcodec_open2(ctx, codec, nullptr) < 0) {
+    avcodec_free_context(&ctx);
+    return 0;
+  }
+  AVPacket *pkt = av_packet_alloc();
+  AVFrame *frame = av_frame_alloc();
+
+  double psnr_sum = 0;
+  int frames = 0;
+  auto receive = [&] {
+    while (avcodec_receive_frame(ctx, frame) == 0) {
+      const auto &source = sources[frame->pts % sources.size()];
+      if (frame->format == AV_PIX_FMT_YUV420P && frame->width == source->width() &&
+          frame->height == source->height()) {
+        psnr_sum += libyuv::I420Psnr(source->DataY(), source->StrideY(), source->DataU(), source->StrideU(),
+                                     source->DataV(), source->StrideV(), frame->data[0], frame->linesize[0],
+                                     frame->data[1], frame->linesize[1], frame->data[2], frame->linesize[2],
+                                     frame->width, frame->height);
+        frames++;
+      }
+    }
+  };
+  for (const auto &buffer: encoded) {
+    // Decoders read past the end of the packet, av_new_packet pads it.
+    if (av_new_packet(pkt, static_cast<int>(buffer->size())) < 0) {
+      break;
+    }
+    memcpy(pkt->data, buffer->data(), buffer->size());
+    pkt->pts = static_cast<int64_t>(buffer->frame_id());
+    if (avcodec_send_packet(ctx, pkt) == 0) {
+      receive();
+    }
+    av_packet_unref(pkt);
+  }
+  avcodec_send_packet(ctx, nullptr);
+  receive();
+
+  av_frame_free(&frame);
+  av_packet_free(&pkt);
+  avcodec_free_context(&ctx);
+  return frames ? psnr_sum / frames : 0;
+}
+
+// Quality against bitrate per codec, on the same synthetic clip, to pick `--codec`
+// for a given uplink. Codecs this libav build cannot encode are skipped.
+void BenchEncodeQuality(BenchmarkRunner &runner) {
+  const Resolution resolution = {1280, 720};
+  const int kSourceFrames = 32;
+  std::vector<std::shared_ptr<I420Buffer>> sources;
+
+  for (const auto &[codec, codec_id]: kCodecs) {
+    for (int kbps: kQualityBitrates) {
+      const std::string name = "encode_quality/" + codec + "/" + std::to_string(kbps);
+      if (!runner.Enabled(name)) {
+        continue;
+      }
+      if (sources.empty()) {
+        sources = EncoderCalibration::SyntheticFrames(resolution.width, resolution.height, kSourceFrames);
+      }
+      Args args = BenchArgs(resolution, V4L2_PIX_FMT_YUV420);
+      args.codec = codec;
+      args.bitrate = kbps;
+
+      std::unique_ptr<BenchEncoder> encoder;
+      try {
+        encoder = std::make_unique<BenchEncoder>(args);
+      } catch (const std::runtime_error &e) {
+        ERROR_PRINT("%s, skipping %s", e.what(), name.c_str());
+        continue;
+      }
+      std::vector<std::shared_ptr<EncodedFrameBuffer>> encoded;
+      auto observer = encoder->AsFrameBufferObservable();
+      observer->Subscribe([&](std::shared_ptr<EncodedFrameBuffer> buffer) { encoded.push_back(buffer); });
+
+      const int64_t interval_us = 1000000 / args.fps;
+      int64_t index = 0;
+      // Enough frames for the rate control to settle.
+      auto result = runner.Run(name, std::max(runner.iterations(), args.fps * 5), [&] {
+        encoder->EncodeFrame(sources[index % sources.size()], (index + 1) * interval_us);
+        index++;
+      });
+      size_t bytes = 0;
+      for (const auto &buffer: encoded) {
+        bytes += buffer->size();
+      }
+      result->counters["kbps"] = index ? bytes * 8.0 * args.fps / index / 1000 : 0;
+      result->counters["psnr_db"] = DecodedPsnr(codec_id, encoded, sources);
+    }
+  }
+}
+
+void BenchSubjectFanOut(BenchmarkRunner &runner) {
+  const int kCallsPerSample = 1000;
+  for (int subscribers: kSubscriberCounts) {
+    std::string name = "subject_next/" + std::to_string(subscribers);
+    if (!runner.Enabled(name)) {
+      continue;
+    }
+
+    Subject<std::shared_ptr<EncodedFrameBuffer>> subject;
+    std::vector<std::shared_ptr<Observable<std::shared_ptr<EncodedFrameBuffer>>>> observers;
+    std::atomic<uint64_t> received{0};
+    for (int i = 0; i < subscribers; i++) {
+      observers.push_back(subject.AsObservable());
+      observers.back()->Subscribe([&received](std::shared_ptr<EncodedFrameBuffer> buffer) {
+        received.fetch_add(buffer->size(), std::memory_order_relaxed);
+      });
+    }
+
+    static uint8_t payload[1] = {0};
+    auto frame = EncodedFrameBuffer::Create(payload, sizeof(payload), false, 0);
+    auto result = runner.Run(name, [&] {
+      for (int i = 0; i < kCallsPerSample; i++) {
+        subject.Next(frame);
+      }
+    });
+    result->counters["ns_per_next"] = result->Mean() * 1000 / kCallsPerSample;
+  }
+}
+
+void BenchSdpParsing(BenchmarkRunner &runner) {
+  const int kParsesPerSample = 100;
+  const std::string offer(kSampleOffer);
+
+  auto candidates = runner.Run("sdp/parse_candidates", [&] {
+    for (int i = 0; i < kParsesPerSample; i++) {
+      HttpSession::ParseCandidates(offer);
+    }
+  });
+  if (candidates) {
+    candidates->counters["us_per_parse"] = candidates->Mean() / kParsesPerSample;
+  }
+
+  auto description = runner.Run("sdp/parse_description", [&] {
+    for (int i = 0; i < kParsesPerSample; i++) {
+      rtc::Description desc(offer, "offer");
+    }
+  });
+  if (description) {
+    description->counters["us_per_parse"] = description->Mean() / kParsesPerSample;
+  }
+}
+
+// The span from the first to the last traced stage of every frame.
+std::vector<double> CaptureToSendUs(const std::vector<TraceEvent> &events) {
+  std::map<uint64_t, std::pair<int64_t, int64_t>> frame_spans;
+  for (const auto &event: events) {
+    auto it = frame_spans.emplace(event.frame_id, std::make_pair(event.begin_us, event.end_us)).first;
+    it->second.first = std::min(it->second.first, event.begin_us);
+    it->second.second = std::max(it->second.second, event.end_us);
+  }
+
+  std::vector<double> samples_us;
+  for (const auto &[frame_id, span]: frame_spans) {
+    samples_us.push_back(static_cast<double>(span.second - span.first));
+  }
+  return samples_us;
+}
+
+void BenchPipeline(BenchmarkRunner &runner, int seconds) {
+  const std::string prefix = "pipeline/mjpeg/1280x720";
+  if (!runner.Enabled(prefix)) {
+    return;
+  }
+
+  Args args = BenchArgs({1280, 720}, V4L2_PIX_FMT_MJPEG);
+  args.stun_url = "";
+  auto webrtc = V4L2Webrtc::Create(args);
+
+  PeerConfig config;
+  config.has_candidates_in_sdp = true;
+  auto sender = webrtc->CreatePeerConnection(config);
+  LoopbackReceiver receiver(sender);
+  if (!receiver.WaitConnected(std::chrono::seconds(10))) {
+    ERROR_PRINT("loopback peer did not connect, skipping %s", prefix.c_str());
+    return;
+  }
+
+  auto &tracer = FrameTracer::Instance();
+  tracer.Start();
+  tracer.Clear();
+  uint64_t frames_before = receiver.frames();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  tracer.Stop();
+  uint64_t frames_received = receiver.frames() - frames_before;
+
+  const auto events = tracer.Snapshot();
+  std::map<TraceStage, BenchmarkResult> stages;
+  for (const auto &event: events) {
+    stages[event.stage].samples_us.push_back(static_cast<double>(event.end_us - event.begin_us));
+  }
+
+  for (auto &[stage, result]: stages) {
+    result.name = prefix + "/" + TraceStageName(stage);
+    runner.Add(std::move(result));
+  }
+
+  BenchmarkResult total;
+  total.name = prefix + "/capture_to_send";
+  total.samples_us = CaptureToSendUs(events);
+  total.counters["received_fps"] = static_cast<double>(frames_received) / seconds;
+  total.counters["received_kbps"] = static_cast<double>(receiver.bytes()) * 8 / 1000 / seconds;
+  runner.Add(std::move(total));
+}
+
+// The pipeline of `pipeline/mjpeg` competing with a busy loop on every core,
+// once with all threads floating and once with capture, encode and send on
+// their own CPUs and capture and send under SCHED_FIFO. Without CAP_SYS_NICE
+// only the affinity takes effect. libdatachannel's threads are already running
+// by then and keep floating.
+void BenchTopology(BenchmarkRunner &runner, int seconds) {
+  const int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  for (const std::string mode: {"floating", "pinned"}) {
+    const std::string name = "pipeline/topology/" + mode;
+    if (!runner.Enabled(name)) {
+      continue;
+    }
+
+    Args args = BenchArgs({1280, 720}, V4L2_PIX_FMT_MJPEG);
+    args.stun_url = "";
+    if (mode == "pinned") {
+      args.capture_policy = {{0}, 10};
+      args.send_policy = {{cores - 1}, 10};
+      for (int cpu = 1; cpu < cores - 1; cpu++) {
+        args.encode_policy.cpus.push_back(cpu);
+      }
+      if (args.encode_policy.cpus.empty()) {
+        args.encode_policy.cpus.push_back(cores - 1);
+      }
+    }
+
+    std::atomic<bool> loaded(true);
+    std::vector<std::thread> load;
+    for (int i = 0; i < cores; i++) {
+      load.emplace_back([&loaded]() {
+        volatile uint64_t spins = 0;
+        while (loaded.load(std::memory_order_relaxed)) {
+          spins = spins + 1;
+        }
+      });
+    }
+
+    {
+      auto webrtc = V4L2Webrtc::Create(args);
+      PeerConfig config;
+      config.has_candidates_in_sdp = true;
+      auto sender = webrtc->CreatePeerConnection(config);
+      LoopbackReceiver receiver(sender);
+      if (receiver.WaitConnected(std::chrono::seconds(10))) {
+        auto &tracer = FrameTracer::Instance();
+        tracer.Start();
+        tracer.Clear();
+        uint64_t frames_before = receiver.frames();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        tracer.Stop();
+
+        BenchmarkResult result;
+        result.name = name;
+        result.samples_us = CaptureToSendUs(tracer.Snapshot());
+        result.counters["received_fps"] = static_cast<double>(receiver.frames() - frames_before) / seconds;
+        result.counters["load_threads"] = cores;
+        runner.Add(std::move(result));
+      } else {
+        ERROR_PRINT("loopback peer did not connect, skipping %s", name.c_str());
+      }
+      sender->Terminate();
+    }
+
+    loaded.store(false);
+    for (auto &thread: load) {
+      thread.join();
+    }
+  }
+}
+
+// Open file descriptors of this process, the sockets of every transport among them.
+int OpenFds() {
+  std::error_code ec;
+  int count = 0;
+  for (auto it = std::filesystem::directory_iterator("/proc/self/fd", ec); it != std::filesystem::directory_iterator();
+       it.increment(ec)) {
+    count++;
+  }
+  return count;
+}
+
+// A viewer of several cameras, either with a peer per camera or with one peer
+// carrying a track per camera. Times the offer up to the first frame on every
+// track and counts the descriptors the viewer's transports hold.
+void BenchPeerSetup(BenchmarkRunner &runner) {
+  const int kCameras = 4;
+  const int kRuns = 10;
+  std::vector<std::shared_ptr<V4L2Webrtc>> cameras;
+
+  for (const std::string mode: {"separate", "bundled"}) {
+    const std::string name = "peer_setup/" + mode + "/" + std::to_string(kCameras);
+    if (!runner.Enabled(name)) {
+      continue;
+    }
+    if (cameras.empty()) {
+      for (int i = 0; i < kCameras; i++) {
+        Args args = BenchArgs({640, 480}, V4L2_PIX_FMT_YUV420);
+        args.stun_url = "";
+        args.camera_name = "cam" + std::to_string(i);
+        args.encoder_threads = 1;
+        cameras.push_back(V4L2Webrtc::Create(args));
+      }
+    }
+
+    // Answer without waiting for gathering, the receiver learns the sender's
+    // address from its connectivity checks.
+    PeerConfig config;
+    config.has_candidates_in_sdp = false;
+    BenchmarkResult result;
+    result.name = name;
+    double fds = 0;
+    int failed = 0;
+    for (int run = 0; run < kRuns; run++) {
+      const int fds_before = OpenFds();
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::shared_ptr<RtcPeer>> senders;
+      std::vector<std::unique_ptr<LoopbackReceiver>> receivers;
+      if (mode == "bundled") {
+        senders.push_back(V4L2Webrtc::CreatePeerConnection(cameras, config));
+        receivers.push_back(std::make_unique<LoopbackReceiver>(senders.back(), nullptr, kCameras));
+      } else {
+        for (const auto &camera: cameras) {
+          senders.push_back(camera->CreatePeerConnection(config));
+          receivers.push_back(std::make_unique<LoopbackReceiver>(senders.back()));
+        }
+      }
+
+      bool received = true;
+      for (const auto &receiver: receivers) {
+        received = receiver->WaitFirstFrames(std::chrono::seconds(10)) && received;
+      }
+      if (received) {
+        result.samples_us.push_back(
+                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        fds += OpenFds() - fds_before;
+      } else {
+        failed++;
+      }
+      receivers.clear();
+      for (const auto &sender: senders) {
+        sender->Terminate();
+      }
+    }
+
+    result.counters["fds_per_viewer"] = result.samples_us.empty() ? 0 : fds / result.samples_us.size();
+    result.counters["failed"] = failed;
+    runner.Add(std::move(result));
+  }
+}
+
+// A link whose capacity drops from 2000 to 300 kbps and recovers to 1500 kbps.
+// Loss is the share of the send rate above capacity; the receiver reports loss
+// every 500 ms and, when `with_remb` is set, its estimate every second.
+void BenchConstrainedLink(BenchmarkRunner &runner, bool with_remb) {
+  const std::string name = std::string("bitrate/constrained_link/") + (with_remb ? "remb" : "loss_only");
+  if (!runner.Enabled(name)) {
+    return;
+  }
+
+  struct Phase {
+    int seconds;
+    int capacity_kbps;
+  };
+  const std::vector<Phase> phases = {{20, 2000}, {20, 300}, {30, 1500}};
+  const auto kStep = std::chrono::milliseconds(100);
+
+  double drop_converge_s = -1;
+  double recover_converge_s = -1;
+  double utilization = 0;
+  double loss = 0;
+  int steps = 0;
+
+  auto simulate = [&] {
+    BitrateController controller(150, 2500, 2500);
+    auto now = BitrateController::Clock::time_point();
+    drop_converge_s = recover_converge_s = -1;
+    utilization = loss = 0;
+    steps = 0;
+
+    for (size_t p = 0; p < phases.size(); p++) {
+      const double capacity = phases[p].capacity_kbps;
+      const int phase_steps = phases[p].seconds * 1000 / kStep.count();
+      double lost_in_window = 0;
+      for (int i = 1; i <= phase_steps; i++) {
+        now += kStep;
+        const double target = controller.target_kbps();
+        const double step_loss = target > capacity ? (target - capacity) / target : 0;
+        lost_in_window += step_loss;
+        utilization += std::min(target, capacity) / capacity;
+        loss += step_loss;
+        steps++;
+
+        if (with_remb && i % 10 == 0) {
+          controller.OnReceiverEstimate(static_cast<unsigned int>(capacity * 1000), now);
+        }
+        if (i % 5 == 0) {
+          controller.OnPacketLoss(lost_in_window / 5, now);
+          lost_in_window = 0;
+        }
+
+        const double elapsed_s = i * kStep.count() / 1000.0;
+        if (p == 1 && drop_converge_s < 0 && controller.target_kbps() <= capacity) {
+          drop_converge_s = elapsed_s;
+        }
+        if (p == 2 && recover_converge_s < 0 && controller.target_kbps() >= capacity * 0.8) {
+          recover_converge_s = elapsed_s;
+        }
+      }
+    }
+  };
+
+  auto result = runner.Run(name, 10, simulate);
+  result->counters["drop_converge_s"] = drop_converge_s;
+  result->counters["recover_converge_s"] = recover_converge_s;
+  result->counters["mean_utilization"] = utilization / steps;
+  result->counters["mean_loss"] = loss / steps;
+}
+
+// Streams to a loopback viewer, then has it send REMB capped at 300 kbps and
+// checks that the encoder follows and the received rate stays near the cap.
+void BenchLoopbackRemb(BenchmarkRunner &runner, int seconds) {
+  const std::string name = "bitrate/loopback_remb";
+  if (!runner.Enabled(name)) {
+    return;
+  }
+  const unsigned int kCapKbps = 300;
+  // Rate control overshoots a little, more than this means the cap is not applied.
+  const double kMaxOverCap = 1.5;
+
+  Args args = BenchArgs({640, 480}, V4L2_PIX_FMT_YUV420);
+  args.stun_url = "";
+  args.bitrate = 2000;
+  args.adaptive_bitrate = true;
+  auto webrtc = V4L2Webrtc::Create(args);
+
+  PeerConfig config;
+  config.has_candidates_in_sdp = true;
+  auto sender = webrtc->CreatePeerConnection(config);
+  LoopbackReceiver receiver(sender);
+  if (!receiver.WaitConnected(std::chrono::seconds(10))) {
+    ERROR_PRINT("loopback peer did not connect, skipping %s", name.c_str());
+    return;
+  }
+
+  uint64_t bytes_before = receiver.bytes();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  const double kbps_before = static_cast<double>(receiver.bytes() - bytes_before) * 8 / 1000 / seconds;
+
+  BenchmarkResult result;
+  result.name = name;
+  auto start = std::chrono::steady_clock::now();
+  double converge_s = -1;
+  while (std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+    receiver.RequestBitrate(kCapKbps * 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    if (webrtc->encoder()->settings().bitrate <= static_cast<int>(kCapKbps)) {
+      converge_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      break;
+    }
+  }
+  result.samples_us.push_back(converge_s * 1e6);
+
+  // Let the rate controller drain what it encoded at the old bitrate.
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  bytes_before = receiver.bytes();
+  for (int i = 0; i < seconds * 2; i++) {
+    receiver.RequestBitrate(kCapKbps * 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+  const double kbps_after = static_cast<double>(receiver.bytes() - bytes_before) * 8 / 1000 / seconds;
+
+  result.counters["received_kbps_before"] = kbps_before;
+  result.counters["received_kbps_capped"] = kbps_after;
+  result.counters["encoder_kbps"] = webrtc->encoder()->settings().bitrate;
+  result.counters["converge_s"] = converge_s;
+  if (converge_s < 0) {
+    result.error = "the encoder did not drop to " + std::to_string(kCapKbps) + " kbps within 10 s";
+  } else if (kbps_after > kCapKbps * kMaxOverCap) {
+    result.error = "received " + std::to_string(static_cast<int>(kbps_after)) + " kbps under a " +
+                   std::to_string(kCapKbps) + " kbps cap";
+  }
+  if (!result.error.empty()) {
+    ERROR_PRINT("%s: %s", name.c_str(), result.error.c_str());
+  }
+  runner.Add(std::move(result));
+}
+
+// Identifies an access unit on both sides of the loopback by its last bytes,
+// which are slice data and survive depacketization unchanged.
+size_t FrameKey(const uint8_t *data, size_t size) {
+  const size_t tail = std::min<size_t>(size, 64);
+  return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char *>(data + size - tail), tail));
+}
+
+// Compares periodic IDRs against x264 intra refresh: the size and RTP packet count
+// of every encoded frame, and the capture-to-receive latency over the loopback peer.
+void BenchIntraRefresh(BenchmarkRunner &runner, int seconds) {
+  const Resolution resolution = {1280, 720};
+  const size_t kRtpPayloadSize = 1200;
+
+  for (bool intra_refresh: {false, true}) {
+    const std::string prefix = std::string("keyframe/") + (intra_refresh ? "intra_refresh" : "idr") + "/" +
+                               ResolutionName(resolution);
+    Args args = BenchArgs(resolution, V4L2_PIX_FMT_YUV420);
+    args.intra_refresh = intra_refresh;
+
+    if (runner.Enabled(prefix + "/frame_size")) {
+      SyntheticCapturer source(args);
+      BenchEncoder encoder(args);
+      BenchmarkResult sizes;
+      auto observer = encoder.AsFrameBufferObservable();
+      observer->Subscribe([&](std::shared_ptr<EncodedFrameBuffer> buffer) {
+        sizes.samples_us.push_back(static_cast<double>(buffer->size()));
+      });
+
+      // At least a few GOPs, so the IDRs show up in the tail.
+      auto result = runner.Run(prefix + "/frame_size", std::max(runner.iterations(), args.fps * 5),
+                               [&] { encoder.EncodeBuffer(source.GenerateFrame()); });
+      BenchmarkResult packets;
+      for (double size: sizes.samples_us) {
+        packets.samples_us.push_back(std::ceil(size / kRtpPayloadSize));
+      }
+      result->counters["bytes_p50"] = sizes.Percentile(50);
+      result->counters["bytes_p99"] = sizes.Percentile(99);
+      result->counters["bytes_max"] = sizes.Percentile(100);
+      result->counters["max_over_mean"] = sizes.Mean() > 0 ? sizes.Percentile(100) / sizes.Mean() : 0;
+      result->counters["packets_p99"] = packets.Percentile(99);
+      result->counters["packets_max"] = packets.Percentile(100);
+    }
+
+    const std::string name = prefix + "/glass_to_glass";
+    if (!runner.Enabled(name)) {
+      continue;
+    }
+
+    args.stun_url = "";
+    auto webrtc = V4L2Webrtc::Create(args);
+    std::mutex mtx;
+    std::unordered_map<size_t, uint64_t> sent_frames;
+    std::unordered_map<size_t, int64_t> arrivals;
+    auto sent_observer = webrtc->encoder()->AsFrameBufferObservable();
+    sent_observer->Subscribe([&](std::shared_ptr<EncodedFrameBuffer> buffer) {
+      std::lock_guard<std::mutex> lock(mtx);
+      sent_frames[FrameKey(buffer->data(), buffer->size())] = buffer->frame_id();
+    });
+
+    PeerConfig config;
+    config.has_candidates_in_sdp = true;
+    auto sender = webrtc->CreatePeerConnection(config);
+    LoopbackReceiver receiver(sender, [&](const rtc::binary &frame, const rtc::FrameInfo &) {
+      const int64_t now_us = FrameTracer::NowUs();
+      std::lock_guard<std::mutex> lock(mtx);
+      arrivals[FrameKey(reinterpret_cast<const uint8_t *>(frame.data()), frame.size())] = now_us;
+    });
+    if (!receiver.WaitConnected(std::chrono::seconds(10))) {
+      ERROR_PRINT("loopback peer did not connect, skipping %s", name.c_str());
+      continue;
+    }
+
+    auto &tracer = FrameTracer::Instance();
+    tracer.Start();
+    tracer.Clear();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    tracer.Stop();
+
+    std::unordered_map<uint64_t, int64_t> capture_us;
+    for (const auto &event: tracer.Snapshot()) {
+      if (event.stage == TraceStage::Dequeue) {
+        capture_us[event.frame_id] = event.begin_us;
+      }
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto &[key, arrival_us]: arrivals) {
+      auto sent = sent_frames.find(key);
+      if (sent == sent_frames.end()) {
+        continue;
+      }
+      auto captured = capture_us.find(sent->second);
+      if (captured != capture_us.end()) {
+        result.samples_us.push_back(static_cast<double>(arrival_us - captured->second));
+      }
+    }
+    result.counters["frames_matched"] = static_cast<double>(result.samples_us.size());
+    runner.Add(std::move(result));
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string filter;
+  std::string json_file;
+  int iterations = 100;
+  int warmup = 3;
+  int pipeline_seconds = 5;
+
+  bpo::options_description opts("Options");
+  // clang-format off
+    opts.add_options()
+        ("help,h", "Display the help message")
+        ("filter", bpo::value<std::string>(&filter)->default_value(filter),
+            "Only run benchmarks whose name contains this string, e.g. `to_i420/mjpeg`.")
+        ("iterations", bpo::value<int>(&iterations)->default_value(iterations), "Timed iterations per benchmark.")
+        ("warmup", bpo::value<int>(&warmup)->default_value(warmup), "Untimed iterations before each benchmark.")
+        ("pipeline-seconds", bpo::value<int>(&pipeline_seconds)->default_value(pipeline_seconds),
+            "How long the end-to-end pipeline benchmark streams to the loopback peer.")
+        ("json", bpo::value<std::string>(&json_file)->default_value(json_file),
+            "Write machine-readable results to this file.");
+  // clang-format on
+
+  bpo::variables_map vm;
+  try {
+    bpo::store(bpo::parse_command_line(argc, argv, opts), vm);
+    bpo::notify(vm);
+  } catch (const bpo::error &ex) {
+    std::cerr << "Error parsing arguments: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  if (vm.count("help")) {
+    std::cout << opts << std::endl;
+    return 1;
+  }
+
+  BenchmarkRunner runner(filter, iterations, warmup);
+  BenchToI420(runner);
+  BenchToI420Transform(runner);
+  BenchStaticDetect(runner);
+  BenchShmInput(runner);
+  BenchEncode(runner);
+  BenchEncodeQuality(runner);
+  BenchSubjectFanOut(runner);
+  BenchSdpParsing(runner);
+  BenchPipeline(runner, pipeline_seconds);
+  BenchTopology(runner, pipeline_seconds);
+  BenchPeerSetup(runner);
+  BenchConstrainedLink(runner, true);
+  BenchConstrainedLink(runner, false);
+  BenchLoopbackRemb(runner, pipeline_seconds);
+  BenchIntraRefresh(runner, pipeline_seconds);
+
+  runner.PrintTable();
+  if (!json_file.empty() && !runner.WriteJson(json_file)) {
+    return 1;
+  }
+  return runner.Failed() ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <thread>
+
+#include "common/logging.h"
+
+double BenchmarkResult::Mean() const {
+  if (samples_us.empty()) {
+    return 0;
+  }
+  return std::accumulate(samples_us.begin(), samples_us.end(), 0.0) / samples_us.size();
+}
+
+double BenchmarkResult::Percentile(double p) const {
+  if (samples_us.empty()) {
+    return 0;
+  }
+  std::vector<double> sorted(samples_us);
+  std::sort(sorted.begin(), sorted.end());
+  size_t index = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+  return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+BenchmarkRunner::BenchmarkRunner(std::string filter, int iterations, int warmup) :
+    filter_(std::move(filter)), iterations_(iterations), warmup_(warmup) {}
+
+bool BenchmarkRunner::Enabled(const std::string &name) const {
+  return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+int BenchmarkRunner::iterations() const { return iterations_; }
+
+BenchmarkResult *BenchmarkRunner::Run(const std::string &name, const std::function<void()> &fn) {
+  return Run(name, iterations_, fn);
+}
+
+BenchmarkResult *BenchmarkRunner::Run(const std::string &name, int iterations, const std::function<void()> &fn) {
+  if (!Enabled(name)) {
+    return nullptr;
+  }
+
+  for (int i = 0; i < warmup_; i++) {
+    fn();
+  }
+
+  BenchmarkResult result;
+  result.name = name;
+  result.samples_us.reserve(iterations);
+  for (int i = 0; i < iterations; i++) {
+    auto t_start = std::chrono::steady_clock::now();
+    fn();
+    auto t_end = std::chrono::steady_clock::now();
+    result.samples_us.push_back(std::chrono::duration<double, std::micro>(t_end - t_start).count());
+  }
+
+  INFO_PRINT("%-48s %10.1f us", name.c_str(), result.Mean());
+  return Add(std::move(result));
+}
+
+BenchmarkResult *BenchmarkRunner::Add(BenchmarkResult result) {
+  results_.push_back(std::move(result));
+  return &results_.back();
+}
+
+bool BenchmarkRunner::Failed() const {
+  return std::any_of(results_.begin(), results_.end(), [](const auto &result) { return !result.error.empty(); });
+}
+
+void BenchmarkRunner::PrintTable() const {
+  printf("\n%-48s %8s %10s %10s %10s %10s\n", "benchmark", "iters", "mean(us)", "p50(us)", "p99(us)", "max(us)");
+  for (const auto &result: results_) {
+    printf("%-48s %8zu %10.1f %10.1f %10.1f %10.1f\n", result.name.c_str(), result.samples_us.size(), result.Mean(),
+           result.Percentile(50), result.Percentile(99), result.Percentile(100));
+    for (const auto &[key, value]: result.counters) {
+      printf("    %-44s %g\n", key.c_str(), value);
+    }
+    if (!result.error.empty()) {
+      printf("    FAILED: %s\n", result.error.c_str());
+    }
+  }
+}
+
+bool BenchmarkRunner::WriteJson(const std::string &file_path) const {
+  std::ofstream file(file_path, std::ios::out | std::ios::trunc);
+  if (!file.is_open()) {
+    ERROR_PRINT("failed to open %s", file_path.c_str());
+    return false;
+  }
+
+  file << "{\"version\":1,\"hardware_concurrency\":" << std::thread::hardware_concurrency() << ",\"benchmarks\":[";
+  for (size_t i = 0; i < results_.size(); i++) {
+    const auto &result = results_[i];
+    file << (i ? "," : "") << "\n{\"name\":\"" << result.name << "\",\"iterations\":" << result.samples_us.size()
+         << ",\"mean_us\":" << result.Mean() << ",\"min_us\":" << result.Percentile(0)
+         << ",\"p50_us\":" << result.Percentile(50) << ",\"p90_us\":" << result.Percentile(90)
+         << ",\"p99_us\":" << result.Percentile(99) << ",\"max_us\":" << result.Percentile(100) << ",\"counters\":{";
+    bool first = true;
+    for (const auto &[key, value]: result.counters) {
+      file << (first ? "" : ",") << "\"" << key << "\":" << value;
+      first = false;
+    }
+    file << "}";
+    if (!result.error.empty()) {
+      file << ",\"error\":\"" << result.error << "\"";
+    }
+    file << "}";
+  }
+  file << "\n]}\n";
+
+  INFO_PRINT("Benchmark results written to %s", file_path.c_str());
+  return true;
+}
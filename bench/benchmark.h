@@ -0,0 +1,55 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchmarkResult {
+  std::string name;
+  std::vector<double> samples_us;
+  std::map<std::string, double> counters;
+  // Set when the case checks an outcome and it was not met, the run then exits non-zero.
+  std::string error;
+
+  double Mean() const;
+  double Percentile(double p) const;
+};
+
+/*
+ * A minimal timing harness. Each case runs a few warm-up iterations, then
+ * records the wall time of every iteration so the report carries percentiles
+ * and not only a mean. Results are printed as a table and optionally written
+ * as JSON for regression gating in CI.
+ */
+class BenchmarkRunner {
+public:
+  BenchmarkRunner(std::string filter, int iterations, int warmup);
+
+  bool Enabled(const std::string &name) const;
+  int iterations() const;
+
+  // Times `fn` for the configured number of iterations.
+  BenchmarkResult *Run(const std::string &name, const std::function<void()> &fn);
+  // Times `fn` for an explicit number of iterations, for cases far slower or faster than the default.
+  BenchmarkResult *Run(const std::string &name, int iterations, const std::function<void()> &fn);
+  // Records an externally measured result, e.g. per-stage timings of a pipeline run.
+  BenchmarkResult *Add(BenchmarkResult result);
+
+  // Whether any result carries an error.
+  bool Failed() const;
+
+  void PrintTable() const;
+  bool WriteJson(const std::string &file_path) const;
+
+private:
+  std::string filter_;
+  int iterations_;
+  int warmup_;
+  std::deque<BenchmarkResult> results_;
+};
+
+#endif // BENCHMARK_H_
@@ -0,0 +1,78 @@
+#include "loopback_peer.h"
+
+#include <algorithm>
+
+#include "common/logging.h"
+
+LoopbackReceiver::LoopbackReceiver(std::shared_ptr<RtcPeer> sender, OnFrameFunc on_frame, int tracks) :
+    sender_(std::move(sender)), on_frame_(std::move(on_frame)), frames_(0), bytes_(0), connected_(false),
+    track_frames_(tracks, 0) {
+  pc_ = std::make_shared<rtc::PeerConnection>(rtc::Configuration());
+
+  for (int i = 0; i < tracks; i++) {
+    rtc::Description::Video video(std::to_string(i), rtc::Description::Direction::RecvOnly);
+    video.addH264Codec(96);
+    auto track = pc_->addTrack(video);
+
+    auto depacketizer = std::make_shared<rtc::H264RtpDepacketizer>(rtc::NalUnit::Separator::StartSequence);
+    depacketizer->addToChain(std::make_shared<rtc::RtcpReceivingSession>());
+    track->setMediaHandler(depacketizer);
+    track->onFrame([this, i](rtc::binary data, rtc::FrameInfo info) {
+      frames_++;
+      bytes_ += data.size();
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        track_frames_[i]++;
+      }
+      cv_.notify_all();
+      if (on_frame_) {
+        on_frame_(data, info);
+      }
+    });
+    tracks_.push_back(std::move(track));
+  }
+
+  pc_->onStateChange([this](rtc::PeerConnection::State state) {
+    if (state == rtc::PeerConnection::State::Connected) {
+      std::lock_guard<std::mutex> lock(mtx_);
+      connected_ = true;
+      cv_.notify_all();
+    }
+  });
+
+  sender_->OnLocalSdp([this]([[maybe_unused]] const std::string &peer_id, const std::string &sdp,
+                             const std::string &type) { pc_->setRemoteDescription(rtc::Description(sdp, type)); });
+
+  // Offer only once all host candidates are in the SDP, as a non-trickle WHEP client would.
+  pc_->onGatheringStateChange([this](rtc::PeerConnection::GatheringState state) {
+    if (state == rtc::PeerConnection::GatheringState::Complete) {
+      auto offer = pc_->localDescription();
+      sender_->SetRemoteSdp(std::string(*offer), offer->typeString());
+    }
+  });
+  pc_->setLocalDescription();
+}
+
+LoopbackReceiver::~LoopbackReceiver() {
+  if (pc_) {
+    pc_->close();
+  }
+}
+
+bool LoopbackReceiver::WaitConnected(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  return cv_.wait_for(lock, timeout, [this] { return connected_; });
+}
+
+bool LoopbackReceiver::WaitFirstFrames(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  return cv_.wait_for(lock, timeout, [this] {
+    return std::all_of(track_frames_.begin(), track_frames_.end(), [](uint64_t frames) { return frames > 0; });
+  });
+}
+
+bool LoopbackReceiver::RequestBitrate(unsigned int bps) { return tracks_.front()->requestBitrate(bps); }
+
+uint64_t LoopbackReceiver::frames() const { return frames_.load(); }
+
+uint64_t LoopbackReceiver::bytes() const { return bytes_.load(); }
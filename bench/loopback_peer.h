@@ -0,0 +1,52 @@
+#ifndef LOOPBACK_PEER_H_
+#define LOOPBACK_PEER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "rtc/rtc.hpp"
+#include "rtc/rtc_peer.h"
+
+/*
+ * An in-process receive-only peer that negotiates directly with an RtcPeer,
+ * exchanging SDP through function calls instead of WHEP, and depacketizes the
+ * H.264 it receives over the loopback interface.
+ */
+class LoopbackReceiver {
+public:
+  using OnFrameFunc = std::function<void(const rtc::binary &frame, const rtc::FrameInfo &info)>;
+
+  // Offers `tracks` receive-only video m-lines, matching a multi-track sender.
+  LoopbackReceiver(std::shared_ptr<RtcPeer> sender, OnFrameFunc on_frame = nullptr, int tracks = 1);
+  ~LoopbackReceiver();
+
+  bool WaitConnected(std::chrono::milliseconds timeout);
+  // Waits until every track has delivered a frame.
+  bool WaitFirstFrames(std::chrono::milliseconds timeout);
+  // Sends a REMB asking the sender to stay below `bps`.
+  bool RequestBitrate(unsigned int bps);
+
+  uint64_t frames() const;
+  uint64_t bytes() const;
+
+private:
+  std::shared_ptr<RtcPeer> sender_;
+  std::shared_ptr<rtc::PeerConnection> pc_;
+  std::vector<std::shared_ptr<rtc::Track>> tracks_;
+  OnFrameFunc on_frame_;
+
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> bytes_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool connected_;
+  std::vector<uint64_t> track_frames_;
+};
+
+#endif // LOOPBACK_PEER_H_
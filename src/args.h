@@ -7,9 +7,35 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <linux/videodev2.h>
 
+#include "common/frame_transform.h"
+#include "common/thread_policy.h"
+
+// A resolution/bitrate variant a WHEP viewer can request with `?profile=<name>`.
+struct EncoderProfile {
+  int width;
+  int height;
+  int bitrate; // kbps
+};
+
+// A capture pipeline added with `--add-camera`, served at `/whep/<name>`. Unset
+// fields take the value of the global option.
+struct CameraSpec {
+  std::string name;
+  std::string camera;
+  std::optional<std::string> v4l2_format;
+  std::optional<int> width;
+  std::optional<int> height;
+  std::optional<int> fps;
+  std::optional<int> rotation;
+  std::optional<CropRect> crop;
+  std::optional<int> bitrate;
+  std::optional<std::string> codec;
+};
+
 struct Args {
   // video input
   int cameraId = 0;
@@ -17,17 +43,74 @@ struct Args {
   int width = 640;
   int height = 480;
   int rotation = 0;
+  // Applied in software while converting to I420, the encoder only sees the region.
+  CropRect crop;
   uint32_t format = V4L2_PIX_FMT_MJPEG;
   std::string camera = "v4l2:0";
+  std::string device_type = "v4l2";
   std::string v4l2_format = "mjpeg";
+  std::string shm_socket;
+  // The pipeline's name when several cameras run in one process, empty otherwise.
+  std::string camera_name;
+  std::vector<CameraSpec> cameras;
 
-  // h264
+  // encoder
+  // The codec of the pipeline's encoder; viewers whose offer lacks it get the
+  // first of `fallback_codecs` they offer, encoded only while watched.
+  std::string codec = "h264";
+  std::vector<std::string> fallback_codecs;
   int bitrate = 1000;
+  int min_bitrate = 150;
+  bool adaptive_bitrate = false;
+  int gop = 0;
+  std::string encoder_preset = "ultrafast";
+  std::string encoder_thread_type = "slice";
+  int encoder_threads = 0;
+  int encoder_slices = 4;
+  bool adaptive_quality = false;
+  int simulcast_layers = 1;
+  int temporal_layers = 1;
+  bool intra_refresh = false;
+  double static_threshold = 0;
+  int static_refresh_ms = 1000;
+  std::unordered_map<std::string, EncoderProfile> profiles;
+  bool calibrate_encoder = false;
+  std::string calibration_file = "/tmp/webrtc-ros-encoder-calibration.txt";
+  int calibration_frames = 60;
 
   // webrtc
+  double pacing_factor = 2.5;
+  int nack_history_ms = 1000;
+  int nack_history_kb = 4096;
+  bool latency_probe = false;
+  int playout_delay_ms = 0;
+  bool abs_capture_time = true;
   int peer_timeout = 10;
   uint16_t http_port = 8000;
   std::string stun_url = "stun:stun.l.google.com:19302";
+
+  // recording
+  std::string record_dir;
+  int record_segment_sec = 60;
+  int record_retention = 60;
+  std::string event_dir;
+  int preroll_sec = 30;
+  int preroll_mb = 64;
+
+  // shared-memory export
+  std::string export_socket;
+  int export_slots = 4;
+  bool export_h264 = false;
+
+  // thread placement, `--cpu-affinity` and `--realtime-priority` per stage
+  ThreadPolicy capture_policy;
+  ThreadPolicy encode_policy;
+  ThreadPolicy send_policy;
+  ThreadPolicy io_policy;
+
+  // tracing
+  bool trace = false;
+  std::string trace_file = "/tmp/webrtc-ros-trace.json";
 };
 
 #endif // ARGS_H_
@@ -0,0 +1,290 @@
+#include "capturer/shm_capturer.h"
+
+#include <cinttypes>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libyuv.h>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+static const int kBufferAlignment = 64;
+
+std::shared_ptr<ShmCapturer> ShmCapturer::Create(Args args) {
+  auto ptr = std::make_shared<ShmCapturer>(args);
+  ptr->StartCapture();
+  return ptr;
+}
+
+ShmCapturer::ShmCapturer(Args args) :
+    socket_path_(args.shm_socket), metric_labels_(Metrics::WithLabel("", "camera", args.camera_name)),
+    fps_(args.fps), width_(args.width), height_(args.height), config_(args),
+    listen_fd_(-1), stop_fd_(-1), conn_fd_(-1), event_fd_(-1), next_(0) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("shm input: socket path too long: " + socket_path_);
+  }
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(socket_path_.c_str());
+  if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(listen_fd_, 1) < 0) {
+    std::string error = strerror(errno);
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+    }
+    throw std::runtime_error("shm input: cannot listen on " + socket_path_ + ": " + error);
+  }
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+  INFO_PRINT("shm input: waiting for a producer on %s", socket_path_.c_str());
+}
+
+ShmCapturer::~ShmCapturer() {
+  uint64_t one = 1;
+  if (write(stop_fd_, &one, sizeof(one)) < 0) {
+    ERROR_PRINT("shm input: cannot stop the capture thread: %s", strerror(errno));
+  }
+  if (capture_thread_.joinable()) {
+    capture_thread_.join();
+  }
+  DropProducer();
+  close(stop_fd_);
+  close(listen_fd_);
+  unlink(socket_path_.c_str());
+}
+
+int ShmCapturer::fps() const { return fps_; }
+
+int ShmCapturer::width() const { return width_; }
+
+int ShmCapturer::height() const { return height_; }
+
+uint32_t ShmCapturer::format() const { return V4L2_PIX_FMT_YUV420; }
+
+Args ShmCapturer::config() const { return config_; }
+
+ShmCapturer &ShmCapturer::SetResolution(int width, int height) {
+  DEBUG_PRINT("  The producer decides the shm input resolution, ignoring %dx%d", width, height);
+  return *this;
+}
+
+ShmCapturer &ShmCapturer::SetFps(int fps) {
+  DEBUG_PRINT("  The producer decides the shm input frame rate, ignoring %d", fps);
+  return *this;
+}
+
+ShmCapturer &ShmCapturer::SetRotation(int angle) {
+  DEBUG_PRINT("  Rotation is not supported by shm input: %d", angle);
+  return *this;
+}
+
+ShmCapturer &ShmCapturer::SetControls([[maybe_unused]] int key, [[maybe_unused]] int value) { return *this; }
+
+void ShmCapturer::StartCapture() {
+  capture_thread_ = std::thread([this]() { Run(); });
+}
+
+void ShmCapturer::Run() {
+  ApplyThreadPolicy(config_.capture_policy, "capture");
+  while (true) {
+    // One producer at a time, a second one waits in the backlog until the first hangs up.
+    std::vector<pollfd> fds = {{stop_fd_, POLLIN, 0}};
+    if (ring_) {
+      fds.push_back({event_fd_, POLLIN, 0});
+      fds.push_back({conn_fd_, POLLIN, 0});
+    } else {
+      fds.push_back({listen_fd_, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ERROR_PRINT("shm input: poll failed: %s", strerror(errno));
+      return;
+    }
+
+    if (fds[0].revents) {
+      return;
+    }
+    if (!ring_) {
+      AcceptProducer();
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      uint64_t count;
+      if (read(event_fd_, &count, sizeof(count)) == sizeof(count)) {
+        TakeNewest();
+      }
+    }
+    // Producers send nothing after the hello, anything readable is them hanging up.
+    if (fds[2].revents) {
+      INFO_PRINT("shm input: producer disconnected");
+      DropProducer();
+    }
+  }
+}
+
+void ShmCapturer::AcceptProducer() {
+  int conn_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+  if (conn_fd < 0) {
+    return;
+  }
+
+  std::vector<int> ring_fds;
+  int event_fd = -1;
+  if (!ReceiveRings(conn_fd, &ring_fds, &event_fd)) {
+    ERROR_PRINT("shm input: unexpected hello from a producer");
+    close(conn_fd);
+    return;
+  }
+  std::shared_ptr<ShmRingReader> ring;
+  try {
+    if (ring_fds.size() != 1) {
+      throw std::runtime_error("shm input: expected one ring, got " + std::to_string(ring_fds.size()));
+    }
+    ring = std::make_shared<ShmRingReader>(ring_fds[0], true);
+    if (ring->format() != ShmFrameFormat::Raw) {
+      throw std::runtime_error("shm input: the producer's ring does not hold raw frames");
+    }
+  } catch (const std::runtime_error &e) {
+    ERROR_PRINT("%s", e.what());
+    ring.reset();
+  }
+  for (int fd: ring_fds) {
+    close(fd);
+  }
+  if (!ring) {
+    close(event_fd);
+    close(conn_fd);
+    return;
+  }
+
+  conn_fd_ = conn_fd;
+  event_fd_ = event_fd;
+  ring_ = std::move(ring);
+  next_ = ring_->published();
+  INFO_PRINT("shm input: producer connected");
+}
+
+void ShmCapturer::DropProducer() {
+  if (!ring_) {
+    return;
+  }
+  close(event_fd_);
+  close(conn_fd_);
+  event_fd_ = -1;
+  conn_fd_ = -1;
+  ring_.reset();
+}
+
+void ShmCapturer::TakeNewest() {
+  const uint64_t published = ring_->published();
+  if (published <= next_) {
+    return;
+  }
+  const uint64_t n = published - 1;
+  if (n > next_) {
+    Metrics::Instance().AddCounter("webrtc_shm_input_frames_skipped_total" + metric_labels_, n - next_);
+  }
+  next_ = published;
+
+  // Held throughout, so the producer can not rewrite the frame under the conversion or the encoder.
+  ShmFrameMeta meta;
+  const uint8_t *data = nullptr;
+  if (ring_->Hold(n)) {
+    data = ring_->Peek(n, &meta);
+    if (!data) {
+      // A payload larger than the slot is rejected after the hold succeeded, give it back.
+      ring_->Release(n);
+    }
+  }
+  if (!data) {
+    Metrics::Instance().AddCounter("webrtc_shm_input_frames_skipped_total" + metric_labels_);
+    return;
+  }
+
+  std::shared_ptr<I420Buffer> i420;
+  try {
+    i420 = ToI420(n, meta, data);
+  } catch (const std::exception &e) {
+    // Nothing took over the hold.
+    ring_->Release(n);
+    ERROR_PRINT("shm input: dropping frame %" PRIu64 ": %s", meta.frame_id, e.what());
+    return;
+  }
+
+  timeval tv;
+  int64_t capture_us = meta.capture_us;
+  if (!capture_us) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    capture_us = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+  tv.tv_sec = capture_us / 1000000;
+  tv.tv_usec = capture_us % 1000000;
+  Metrics::Instance().AddCounter("webrtc_shm_input_frames_total" + metric_labels_);
+  NextFrameBuffer(V4L2FrameBuffer::Create(std::move(i420), tv));
+}
+
+std::shared_ptr<I420Buffer> ShmCapturer::ToI420(uint64_t n, const ShmFrameMeta &meta, const uint8_t *data) {
+  const int width = meta.width;
+  const int height = meta.height;
+  const int chroma_rows = (height + 1) / 2;
+  // Planes lie back to back, so one past each ends where the next starts.
+  size_t plane_bytes[3] = {static_cast<size_t>(meta.stride_y) * height,
+                           static_cast<size_t>(meta.stride_u) * chroma_rows,
+                           static_cast<size_t>(meta.stride_v) * chroma_rows};
+  if (width <= 0 || height <= 0 || plane_bytes[0] + plane_bytes[1] + plane_bytes[2] > meta.size) {
+    throw std::runtime_error("frame larger than its payload");
+  }
+  // A row narrower than the frame would have the conversion read into the next row, and past the payload.
+  const uint32_t chroma_width = (static_cast<uint32_t>(width) + 1) / 2;
+  bool narrow = false;
+  if (meta.pixel_format == V4L2_PIX_FMT_YUV420) {
+    narrow = meta.stride_y < meta.width || meta.stride_u < chroma_width || meta.stride_v < chroma_width;
+  } else if (meta.pixel_format == V4L2_PIX_FMT_NV12) {
+    narrow = meta.stride_y < meta.width || meta.stride_u < 2 * chroma_width;
+  } else if (meta.pixel_format == V4L2_PIX_FMT_YUYV) {
+    narrow = meta.stride_y < 4 * chroma_width;
+  }
+  if (narrow) {
+    throw std::runtime_error("stride narrower than the frame");
+  }
+  const uint8_t *y = data;
+  const uint8_t *u = y + plane_bytes[0];
+  const uint8_t *v = u + plane_bytes[1];
+
+  if (meta.pixel_format == V4L2_PIX_FMT_YUV420) {
+    // Encoded in place, the slot goes back to the producer with the last reference.
+    std::shared_ptr<ShmRingReader> ring = ring_;
+    return I420Buffer::Wrap(width, height, const_cast<uint8_t *>(y), meta.stride_y, const_cast<uint8_t *>(u),
+                            meta.stride_u, const_cast<uint8_t *>(v), meta.stride_v,
+                            [ring, n]() { ring->Release(n); });
+  }
+
+  auto i420 = I420Buffer::Create(width, height, kBufferAlignment);
+  int result = -1;
+  if (meta.pixel_format == V4L2_PIX_FMT_NV12) {
+    result = libyuv::NV12ToI420(y, meta.stride_y, u, meta.stride_u, i420->MutableDataY(), i420->StrideY(),
+                                i420->MutableDataU(), i420->StrideU(), i420->MutableDataV(), i420->StrideV(), width,
+                                height);
+  } else if (meta.pixel_format == V4L2_PIX_FMT_YUYV) {
+    result = libyuv::YUY2ToI420(y, meta.stride_y, i420->MutableDataY(), i420->StrideY(), i420->MutableDataU(),
+                                i420->StrideU(), i420->MutableDataV(), i420->StrideV(), width, height);
+  } else {
+    throw std::runtime_error("unsupported pixel format " + V4L2Util::FourccToString(meta.pixel_format));
+  }
+  if (result < 0) {
+    throw std::runtime_error("conversion to I420 failed");
+  }
+  ring_->Release(n);
+  return i420;
+}
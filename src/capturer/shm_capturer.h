@@ -0,0 +1,66 @@
+#ifndef SHM_CAPTURER_H_
+#define SHM_CAPTURER_H_
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "args.h"
+#include "capturer/video_capturer.h"
+#include "common/shm_frame_ring.h"
+
+/*
+ * Takes frames from another process instead of a camera, e.g. images rendered
+ * or rectified by a ROS node, with `--camera shm:<socket>`. A producer (see
+ * ShmProducer) connects to the socket and hands over its shared-memory ring.
+ * I420 frames are wrapped in place and the slot is held until the encoder is
+ * done with it; NV12 and YUYV are converted to I420 straight out of the slot.
+ * Only the newest frame is taken on each wakeup, so a slow encoder skips frames
+ * rather than falling behind.
+ */
+class ShmCapturer : public VideoCapturer {
+public:
+  static std::shared_ptr<ShmCapturer> Create(Args args);
+
+  ShmCapturer(Args args);
+  ~ShmCapturer();
+  int fps() const override;
+  int width() const override;
+  int height() const override;
+  uint32_t format() const override;
+  Args config() const override;
+  void StartCapture() override;
+
+  ShmCapturer &SetControls(int key, int value) override;
+
+private:
+  ShmCapturer &SetResolution(int width, int height) override;
+  ShmCapturer &SetFps(int fps) override;
+  ShmCapturer &SetRotation(int angle) override;
+
+  void Run();
+  void AcceptProducer();
+  void DropProducer();
+  void TakeNewest();
+  std::shared_ptr<I420Buffer> ToI420(uint64_t n, const ShmFrameMeta &meta, const uint8_t *data);
+
+  const std::string socket_path_;
+  const std::string metric_labels_;
+  int fps_;
+  int width_;
+  int height_;
+  Args config_;
+
+  int listen_fd_;
+  // Wakes the capture thread up to exit.
+  int stop_fd_;
+  int conn_fd_;
+  int event_fd_;
+  // Shared with the I420 buffers wrapping its slots, which may outlive the producer.
+  std::shared_ptr<ShmRingReader> ring_;
+  uint64_t next_;
+
+  std::thread capture_thread_;
+};
+
+#endif // SHM_CAPTURER_H_
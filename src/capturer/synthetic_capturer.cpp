@@ -0,0 +1,211 @@
+#include "synthetic_capturer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include <jpeglib.h>
+#include <libyuv.h>
+
+#include "common/logging.h"
+
+// Enough distinct frames that the encoder can not settle into skip blocks.
+static const int kSyntheticFrameCount = 8;
+static const int kBufferAlignment = 64;
+
+static std::vector<uint8_t> CompressJpeg(const I420Buffer &i420) {
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+
+  unsigned char *out = nullptr;
+  unsigned long out_size = 0;
+  jpeg_mem_dest(&cinfo, &out, &out_size);
+
+  cinfo.image_width = i420.width();
+  cinfo.image_height = i420.height();
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_YCbCr;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 85, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  std::vector<uint8_t> row(i420.width() * 3);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    const int y = cinfo.next_scanline;
+    const uint8_t *src_y = i420.DataY() + y * i420.StrideY();
+    const uint8_t *src_u = i420.DataU() + (y / 2) * i420.StrideU();
+    const uint8_t *src_v = i420.DataV() + (y / 2) * i420.StrideV();
+    for (int x = 0; x < i420.width(); x++) {
+      row[x * 3] = src_y[x];
+      row[x * 3 + 1] = src_u[x / 2];
+      row[x * 3 + 2] = src_v[x / 2];
+    }
+    JSAMPROW row_ptr = row.data();
+    jpeg_write_scanlines(&cinfo, &row_ptr, 1);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  std::vector<uint8_t> jpeg(out, out + out_size);
+  free(out);
+  jpeg_destroy_compress(&cinfo);
+  return jpeg;
+}
+
+static void DrawPattern(I420Buffer &i420, int index, uint32_t &seed) {
+  const int w = i420.width();
+  const int h = i420.height();
+  const int box = std::max(w, h) / 8;
+  const int box_x = (w - box) * index / kSyntheticFrameCount;
+  const int box_y = (h - box) / 2;
+
+  for (int y = 0; y < h; y++) {
+    uint8_t *row = i420.MutableDataY() + y * i420.StrideY();
+    for (int x = 0; x < w; x++) {
+      seed = seed * 1664525 + 1013904223;
+      bool in_box = x >= box_x && x < box_x + box && y >= box_y && y < box_y + box;
+      row[x] = in_box ? 235 : static_cast<uint8_t>(((x + y + index * 4) & 0xbf) + (seed >> 28));
+    }
+  }
+  for (int y = 0; y < (h + 1) / 2; y++) {
+    uint8_t *row_u = i420.MutableDataU() + y * i420.StrideU();
+    uint8_t *row_v = i420.MutableDataV() + y * i420.StrideV();
+    for (int x = 0; x < (w + 1) / 2; x++) {
+      row_u[x] = static_cast<uint8_t>(64 + (x * 128) / w);
+      row_v[x] = static_cast<uint8_t>(64 + (y * 256) / h);
+    }
+  }
+}
+
+std::shared_ptr<SyntheticCapturer> SyntheticCapturer::Create(Args args) {
+  auto ptr = std::make_shared<SyntheticCapturer>(args);
+  ptr->StartCapture();
+  return ptr;
+}
+
+SyntheticCapturer::SyntheticCapturer(Args args) :
+    fps_(args.fps), width_(args.width), height_(args.height), format_(args.format), config_(args),
+    transform_(FrameTransform::Create(args.width, args.height, args.crop, args.rotation)), frame_index_(0),
+    capture_stop_(false) {
+  RenderFrames();
+}
+
+SyntheticCapturer::~SyntheticCapturer() {
+  capture_stop_ = true;
+  if (capture_thread_.joinable()) {
+    capture_thread_.join();
+  }
+}
+
+int SyntheticCapturer::fps() const { return fps_; }
+
+int SyntheticCapturer::width() const { return transform_.OutputWidth(); }
+
+int SyntheticCapturer::height() const { return transform_.OutputHeight(); }
+
+uint32_t SyntheticCapturer::format() const { return format_; }
+
+Args SyntheticCapturer::config() const { return config_; }
+
+SyntheticCapturer &SyntheticCapturer::SetResolution(int width, int height) {
+  width_ = width;
+  height_ = height;
+  transform_ = FrameTransform::Create(width, height, config_.crop, transform_.rotation);
+  RenderFrames();
+  return *this;
+}
+
+SyntheticCapturer &SyntheticCapturer::SetFps(int fps) {
+  fps_ = fps;
+  return *this;
+}
+
+SyntheticCapturer &SyntheticCapturer::SetRotation(int angle) {
+  transform_ = FrameTransform::Create(width_, height_, config_.crop, angle);
+  return *this;
+}
+
+SyntheticCapturer &SyntheticCapturer::SetControls([[maybe_unused]] int key, [[maybe_unused]] int value) {
+  return *this;
+}
+
+void SyntheticCapturer::RenderFrames() {
+  frames_.clear();
+  frame_sizes_.clear();
+  uint32_t seed = 0x1234;
+
+  for (int i = 0; i < kSyntheticFrameCount; i++) {
+    auto i420 = I420Buffer::Create(width_, height_, kBufferAlignment);
+    DrawPattern(*i420, i, seed);
+
+    const int chroma_w = (width_ + 1) / 2;
+    const int chroma_h = (height_ + 1) / 2;
+    std::vector<uint8_t> jpeg;
+    size_t size = 0;
+    if (format_ == V4L2_PIX_FMT_YUV420) {
+      size = size_t(width_) * height_ + size_t(chroma_w) * chroma_h * 2;
+    } else if (format_ == V4L2_PIX_FMT_YUYV) {
+      size = size_t(width_) * height_ * 2;
+    } else if (format_ == V4L2_PIX_FMT_MJPEG) {
+      jpeg = CompressJpeg(*i420);
+      size = jpeg.size();
+    } else {
+      throw std::runtime_error("synthetic source does not support format " + V4L2Util::FourccToString(format_));
+    }
+
+    std::unique_ptr<uint8_t, BoostAlignedFree> frame(
+            static_cast<uint8_t *>(boost::alignment::aligned_alloc(kBufferAlignment, size)), BoostAlignedFree{});
+    if (!frame)
+      throw std::bad_alloc();
+
+    uint8_t *dst = frame.get();
+    if (format_ == V4L2_PIX_FMT_YUV420) {
+      uint8_t *dst_u = dst + size_t(width_) * height_;
+      uint8_t *dst_v = dst_u + size_t(chroma_w) * chroma_h;
+      libyuv::I420Copy(i420->DataY(), i420->StrideY(), i420->DataU(), i420->StrideU(), i420->DataV(),
+                       i420->StrideV(), dst, width_, dst_u, chroma_w, dst_v, chroma_w, width_, height_);
+    } else if (format_ == V4L2_PIX_FMT_YUYV) {
+      libyuv::I420ToYUY2(i420->DataY(), i420->StrideY(), i420->DataU(), i420->StrideU(), i420->DataV(),
+                         i420->StrideV(), dst, width_ * 2, width_, height_);
+    } else {
+      memcpy(dst, jpeg.data(), jpeg.size());
+    }
+
+    frames_.push_back(std::move(frame));
+    frame_sizes_.push_back(static_cast<unsigned int>(size));
+  }
+
+  DEBUG_PRINT("Synthetic source rendered %d frames of %s(%dx%d)", kSyntheticFrameCount,
+              V4L2Util::FourccToString(format_).c_str(), width_, height_);
+}
+
+std::shared_ptr<V4L2FrameBuffer> SyntheticCapturer::GenerateFrame() {
+  size_t index = frame_index_++ % frames_.size();
+
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  auto buffer = V4L2Buffer::FromRaw(frames_[index].get(), frame_sizes_[index]);
+  buffer.pix_fmt = format_;
+  buffer.timestamp = {ts.tv_sec, ts.tv_nsec / 1000};
+  auto frame_buffer = V4L2FrameBuffer::Create(width_, height_, buffer);
+  frame_buffer->SetTransform(transform_);
+  return frame_buffer;
+}
+
+void SyntheticCapturer::StartCapture() {
+  capture_thread_ = std::thread([this]() {
+    ApplyThreadPolicy(config_.capture_policy, "capture");
+    auto interval = std::chrono::microseconds(1000000 / std::max(fps_, 1));
+    auto next = std::chrono::steady_clock::now();
+    while (!capture_stop_) {
+      next += interval;
+      NextFrameBuffer(GenerateFrame());
+      std::this_thread::sleep_until(next);
+    }
+  });
+}
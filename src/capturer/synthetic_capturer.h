@@ -0,0 +1,58 @@
+#ifndef SYNTHETIC_CAPTURER_H_
+#define SYNTHETIC_CAPTURER_H_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "args.h"
+#include "capturer/video_capturer.h"
+#include "common/v4l2_frame_buffer.h"
+
+/*
+ * A camera-less frame source. It pre-renders a short loop of moving test
+ * pattern frames in the configured V4L2 format (i420, yuyv or mjpeg) and
+ * replays them at the configured fps, so the pipeline can be driven without
+ * `/dev/videoN`, e.g. `--camera synthetic:0`.
+ */
+class SyntheticCapturer : public VideoCapturer {
+public:
+  static std::shared_ptr<SyntheticCapturer> Create(Args args);
+
+  SyntheticCapturer(Args args);
+  ~SyntheticCapturer();
+  int fps() const override;
+  int width() const override;
+  int height() const override;
+  uint32_t format() const override;
+  Args config() const override;
+  void StartCapture() override;
+
+  SyntheticCapturer &SetControls(int key, int value) override;
+
+  // Wraps the next pre-rendered frame, stamped with the current monotonic time.
+  std::shared_ptr<V4L2FrameBuffer> GenerateFrame();
+
+private:
+  int fps_;
+  int width_;
+  int height_;
+  uint32_t format_;
+  Args config_;
+  FrameTransform transform_;
+  size_t frame_index_;
+
+  std::vector<std::unique_ptr<uint8_t, BoostAlignedFree>> frames_;
+  std::vector<unsigned int> frame_sizes_;
+
+  std::atomic<bool> capture_stop_;
+  std::thread capture_thread_;
+
+  SyntheticCapturer &SetResolution(int width, int height) override;
+  SyntheticCapturer &SetFps(int fps) override;
+  SyntheticCapturer &SetRotation(int angle) override;
+
+  void RenderFrames();
+};
+
+#endif // SYNTHETIC_CAPTURER_H_
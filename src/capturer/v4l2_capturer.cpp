@@ -21,7 +21,8 @@ std::shared_ptr<V4L2Capturer> V4L2Capturer::Create(Args args) {
   return ptr;
 }
 
-V4L2Capturer::V4L2Capturer(Args args) : buffer_count_(4), format_(args.format), config_(args), capture_stop_(false) {}
+V4L2Capturer::V4L2Capturer(Args args) :
+    buffer_count_(4), format_(args.format), config_(args), software_rotation_(0), capture_stop_(false) {}
 
 void V4L2Capturer::Init(int deviceId) {
   std::string devicePath = "/dev/video" + std::to_string(deviceId);
@@ -45,9 +46,9 @@ V4L2Capturer::~V4L2Capturer() {
 
 int V4L2Capturer::fps() const { return fps_; }
 
-int V4L2Capturer::width() const { return width_; }
+int V4L2Capturer::width() const { return transform_.OutputWidth(); }
 
-int V4L2Capturer::height() const { return height_; }
+int V4L2Capturer::height() const { return transform_.OutputHeight(); }
 
 uint32_t V4L2Capturer::format() const { return format_; }
 
@@ -59,6 +60,7 @@ V4L2Capturer &V4L2Capturer::SetResolution(int width, int height) {
   width_ = width;
   height_ = height;
   V4L2Util::SetFormat(fd_, &capture_, width, height, format_);
+  transform_ = FrameTransform::Create(width, height, config_.crop, software_rotation_);
   return *this;
 }
 
@@ -73,7 +75,13 @@ V4L2Capturer &V4L2Capturer::SetFps(int fps) {
 
 V4L2Capturer &V4L2Capturer::SetRotation(int angle) {
   DEBUG_PRINT("  Rotation: %d", angle);
-  V4L2Util::SetCtrl(fd_, V4L2_CID_ROTATE, angle);
+  // Most UVC cameras have no rotation control, those frames are rotated while converted.
+  // H.264 frames are never converted, the driver's rotation is all they get.
+  bool driver_rotates = V4L2Util::SetCtrl(fd_, V4L2_CID_ROTATE, angle);
+  software_rotation_ = driver_rotates || format_ == V4L2_PIX_FMT_H264 ? 0 : angle;
+  if (software_rotation_) {
+    INFO_PRINT("  The driver cannot rotate, rotating by %d in software", angle);
+  }
   return *this;
 }
 
@@ -116,6 +124,7 @@ V4L2Capturer &V4L2Capturer::SetControls(int key, int value) {
 
 void V4L2Capturer::NextBuffer(V4L2Buffer &buffer) {
   frame_buffer_ = V4L2FrameBuffer::Create(width_, height_, buffer);
+  frame_buffer_->SetTransform(transform_);
   NextFrameBuffer(frame_buffer_);
 }
 
@@ -126,6 +135,7 @@ void V4L2Capturer::StartCapture() {
 
   V4L2Util::StreamOn(fd_, capture_.type);
   capture_thread_ = std::thread([this]() {
+    ApplyThreadPolicy(config_.capture_policy, "capture");
     while (!capture_stop_) {
       CaptureImage();
     }
@@ -33,6 +33,9 @@ private:
   int buffer_count_;
   uint32_t format_;
   Args config_;
+  // The rotation left to ToI420() when the driver does not rotate.
+  int software_rotation_;
+  FrameTransform transform_;
 
   V4L2BufferGroup capture_;
   std::atomic<bool> capture_stop_;
@@ -2,6 +2,7 @@
 #define VIDEO_CAPTURER_H_
 
 #include "args.h"
+#include "common/frame_tracer.h"
 #include "common/interface/subject.h"
 #include "common/v4l2_frame_buffer.h"
 #include "common/v4l2_utils.h"
@@ -31,9 +32,21 @@ public:
   }
 
 protected:
-  void NextFrameBuffer(std::shared_ptr<V4L2FrameBuffer> frame_buffer) { frame_buffer_subject_.Next(frame_buffer); }
+  void NextFrameBuffer(std::shared_ptr<V4L2FrameBuffer> frame_buffer) {
+    frame_buffer->SetFrameId(next_frame_id_++);
+    if (FrameTracer::Enabled()) {
+      // The dequeue stage spans from the driver's capture timestamp to the frame entering the pipeline.
+      timeval tv = frame_buffer->timestamp();
+      int64_t now_us = FrameTracer::NowUs();
+      int64_t capture_us = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+      FrameTracer::Instance().Record(frame_buffer->frame_id(), TraceStage::Dequeue, capture_us ? capture_us : now_us,
+                                     now_us);
+    }
+    frame_buffer_subject_.Next(frame_buffer);
+  }
 
 private:
+  uint64_t next_frame_id_ = 0;
   Subject<std::shared_ptr<V4L2FrameBuffer>> frame_buffer_subject_;
 };
 
@@ -0,0 +1,74 @@
+#include "common/encoded_frame_buffer.h"
+
+const char *VideoCodecName(VideoCodec codec) {
+  switch (codec) {
+    case VideoCodec::H264:
+      return "h264";
+    case VideoCodec::VP8:
+      return "vp8";
+    case VideoCodec::VP9:
+      return "vp9";
+    case VideoCodec::AV1:
+      return "av1";
+  }
+  return "unknown";
+}
+
+bool ParseVideoCodec(const std::string &name, VideoCodec &codec) {
+  for (VideoCodec candidate: {VideoCodec::H264, VideoCodec::VP8, VideoCodec::VP9, VideoCodec::AV1}) {
+    if (name == VideoCodecName(candidate)) {
+      codec = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<EncodedFrameBuffer> EncodedFrameBuffer::Create(uint8_t *data, size_t size, bool keyframe,
+                                                               int64_t timestamp, Deleter deleter) {
+  return std::make_shared<EncodedFrameBuffer>(data, size, keyframe, timestamp, std::move(deleter));
+}
+
+EncodedFrameBuffer::EncodedFrameBuffer(uint8_t *data, size_t size, bool keyframe, int64_t timestamp, Deleter deleter) :
+    data_(data), size_(size), keyframe_(keyframe), idr_(keyframe), timestamp_(timestamp), capture_time_us_(0),
+    decode_delay_us_(0), frame_id_(0), temporal_id_(0), codec_(VideoCodec::H264), deleter_(std::move(deleter)) {}
+
+EncodedFrameBuffer::~EncodedFrameBuffer() {
+  if (deleter_) {
+    deleter_(data_);
+  }
+}
+
+const uint8_t *EncodedFrameBuffer::data() const { return data_; }
+
+size_t EncodedFrameBuffer::size() const { return size_; }
+
+bool EncodedFrameBuffer::isKeyFrame() const { return keyframe_; }
+
+bool EncodedFrameBuffer::isIdr() const { return idr_; }
+
+void EncodedFrameBuffer::SetIdr(bool idr) { idr_ = idr; }
+
+bool EncodedFrameBuffer::isOwned() const { return deleter_ != nullptr; }
+
+int64_t EncodedFrameBuffer::timestamp() const { return timestamp_; }
+
+int64_t EncodedFrameBuffer::capture_time_us() const { return capture_time_us_; }
+
+void EncodedFrameBuffer::SetCaptureTime(int64_t capture_time_us) { capture_time_us_ = capture_time_us; }
+
+int64_t EncodedFrameBuffer::decode_time_us() const { return capture_time_us_ - decode_delay_us_; }
+
+void EncodedFrameBuffer::SetDecodeDelay(int64_t delay_us) { decode_delay_us_ = delay_us; }
+
+uint64_t EncodedFrameBuffer::frame_id() const { return frame_id_; }
+
+void EncodedFrameBuffer::SetFrameId(uint64_t frame_id) { frame_id_ = frame_id; }
+
+int EncodedFrameBuffer::temporal_id() const { return temporal_id_; }
+
+void EncodedFrameBuffer::SetTemporalId(int temporal_id) { temporal_id_ = temporal_id; }
+
+VideoCodec EncodedFrameBuffer::codec() const { return codec_; }
+
+void EncodedFrameBuffer::SetCodec(VideoCodec codec) { codec_ = codec; }
@@ -0,0 +1,69 @@
+#ifndef ENCODED_FRAME_BUFFER_H
+#define ENCODED_FRAME_BUFFER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+
+enum class VideoCodec { H264, VP8, VP9, AV1 };
+
+// The lowercase name used on the command line and in metrics, e.g. `vp9`.
+const char *VideoCodecName(VideoCodec codec);
+// Accepts the names of VideoCodecName, returns false for anything else.
+bool ParseVideoCodec(const std::string &name, VideoCodec &codec);
+
+// One encoded frame: an Annex B access unit for H.264, a single frame
+// (VP8/VP9) or temporal unit (AV1, low-overhead OBUs) otherwise.
+class EncodedFrameBuffer {
+public:
+  using Deleter = std::function<void(uint8_t *)>;
+
+  // Without a `deleter` the buffer only borrows `data` for the duration of the
+  // frame's delivery; with one it owns the data and may be kept, e.g. for retransmission.
+  static std::shared_ptr<EncodedFrameBuffer> Create(uint8_t *data, size_t size, bool keyframe, int64_t timestamp,
+                                                    Deleter deleter = nullptr);
+
+  EncodedFrameBuffer(uint8_t *data, size_t size, bool keyframe, int64_t timestamp, Deleter deleter = nullptr);
+
+  ~EncodedFrameBuffer();
+
+  const uint8_t *data() const;
+  size_t size() const;
+  bool isKeyFrame() const;
+  // Whether a decoder can start here without earlier state. For H.264 an IDR
+  // carrying SPS/PPS; an intra-refresh recovery point is a keyframe but not this.
+  bool isIdr() const;
+  void SetIdr(bool idr);
+  // Whether `data()` stays valid for as long as the buffer is referenced.
+  bool isOwned() const;
+  int64_t timestamp() const;
+  // When the frame was captured, CLOCK_MONOTONIC microseconds (the V4L2 buffer timestamp).
+  int64_t capture_time_us() const;
+  void SetCaptureTime(int64_t capture_time_us);
+  // When the frame is decoded on the same clock, earlier than the capture time by
+  // the encoder's reordering delay (its packet's pts - dts).
+  int64_t decode_time_us() const;
+  void SetDecodeDelay(int64_t delay_us);
+  uint64_t frame_id() const;
+  void SetFrameId(uint64_t frame_id);
+  // 0 for frames other frames may reference; higher layers can be dropped without breaking decoding.
+  int temporal_id() const;
+  void SetTemporalId(int temporal_id);
+  VideoCodec codec() const;
+  void SetCodec(VideoCodec codec);
+
+private:
+  uint8_t *data_;
+  size_t size_;
+  bool keyframe_;
+  bool idr_;
+  int64_t timestamp_;
+  int64_t capture_time_us_;
+  int64_t decode_delay_us_;
+  uint64_t frame_id_;
+  int temporal_id_;
+  VideoCodec codec_;
+  Deleter deleter_;
+};
+
+#endif // ENCODED_FRAME_BUFFER_H
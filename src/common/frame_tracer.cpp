@@ -0,0 +1,149 @@
+#include "common/frame_tracer.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <time.h>
+
+std::atomic<bool> FrameTracer::enabled_{false};
+
+const char *TraceStageName(TraceStage stage) {
+  switch (stage) {
+    case TraceStage::Dequeue:
+      return "dequeue";
+    case TraceStage::Convert:
+      return "convert";
+    case TraceStage::EncodeSubmit:
+      return "encode_submit";
+    case TraceStage::PacketOut:
+      return "packet_out";
+    case TraceStage::Send:
+      return "send";
+  }
+  return "unknown";
+}
+
+FrameTracer &FrameTracer::Instance() {
+  static FrameTracer tracer;
+  return tracer;
+}
+
+int64_t FrameTracer::NowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void FrameTracer::Start(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (events_.size() != capacity) {
+    events_.assign(capacity, TraceEvent{});
+    next_ = 0;
+    wrapped_ = false;
+  }
+  enabled_.store(true);
+  INFO_PRINT("Frame tracing enabled, capacity: %zu events", capacity);
+}
+
+void FrameTracer::Stop() {
+  enabled_.store(false);
+  INFO_PRINT("Frame tracing disabled");
+}
+
+void FrameTracer::Clear() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  next_ = 0;
+  wrapped_ = false;
+}
+
+void FrameTracer::Record(uint64_t frame_id, TraceStage stage, int64_t begin_us, int64_t end_us,
+                         const std::string &lane) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (events_.empty()) {
+    return;
+  }
+
+  TraceEvent &event = events_[next_];
+  event.frame_id = frame_id;
+  event.stage = stage;
+  event.begin_us = begin_us;
+  event.end_us = end_us;
+  event.lane = lane;
+
+  if (++next_ == events_.size()) {
+    next_ = 0;
+    wrapped_ = true;
+  }
+}
+
+std::vector<TraceEvent> FrameTracer::Snapshot() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::vector<TraceEvent> events;
+  size_t count = wrapped_ ? events_.size() : next_;
+  size_t begin = wrapped_ ? next_ : 0;
+  events.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    events.push_back(events_[(begin + i) % events_.size()]);
+  }
+  return events;
+}
+
+int FrameTracer::LaneId(const TraceEvent &event) {
+  // One row per pipeline stage, plus one row per peer for the send stage.
+  if (event.lane.empty()) {
+    return static_cast<int>(event.stage) + 1;
+  }
+  auto it = lanes_.find(event.lane);
+  if (it == lanes_.end()) {
+    it = lanes_.emplace(event.lane, static_cast<int>(TraceStage::Send) + 1 + static_cast<int>(lanes_.size())).first;
+  }
+  return it->second;
+}
+
+std::string FrameTracer::ExportChromeTrace() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::ostringstream out;
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  bool first = true;
+  auto emit_thread_name = [&](int tid, const std::string &name) {
+    out << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+        << ",\"args\":{\"name\":\"" << name << "\"}}";
+    first = false;
+  };
+
+  for (int s = static_cast<int>(TraceStage::Dequeue); s <= static_cast<int>(TraceStage::Send); s++) {
+    emit_thread_name(s + 1, TraceStageName(static_cast<TraceStage>(s)));
+  }
+
+  lanes_.clear();
+  size_t count = wrapped_ ? events_.size() : next_;
+  size_t begin = wrapped_ ? next_ : 0;
+  for (size_t i = 0; i < count; i++) {
+    const TraceEvent &event = events_[(begin + i) % events_.size()];
+    bool new_lane = !event.lane.empty() && lanes_.find(event.lane) == lanes_.end();
+    int tid = LaneId(event);
+    if (new_lane) {
+      emit_thread_name(tid, "send " + event.lane);
+    }
+
+    out << ",{\"name\":\"" << TraceStageName(event.stage) << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << event.begin_us << ",\"dur\":" << std::max<int64_t>(event.end_us - event.begin_us, 0)
+        << ",\"args\":{\"frame_id\":" << event.frame_id << "}}";
+  }
+
+  out << "]}";
+  return out.str();
+}
+
+bool FrameTracer::ExportChromeTrace(const std::string &file_path) {
+  std::ofstream file(file_path, std::ios::out | std::ios::trunc);
+  if (!file.is_open()) {
+    ERROR_PRINT("failed to open trace file %s", file_path.c_str());
+    return false;
+  }
+  file << ExportChromeTrace();
+  INFO_PRINT("Frame trace written to %s", file_path.c_str());
+  return true;
+}
@@ -0,0 +1,89 @@
+#ifndef FRAME_TRACER_H_
+#define FRAME_TRACER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class TraceStage { Dequeue = 0, Convert, EncodeSubmit, PacketOut, Send };
+
+const char *TraceStageName(TraceStage stage);
+
+struct TraceEvent {
+  uint64_t frame_id = 0;
+  TraceStage stage = TraceStage::Dequeue;
+  int64_t begin_us = 0;
+  int64_t end_us = 0;
+  std::string lane;
+};
+
+/*
+ * Collects per-frame stage timings into a fixed-size ring and exports them as
+ * Chrome trace-event JSON (loadable in chrome://tracing or ui.perfetto.dev).
+ * All timestamps are CLOCK_MONOTONIC microseconds, the same clock V4L2 uses
+ * for buffer timestamps.
+ */
+class FrameTracer {
+public:
+  static FrameTracer &Instance();
+
+  // Checked by every stage before taking any timestamp, so a disabled tracer
+  // costs one relaxed atomic load per stage.
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static int64_t NowUs();
+
+  void Start(size_t capacity = kDefaultCapacity);
+  void Stop();
+  void Clear();
+
+  void Record(uint64_t frame_id, TraceStage stage, int64_t begin_us, int64_t end_us, const std::string &lane = "");
+
+  // Recorded events in chronological order of recording.
+  std::vector<TraceEvent> Snapshot();
+
+  std::string ExportChromeTrace();
+  bool ExportChromeTrace(const std::string &file_path);
+
+  static constexpr size_t kDefaultCapacity = 1 << 16;
+
+private:
+  FrameTracer() = default;
+
+  int LaneId(const TraceEvent &event);
+
+  static std::atomic<bool> enabled_;
+
+  std::mutex mtx_;
+  std::vector<TraceEvent> events_;
+  size_t next_ = 0;
+  bool wrapped_ = false;
+  std::unordered_map<std::string, int> lanes_;
+};
+
+class ScopedTrace {
+public:
+  ScopedTrace(uint64_t frame_id, TraceStage stage, const char *lane = "") :
+      enabled_(FrameTracer::Enabled()), frame_id_(frame_id), stage_(stage), lane_(lane),
+      begin_us_(enabled_ ? FrameTracer::NowUs() : 0) {}
+
+  ~ScopedTrace() {
+    if (enabled_) {
+      FrameTracer::Instance().Record(frame_id_, stage_, begin_us_, FrameTracer::NowUs(), lane_);
+    }
+  }
+
+  ScopedTrace(const ScopedTrace &) = delete;
+  ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+private:
+  const bool enabled_;
+  const uint64_t frame_id_;
+  const TraceStage stage_;
+  const char *lane_;
+  const int64_t begin_us_;
+};
+
+#endif // FRAME_TRACER_H_
@@ -0,0 +1,63 @@
+#include "common/frame_transform.h"
+
+#include <regex>
+#include <stdexcept>
+
+CropRect ParseCropRect(const std::string &spec) {
+  const std::regex spec_regex(R"(^(\d{1,5})x(\d{1,5})(?:\+(\d{1,5})\+(\d{1,5}))?$)");
+  std::smatch match;
+  if (!std::regex_match(spec, match, spec_regex)) {
+    throw std::invalid_argument("invalid crop: " + spec);
+  }
+  CropRect crop;
+  crop.width = std::stoi(match[1]);
+  crop.height = std::stoi(match[2]);
+  if (match[3].matched) {
+    crop.x = std::stoi(match[3]);
+    crop.y = std::stoi(match[4]);
+  }
+  if (crop.width == 0 || crop.height == 0) {
+    throw std::invalid_argument("empty crop: " + spec);
+  }
+  return crop;
+}
+
+FrameTransform FrameTransform::Create(int width, int height, const CropRect &crop, int rotation) {
+  if (rotation != 0 && rotation != 90 && rotation != 180 && rotation != 270) {
+    throw std::invalid_argument("rotation must be 0, 90, 180 or 270");
+  }
+
+  FrameTransform transform;
+  transform.width = width;
+  transform.height = height;
+  transform.rotation = rotation;
+  transform.crop_width = crop.width > 0 ? crop.width : width;
+  transform.crop_height = crop.height > 0 ? crop.height : height;
+  transform.crop_x = crop.x >= 0 ? crop.x : (width - transform.crop_width) / 2;
+  transform.crop_y = crop.y >= 0 ? crop.y : (height - transform.crop_height) / 2;
+  if (transform.crop_x < 0 || transform.crop_y < 0 || transform.crop_x + transform.crop_width > width ||
+      transform.crop_y + transform.crop_height > height) {
+    throw std::invalid_argument("the crop leaves the " + std::to_string(width) + "x" + std::to_string(height) +
+                                " frame");
+  }
+
+  // Chroma is subsampled 2x2, an odd edge would split a chroma sample.
+  transform.crop_x &= ~1;
+  transform.crop_y &= ~1;
+  if (transform.crop_width != width || transform.crop_height != height) {
+    transform.crop_width &= ~1;
+    transform.crop_height &= ~1;
+  }
+  if (transform.crop_width == 0 || transform.crop_height == 0) {
+    throw std::invalid_argument("the crop is narrower than 2 pixels");
+  }
+  return transform;
+}
+
+bool FrameTransform::IsIdentity() const { return rotation == 0 && !IsCropped(); }
+
+bool FrameTransform::IsCropped() const { return crop_width != width || crop_height != height; }
+
+int FrameTransform::OutputWidth() const { return rotation % 180 ? crop_height : crop_width; }
+
+int FrameTransform::OutputHeight() const { return rotation % 180 ? crop_width : crop_height; }
@@ -0,0 +1,45 @@
+#ifndef FRAME_TRANSFORM_H_
+#define FRAME_TRANSFORM_H_
+
+#include <string>
+
+// A region of the captured frame in capture pixels. A negative offset centres
+// the region on that axis, a zero size keeps the full frame.
+struct CropRect {
+  int x = -1;
+  int y = -1;
+  int width = 0;
+  int height = 0;
+};
+
+// Parses `WIDTHxHEIGHT+X+Y`, or `WIDTHxHEIGHT` for a centred region, throws
+// std::invalid_argument if malformed.
+CropRect ParseCropRect(const std::string &spec);
+
+/*
+ * The crop and rotation V4L2FrameBuffer::ToI420() applies while converting a
+ * capture, so the frame is read once and every later stage only handles the
+ * region. The crop is taken before the rotation.
+ */
+struct FrameTransform {
+  // Resolves `crop` against a `width` x `height` capture. Throws std::invalid_argument
+  // when the region leaves the frame or `rotation` is not 0, 90, 180 or 270.
+  static FrameTransform Create(int width, int height, const CropRect &crop, int rotation);
+
+  // Whether the conversion is a plain one of the whole frame.
+  bool IsIdentity() const;
+  bool IsCropped() const;
+  // The size of the converted frame.
+  int OutputWidth() const;
+  int OutputHeight() const;
+
+  int width = 0;
+  int height = 0;
+  int crop_x = 0;
+  int crop_y = 0;
+  int crop_width = 0;
+  int crop_height = 0;
+  int rotation = 0;
+};
+
+#endif // FRAME_TRANSFORM_H_
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 template<typename T>
@@ -24,30 +25,46 @@ class Subject {
 public:
   virtual ~Subject() = default;
   virtual void Next(T message) {
-    auto it = observers_.begin();
-    while (it != observers_.end()) {
-      if (auto obs = it->lock()) {
-        if (obs->subscribed_func_)
-          obs->subscribed_func_(message);
-        ++it;
-      } else {
-        it = observers_.erase(it);
+    // Observers may be added from other threads (e.g. a new peer) while frames flow,
+    // so deliver to a snapshot and keep the lock out of the callbacks.
+    std::vector<std::shared_ptr<Observable<T>>> observers;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      observers.reserve(observers_.size());
+      auto it = observers_.begin();
+      while (it != observers_.end()) {
+        if (auto obs = it->lock()) {
+          observers.push_back(std::move(obs));
+          ++it;
+        } else {
+          it = observers_.erase(it);
+        }
       }
     }
+    for (const auto &obs: observers) {
+      if (obs->subscribed_func_)
+        obs->subscribed_func_(message);
+    }
   }
 
   virtual std::shared_ptr<Observable<T>> AsObservable() {
     auto observer = std::make_shared<Observable<T>>();
+    std::lock_guard<std::mutex> lock(mtx_);
     observers_.push_back(observer);
     return observer;
   }
 
-  virtual void UnSubscribe() { observers_.clear(); }
+  virtual void UnSubscribe() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    observers_.clear();
+  }
 
 protected:
+  std::mutex mtx_;
   std::vector<std::weak_ptr<Observable<T>>> observers_;
 
   void RemoveNullObservers() {
+    std::lock_guard<std::mutex> lock(mtx_);
     auto new_end = std::remove_if(observers_.begin(), observers_.end(),
                                   [](const std::weak_ptr<Observable<T>> &w) { return w.expired(); });
     observers_.erase(new_end, observers_.end());
@@ -0,0 +1,81 @@
+#include "common/latency_probe.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const uint8_t kNalSei = 6;
+static const uint8_t kUserDataUnregistered = 5;
+// Identifies our payload among other user data SEIs.
+static const uint8_t kProbeUuid[16] = {0x5a, 0x2b, 0x6e, 0x1c, 0x94, 0x3f, 0x4d, 0x8e,
+                                       0xa1, 0x07, 0xc3, 0x52, 0x77, 0xe0, 0x19, 0xb6};
+static const size_t kPayloadSize = sizeof(kProbeUuid) + 16;
+
+static void WriteU64(uint64_t value, uint8_t *p) {
+  for (int i = 7; i >= 0; i--) {
+    p[i] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+static uint64_t ReadU64(const uint8_t *p) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+std::vector<uint8_t> LatencyProbe::ToSei() const {
+  uint8_t rbsp[2 + kPayloadSize + 1];
+  rbsp[0] = kUserDataUnregistered;
+  rbsp[1] = kPayloadSize;
+  std::memcpy(rbsp + 2, kProbeUuid, sizeof(kProbeUuid));
+  WriteU64(static_cast<uint64_t>(capture_us), rbsp + 2 + sizeof(kProbeUuid));
+  WriteU64(frame_id, rbsp + 2 + sizeof(kProbeUuid) + 8);
+  rbsp[sizeof(rbsp) - 1] = 0x80; // rbsp_trailing_bits
+
+  std::vector<uint8_t> nal = {0, 0, 0, 1, kNalSei};
+  int zeros = 0;
+  for (uint8_t byte: rbsp) {
+    // Emulation prevention: no 00 00 0x (x <= 3) may appear inside a NAL unit.
+    if (zeros >= 2 && byte <= 3) {
+      nal.push_back(3);
+      zeros = 0;
+    }
+    nal.push_back(byte);
+    zeros = byte == 0 ? zeros + 1 : 0;
+  }
+  return nal;
+}
+
+bool LatencyProbe::Parse(const uint8_t *data, size_t size, LatencyProbe &probe) {
+  for (size_t i = 0; i + 3 < size; i++) {
+    if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1 || (data[i + 3] & 0x1f) != kNalSei) {
+      continue;
+    }
+
+    // Unescape only as much as the probe needs.
+    uint8_t rbsp[2 + kPayloadSize];
+    size_t n = 0;
+    int zeros = 0;
+    for (size_t j = i + 4; j < size && n < sizeof(rbsp); j++) {
+      if (zeros >= 2 && data[j] == 3) {
+        zeros = 0;
+        continue;
+      }
+      if (zeros >= 2 && data[j] <= 2) {
+        break; // the next start code
+      }
+      rbsp[n++] = data[j];
+      zeros = data[j] == 0 ? zeros + 1 : 0;
+    }
+
+    if (n == sizeof(rbsp) && rbsp[0] == kUserDataUnregistered && rbsp[1] == kPayloadSize &&
+        std::equal(kProbeUuid, kProbeUuid + sizeof(kProbeUuid), rbsp + 2)) {
+      probe.capture_us = static_cast<int64_t>(ReadU64(rbsp + 2 + sizeof(kProbeUuid)));
+      probe.frame_id = ReadU64(rbsp + 2 + sizeof(kProbeUuid) + 8);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,23 @@
+#ifndef LATENCY_PROBE_H_
+#define LATENCY_PROBE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * An H.264 user-data-unregistered SEI carrying a frame's capture time and ID,
+ * so a receiver on the same host can measure glass-to-glass latency. The
+ * capture time is CLOCK_MONOTONIC microseconds, the V4L2 buffer timestamp.
+ */
+struct LatencyProbe {
+  int64_t capture_us = 0;
+  uint64_t frame_id = 0;
+
+  // The SEI as an Annex B NAL unit, start code included, ready to prepend to an access unit.
+  std::vector<uint8_t> ToSei() const;
+  // Looks for the probe SEI in an Annex B access unit.
+  static bool Parse(const uint8_t *data, size_t size, LatencyProbe &probe);
+};
+
+#endif // LATENCY_PROBE_H_
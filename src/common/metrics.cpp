@@ -0,0 +1,63 @@
+#include "common/metrics.h"
+
+#include <sstream>
+#include <vector>
+
+Metrics &Metrics::Instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+void Metrics::SetGauge(const std::string &name, double value) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  values_[name] = {Type::Gauge, value};
+}
+
+void Metrics::AddCounter(const std::string &name, double delta) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = values_.find(name);
+  if (it == values_.end()) {
+    values_[name] = {Type::Counter, delta};
+  } else {
+    it->second.value += delta;
+  }
+}
+
+void Metrics::Remove(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  values_.erase(name);
+}
+
+double Metrics::Get(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = values_.find(name);
+  return it == values_.end() ? 0 : it->second.value;
+}
+
+std::string Metrics::WithLabel(const std::string &labels, const std::string &key, const std::string &value) {
+  if (value.empty()) {
+    return labels;
+  }
+  std::string label = key + "=\"" + value + "\"";
+  if (labels.empty()) {
+    return "{" + label + "}";
+  }
+  return "{" + label + "," + labels.substr(1);
+}
+
+std::string Metrics::RenderPrometheus() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::map<std::string, std::vector<std::map<std::string, Value>::const_iterator>> families;
+  for (auto it = values_.begin(); it != values_.end(); ++it) {
+    families[it->first.substr(0, it->first.find('{'))].push_back(it);
+  }
+
+  std::ostringstream out;
+  for (const auto &[family, series]: families) {
+    out << "# TYPE " << family << (series.front()->second.type == Type::Counter ? " counter" : " gauge") << "\n";
+    for (const auto &it: series) {
+      out << it->first << " " << it->second.value << "\n";
+    }
+  }
+  return out.str();
+}
@@ -0,0 +1,41 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/*
+ * Process-wide counters and gauges, rendered in the Prometheus text format by
+ * `GET /metrics`. A metric name may carry labels, e.g.
+ * `webrtc_peer_bitrate_bps{peer="..."}`; the part before `{` is the family.
+ */
+class Metrics {
+public:
+  static Metrics &Instance();
+
+  void SetGauge(const std::string &name, double value);
+  void AddCounter(const std::string &name, double delta = 1);
+  void Remove(const std::string &name);
+  double Get(const std::string &name);
+
+  // Prepends `key="value"` to a label set such as `{layer="1"}`, an empty value
+  // returns `labels` unchanged.
+  static std::string WithLabel(const std::string &labels, const std::string &key, const std::string &value);
+
+  std::string RenderPrometheus();
+
+private:
+  Metrics() = default;
+
+  enum class Type { Gauge, Counter };
+  struct Value {
+    Type type;
+    double value;
+  };
+
+  std::mutex mtx_;
+  std::map<std::string, Value> values_;
+};
+
+#endif // METRICS_H_
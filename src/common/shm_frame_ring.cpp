@@ -0,0 +1,242 @@
+#include "common/shm_frame_ring.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const int kMaxRingFds = 8;
+
+static size_t AlignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+static size_t SlotStride(uint32_t slot_capacity) { return AlignUp(sizeof(ShmSlotHeader) + slot_capacity, 64); }
+
+bool SendRings(int sock, const std::vector<int> &ring_fds, int event_fd) {
+  if (ring_fds.size() >= kMaxRingFds) {
+    return false;
+  }
+  std::vector<int> fds = ring_fds;
+  fds.push_back(event_fd);
+  ShmRingHello hello = {kShmRingMagic, kShmRingVersion, static_cast<uint32_t>(ring_fds.size())};
+
+  iovec iov = {&hello, sizeof(hello)};
+  char control[CMSG_SPACE(sizeof(int) * kMaxRingFds)] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == sizeof(hello);
+}
+
+bool ReceiveRings(int sock, std::vector<int> *ring_fds, int *event_fd) {
+  ShmRingHello hello{};
+  iovec iov = {&hello, sizeof(hello)};
+  char control[CMSG_SPACE(sizeof(int) * kMaxRingFds)] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof(hello)) {
+    return false;
+  }
+
+  std::vector<int> fds;
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      fds.resize((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(int) * fds.size());
+    }
+  }
+  if (hello.magic != kShmRingMagic || hello.version != kShmRingVersion || fds.size() != hello.ring_count + 1) {
+    for (int fd: fds) {
+      close(fd);
+    }
+    return false;
+  }
+  *event_fd = fds.back();
+  fds.pop_back();
+  *ring_fds = std::move(fds);
+  return true;
+}
+
+ShmRingWriter::ShmRingWriter(const std::string &name, ShmFrameFormat format, uint32_t slot_count,
+                             uint32_t slot_capacity, bool readers_hold) :
+    fd_(-1), map_size_(0), map_(nullptr), header_(nullptr), pending_(nullptr), pending_n_(0) {
+  const size_t stride = SlotStride(slot_capacity);
+  map_size_ = sizeof(ShmRingHeader) + stride * slot_count;
+
+  fd_ = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd_ < 0) {
+    throw std::runtime_error("shm ring: memfd_create failed: " + std::string(strerror(errno)));
+  }
+  if (ftruncate(fd_, map_size_) < 0) {
+    close(fd_);
+    throw std::runtime_error("shm ring: cannot size " + name + ": " + strerror(errno));
+  }
+  void *map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    close(fd_);
+    throw std::runtime_error("shm ring: cannot map " + name + ": " + strerror(errno));
+  }
+  map_ = static_cast<uint8_t *>(map);
+
+  int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+  // Our own mapping stays writable, any a reader tries to make would fail.
+  if (!readers_hold) {
+    seals |= F_SEAL_FUTURE_WRITE;
+  }
+#endif
+  fcntl(fd_, F_ADD_SEALS, seals);
+
+  header_ = new (map_) ShmRingHeader{};
+  header_->magic = kShmRingMagic;
+  header_->version = kShmRingVersion;
+  header_->format = static_cast<uint32_t>(format);
+  header_->slot_count = slot_count;
+  header_->slot_stride = stride;
+  header_->slot_capacity = slot_capacity;
+  for (uint32_t i = 0; i < slot_count; i++) {
+    new (map_ + sizeof(ShmRingHeader) + stride * i) ShmSlotHeader{};
+  }
+  header_->published.store(0, std::memory_order_release);
+}
+
+ShmRingWriter::~ShmRingWriter() {
+  munmap(map_, map_size_);
+  close(fd_);
+}
+
+ShmSlotHeader *ShmRingWriter::SlotAt(uint64_t n) const {
+  return reinterpret_cast<ShmSlotHeader *>(map_ + sizeof(ShmRingHeader) +
+                                           static_cast<size_t>(header_->slot_stride) * (n % header_->slot_count));
+}
+
+bool ShmRingWriter::Write(const ShmFrameMeta &meta, const uint8_t *data) {
+  uint8_t *payload = Begin(meta.size);
+  if (!payload) {
+    return false;
+  }
+  memcpy(payload, data, meta.size);
+  Commit(meta);
+  return true;
+}
+
+uint8_t *ShmRingWriter::Begin(uint32_t size) {
+  if (size > header_->slot_capacity) {
+    return nullptr;
+  }
+
+  // A held slot is passed over, its frame number goes unused and readers see it as lost.
+  const uint64_t published = header_->published.load(std::memory_order_relaxed);
+  for (uint64_t n = published; n < published + header_->slot_count; n++) {
+    ShmSlotHeader *slot = SlotAt(n);
+    if (slot->holders.load(std::memory_order_acquire)) {
+      continue;
+    }
+
+    const uint64_t previous = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(2 * n + 1, std::memory_order_relaxed);
+    // Pairs with the fence in Hold(): either the reader sees the slot busy or we see its hold.
+    // It also keeps the payload stores from becoming visible before the slot is marked busy.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (slot->holders.load(std::memory_order_relaxed)) {
+      slot->sequence.store(previous, std::memory_order_relaxed);
+      continue;
+    }
+    pending_ = slot;
+    pending_n_ = n;
+    return reinterpret_cast<uint8_t *>(slot) + sizeof(ShmSlotHeader);
+  }
+  return nullptr;
+}
+
+void ShmRingWriter::Commit(const ShmFrameMeta &meta) {
+  pending_->meta = meta;
+  pending_->sequence.store(2 * (pending_n_ + 1), std::memory_order_release);
+  header_->published.store(pending_n_ + 1, std::memory_order_release);
+  pending_ = nullptr;
+}
+
+int ShmRingWriter::fd() const { return fd_; }
+
+uint32_t ShmRingWriter::slot_capacity() const { return header_->slot_capacity; }
+
+ShmRingReader::ShmRingReader(int fd, bool hold_slots) : map_size_(0), map_(nullptr), header_(nullptr) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(ShmRingHeader)) {
+    throw std::runtime_error("shm ring: not a frame ring");
+  }
+  map_size_ = st.st_size;
+  void *map = mmap(nullptr, map_size_, hold_slots ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("shm ring: cannot map: " + std::string(strerror(errno)));
+  }
+  map_ = static_cast<uint8_t *>(map);
+  header_ = reinterpret_cast<const ShmRingHeader *>(map_);
+
+  if (header_->magic != kShmRingMagic || header_->version != kShmRingVersion ||
+      header_->slot_stride < SlotStride(header_->slot_capacity) ||
+      sizeof(ShmRingHeader) + static_cast<size_t>(header_->slot_stride) * header_->slot_count > map_size_) {
+    munmap(map_, map_size_);
+    throw std::runtime_error("shm ring: unsupported ring layout");
+  }
+}
+
+ShmRingReader::~ShmRingReader() { munmap(map_, map_size_); }
+
+uint64_t ShmRingReader::published() const { return header_->published.load(std::memory_order_acquire); }
+
+ShmFrameFormat ShmRingReader::format() const { return static_cast<ShmFrameFormat>(header_->format); }
+
+uint32_t ShmRingReader::slot_count() const { return header_->slot_count; }
+
+ShmSlotHeader *ShmRingReader::Slot(uint64_t n) const {
+  return reinterpret_cast<ShmSlotHeader *>(map_ + sizeof(ShmRingHeader) +
+                                           static_cast<size_t>(header_->slot_stride) * (n % header_->slot_count));
+}
+
+const uint8_t *ShmRingReader::Peek(uint64_t n, ShmFrameMeta *meta) const {
+  if (n >= published()) {
+    return nullptr;
+  }
+  const ShmSlotHeader *slot = Slot(n);
+  if (slot->sequence.load(std::memory_order_acquire) != 2 * (n + 1)) {
+    return nullptr;
+  }
+  *meta = slot->meta;
+  if (!Valid(n) || meta->size > header_->slot_capacity) {
+    return nullptr;
+  }
+  return reinterpret_cast<const uint8_t *>(slot) + sizeof(ShmSlotHeader);
+}
+
+bool ShmRingReader::Valid(uint64_t n) const {
+  // Orders the reads of the slot before the second look at its sequence.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return Slot(n)->sequence.load(std::memory_order_relaxed) == 2 * (n + 1);
+}
+
+bool ShmRingReader::Hold(uint64_t n) {
+  ShmSlotHeader *slot = Slot(n);
+  slot->holders.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (slot->sequence.load(std::memory_order_relaxed) != 2 * (n + 1)) {
+    slot->holders.fetch_sub(1, std::memory_order_release);
+    return false;
+  }
+  return true;
+}
+
+void ShmRingReader::Release(uint64_t n) { Slot(n)->holders.fetch_sub(1, std::memory_order_release); }
@@ -0,0 +1,147 @@
+#ifndef SHM_FRAME_RING_H_
+#define SHM_FRAME_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * A ring of frame slots in a memfd, written by one process and mapped by
+ * others. There are no locks between them: each slot carries a sequence
+ * number that is odd while the writer fills it, so a reader checks the number
+ * before and after using a slot and discards what it read if the writer came
+ * by in between. The writer never waits for anyone; a reader too slow to keep
+ * up simply loses frames.
+ *
+ * A reader that needs a frame to stay put, e.g. to encode straight out of the
+ * ring, may hold its slot instead. The writer then passes over that slot, and
+ * drops frames only once every slot is held. Holding needs a ring created with
+ * `readers_hold`.
+ *
+ * The layout below is the wire format shared with readers, only fixed-size
+ * fields and lock-free atomics.
+ */
+
+static const uint32_t kShmRingMagic = 0x57524652; // "RFRW"
+static const uint32_t kShmRingVersion = 1;
+static const uint32_t kShmFrameKey = 1;
+
+// Raw frames describe their pixel layout each in their ShmFrameMeta.
+enum class ShmFrameFormat : uint32_t { Raw = 1, H264 = 2 };
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring needs address-free 64-bit atomics");
+
+struct alignas(64) ShmRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format; // ShmFrameFormat
+  uint32_t slot_count;
+  // Bytes from one slot to the next, a slot being its ShmSlotHeader followed by the payload.
+  uint32_t slot_stride;
+  uint32_t slot_capacity;
+  // Frames published so far, frame n is in slot n % slot_count.
+  std::atomic<uint64_t> published;
+};
+
+struct ShmFrameMeta {
+  int64_t capture_us; // CLOCK_MONOTONIC
+  uint64_t frame_id;
+  uint32_t size;
+  uint32_t flags;
+  // Raw frames only. The payload holds the planes back to back, each `height` rows of its
+  // stride, or half as many rows for chroma. NV12 and YUYV leave the unused strides at 0.
+  uint32_t pixel_format; // V4L2 fourcc
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride_y;
+  uint32_t stride_u;
+  uint32_t stride_v;
+};
+
+struct alignas(64) ShmSlotHeader {
+  // Odd while the slot is written, 2 * (n + 1) once it holds frame n.
+  std::atomic<uint64_t> sequence;
+  // Readers holding the slot, the writer leaves it alone while non-zero.
+  std::atomic<uint32_t> holders;
+  ShmFrameMeta meta;
+};
+
+// Sent by whoever created the rings on a Unix socket, together with their file descriptors
+// and last an eventfd which counts up after every frame written to any of them.
+struct ShmRingHello {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ring_count;
+};
+
+// Both return false on a socket error or, when receiving, anything but a ShmRingHello.
+bool SendRings(int sock, const std::vector<int> &ring_fds, int event_fd);
+bool ReceiveRings(int sock, std::vector<int> *ring_fds, int *event_fd);
+
+class ShmRingWriter {
+public:
+  // Throws std::runtime_error if the memfd can not be created or mapped.
+  ShmRingWriter(const std::string &name, ShmFrameFormat format, uint32_t slot_count, uint32_t slot_capacity,
+                bool readers_hold = false);
+  ~ShmRingWriter();
+
+  ShmRingWriter(const ShmRingWriter &) = delete;
+  ShmRingWriter &operator=(const ShmRingWriter &) = delete;
+
+  // Copies one frame into the next free slot. False if it is larger than a slot or all are held.
+  bool Write(const ShmFrameMeta &meta, const uint8_t *data);
+  // The payload of the next slot to fill in place, or nullptr as Write() would fail. Nothing is
+  // published until Commit(), whose `meta` describes what was written.
+  uint8_t *Begin(uint32_t size);
+  void Commit(const ShmFrameMeta &meta);
+
+  // Unless readers hold slots, sealed against writable mappings: readers can only map it read-only.
+  int fd() const;
+  uint32_t slot_capacity() const;
+
+private:
+  ShmSlotHeader *SlotAt(uint64_t n) const;
+
+  int fd_;
+  size_t map_size_;
+  uint8_t *map_;
+  ShmRingHeader *header_;
+  ShmSlotHeader *pending_;
+  uint64_t pending_n_;
+};
+
+class ShmRingReader {
+public:
+  // Maps a ring received from the writer, writable if `hold_slots`. Throws std::runtime_error if
+  // it is not a ring or can not be mapped that way.
+  explicit ShmRingReader(int fd, bool hold_slots = false);
+  ~ShmRingReader();
+
+  ShmRingReader(const ShmRingReader &) = delete;
+  ShmRingReader &operator=(const ShmRingReader &) = delete;
+
+  uint64_t published() const;
+  ShmFrameFormat format() const;
+  uint32_t slot_count() const;
+  // Frame `n` in place: its metadata is copied to `meta` and the payload returned, or nullptr
+  // if the frame is not there, being written or gone already. The writer may overwrite the
+  // payload while it is read, anything taken from it counts only if Valid(n) holds afterwards.
+  const uint8_t *Peek(uint64_t n, ShmFrameMeta *meta) const;
+  bool Valid(uint64_t n) const;
+
+  // Keeps the writer off the slot of frame `n` until Release(n). False if the frame is gone.
+  // Only for readers mapping with `hold_slots`.
+  bool Hold(uint64_t n);
+  void Release(uint64_t n);
+
+private:
+  ShmSlotHeader *Slot(uint64_t n) const;
+
+  size_t map_size_;
+  uint8_t *map_;
+  const ShmRingHeader *header_;
+};
+
+#endif // SHM_FRAME_RING_H_
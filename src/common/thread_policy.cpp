@@ -0,0 +1,90 @@
+#include "common/thread_policy.h"
+
+#include <cstring>
+#include <pthread.h>
+#include <sstream>
+#include <stdexcept>
+
+#include "common/logging.h"
+
+static void SetAffinity(const std::vector<int> &cpus, const char *stage) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu: cpus) {
+    CPU_SET(cpu, &set);
+  }
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (ret != 0) {
+    ERROR_PRINT("%s thread: cannot set CPU affinity: %s", stage, strerror(ret));
+  }
+}
+
+static void SetScheduling(int priority, const char *stage) {
+  int policy;
+  sched_param param;
+  if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) {
+    return;
+  }
+  // A thread created by a real-time one inherits its class, drop it unless asked for.
+  if (priority == 0 && policy == SCHED_OTHER) {
+    return;
+  }
+
+  param.sched_priority = priority;
+  int ret = pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+  if (ret != 0) {
+    ERROR_PRINT("%s thread: cannot set SCHED_FIFO priority %d: %s", stage, priority, strerror(ret));
+  }
+}
+
+void ApplyThreadPolicy(const ThreadPolicy &policy, const char *stage) {
+  if (!policy.cpus.empty()) {
+    SetAffinity(policy.cpus, stage);
+  }
+  SetScheduling(policy.priority, stage);
+}
+
+std::vector<int> ParseCpuList(const std::string &list) {
+  std::vector<int> cpus;
+  std::string range;
+  std::stringstream ss(list);
+  while (std::getline(ss, range, ',')) {
+    size_t dash = range.find('-');
+    size_t end;
+    int first = std::stoi(range, &end);
+    int last = first;
+    if (dash != std::string::npos && end == dash) {
+      std::string upper = range.substr(dash + 1);
+      last = std::stoi(upper, &end);
+      end = end == upper.size() ? range.size() : 0;
+    }
+    if (end != range.size() || first < 0 || last < first || last >= CPU_SETSIZE) {
+      throw std::invalid_argument("invalid CPU range: " + range);
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty()) {
+    throw std::invalid_argument("empty CPU list");
+  }
+  return cpus;
+}
+
+ScopedThreadPolicy::ScopedThreadPolicy(const ThreadPolicy &policy, const char *stage) :
+    restore_affinity_(false), restore_sched_(false), sched_policy_(SCHED_OTHER), sched_param_{} {
+  if (!policy.cpus.empty()) {
+    restore_affinity_ = pthread_getaffinity_np(pthread_self(), sizeof(affinity_), &affinity_) == 0;
+  }
+  restore_sched_ = pthread_getschedparam(pthread_self(), &sched_policy_, &sched_param_) == 0;
+  ApplyThreadPolicy(policy, stage);
+}
+
+ScopedThreadPolicy::~ScopedThreadPolicy() {
+  if (restore_affinity_) {
+    pthread_setaffinity_np(pthread_self(), sizeof(affinity_), &affinity_);
+  }
+  if (restore_sched_) {
+    pthread_setschedparam(pthread_self(), sched_policy_, &sched_param_);
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef THREAD_POLICY_H_
+#define THREAD_POLICY_H_
+
+#include <sched.h>
+#include <string>
+#include <vector>
+
+/*
+ * Where a pipeline stage's threads run. Threads inherit the affinity mask and
+ * scheduling policy of the thread that creates them, so applying a policy
+ * before x264 or libdatachannel start their own threads places those as well.
+ */
+struct ThreadPolicy {
+  // CPUs the stage may run on, empty leaves the affinity alone.
+  std::vector<int> cpus;
+  // SCHED_FIFO priority (1-99), 0 keeps the default time-sharing policy.
+  int priority = 0;
+};
+
+// Applies `policy` to the calling thread. Failures, e.g. a missing CAP_SYS_NICE
+// for SCHED_FIFO, are logged and the thread keeps running unpinned.
+void ApplyThreadPolicy(const ThreadPolicy &policy, const char *stage);
+
+// Parses a CPU list such as `0-2,5`, throws std::invalid_argument if malformed.
+std::vector<int> ParseCpuList(const std::string &list);
+
+/*
+ * Applies a policy for the lifetime of the object and then restores what the
+ * calling thread had, for code that spawns threads on behalf of another stage.
+ */
+class ScopedThreadPolicy {
+public:
+  ScopedThreadPolicy(const ThreadPolicy &policy, const char *stage);
+  ~ScopedThreadPolicy();
+
+  ScopedThreadPolicy(const ScopedThreadPolicy &) = delete;
+  ScopedThreadPolicy &operator=(const ScopedThreadPolicy &) = delete;
+
+private:
+  bool restore_affinity_;
+  bool restore_sched_;
+  cpu_set_t affinity_;
+  int sched_policy_;
+  sched_param sched_param_;
+};
+
+#endif // THREAD_POLICY_H_
@@ -56,6 +56,21 @@ std::shared_ptr<I420Buffer> I420Buffer::Create(int width, int height, int align)
   return buf;
 }
 
+std::shared_ptr<I420Buffer> I420Buffer::Wrap(int width, int height, uint8_t *y, int stride_y, uint8_t *u,
+                                             int stride_u, uint8_t *v, int stride_v, std::function<void()> release) {
+  if (width <= 0 || height <= 0)
+    throw std::invalid_argument("I420Buffer: invalid size");
+  if (stride_y < width || stride_u < (width + 1) / 2 || stride_v < (width + 1) / 2)
+    throw std::invalid_argument("I420Buffer: stride narrower than a row");
+
+  auto buf = std::shared_ptr<I420Buffer>(new I420Buffer(width, height, stride_y, stride_u, stride_v, 0));
+  buf->y_ = y;
+  buf->u_ = u;
+  buf->v_ = v;
+  buf->release_ = std::move(release);
+  return buf;
+}
+
 std::shared_ptr<V4L2FrameBuffer> V4L2FrameBuffer::Create(int width, int height, int size, uint32_t format) {
   return std::make_shared<V4L2FrameBuffer>(width, height, size, format);
 }
@@ -66,14 +81,23 @@ std::shared_ptr<V4L2FrameBuffer> V4L2FrameBuffer::Create(int width, int height,
 
 V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, V4L2Buffer buffer) :
     width_(width), height_(height), format_(buffer.pix_fmt), size_(buffer.length), flags_(buffer.flags),
-    is_buffer_copied(false), timestamp_(buffer.timestamp), buffer_(buffer),
+    is_buffer_copied(false), timestamp_(buffer.timestamp), frame_id_(0), buffer_(buffer),
     data_(static_cast<uint8_t *>(boost::alignment::aligned_alloc(
                   kBufferAlignment, AlignUp(static_cast<std::size_t>(size_), kBufferAlignment))),
           BoostAlignedFree{}) {}
 
+std::shared_ptr<V4L2FrameBuffer> V4L2FrameBuffer::Create(std::shared_ptr<I420Buffer> i420, timeval timestamp) {
+  return std::make_shared<V4L2FrameBuffer>(std::move(i420), timestamp);
+}
+
+V4L2FrameBuffer::V4L2FrameBuffer(std::shared_ptr<I420Buffer> i420, timeval timestamp) :
+    width_(i420->width()), height_(i420->height()), format_(V4L2_PIX_FMT_YUV420), size_(i420->ByteSize()), flags_(0),
+    is_buffer_copied(false), timestamp_(timestamp), frame_id_(0), i420_(std::move(i420)),
+    data_(nullptr, BoostAlignedFree{}) {}
+
 V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, int size, uint32_t format) :
     width_(width), height_(height), format_(format), size_(size), flags_(0), is_buffer_copied(false),
-    timestamp_({0, 0}), data_(static_cast<uint8_t *>(boost::alignment::aligned_alloc(
+    timestamp_({0, 0}), frame_id_(0), data_(static_cast<uint8_t *>(boost::alignment::aligned_alloc(
                                       kBufferAlignment, AlignUp(static_cast<std::size_t>(size_), kBufferAlignment))),
                               BoostAlignedFree{}) {}
 
@@ -91,23 +115,64 @@ unsigned int V4L2FrameBuffer::flags() const { return flags_; }
 
 timeval V4L2FrameBuffer::timestamp() const { return timestamp_; }
 
-std::shared_ptr<I420Buffer> V4L2FrameBuffer::ToI420() {
-  std::shared_ptr<I420Buffer> i420_buffer(I420Buffer::Create(width_, height_, kBufferAlignment));
+uint64_t V4L2FrameBuffer::frame_id() const { return frame_id_; }
+
+void V4L2FrameBuffer::SetFrameId(uint64_t frame_id) {
+  frame_id_ = frame_id;
+  std::lock_guard<std::mutex> lock(i420_mtx_);
+  if (i420_) {
+    i420_->SetFrameId(frame_id);
+  }
+}
 
-  if (format_ == V4L2_PIX_FMT_YUV420) {
-    memcpy(i420_buffer->MutableDataY(), is_buffer_copied ? data_.get() : (uint8_t *) buffer_.start, size_);
+void V4L2FrameBuffer::SetTransform(const FrameTransform &transform) { transform_ = transform; }
+
+std::shared_ptr<I420Buffer> V4L2FrameBuffer::ToI420() {
+  std::lock_guard<std::mutex> lock(i420_mtx_);
+  if (i420_) {
+    return i420_;
+  }
+  const bool identity = transform_.IsIdentity();
+  std::shared_ptr<I420Buffer> i420_buffer(I420Buffer::Create(identity ? width_ : transform_.OutputWidth(),
+                                                             identity ? height_ : transform_.OutputHeight(),
+                                                             kBufferAlignment));
+  i420_buffer->SetFrameId(frame_id_);
+  const uint8_t *data = is_buffer_copied ? data_.get() : (uint8_t *) buffer_.start;
+
+  if (format_ == V4L2_PIX_FMT_YUV420 && identity) {
+    memcpy(i420_buffer->MutableDataY(), data, size_);
   } else if (format_ == V4L2_PIX_FMT_H264) {
     // use hw decoded frame from track.
+  } else if (format_ == V4L2_PIX_FMT_MJPEG && transform_.IsCropped()) {
+    // libyuv decodes MJPEG whole and ignores the crop offset, the region is rotated out of the decoded frame.
+    auto decoded = I420Buffer::Create(width_, height_, kBufferAlignment);
+    if (libyuv::ConvertToI420(data, size_, decoded->MutableDataY(), decoded->StrideY(), decoded->MutableDataU(),
+                              decoded->StrideU(), decoded->MutableDataV(), decoded->StrideV(), 0, 0, width_, height_,
+                              width_, height_, libyuv::kRotate0, format_) < 0) {
+      ERROR_PRINT("%s ConvertToI420 Failed", V4L2Util::FourccToString(format_).c_str());
+    }
+    const int chroma_offset_u = transform_.crop_y / 2 * decoded->StrideU() + transform_.crop_x / 2;
+    const int chroma_offset_v = transform_.crop_y / 2 * decoded->StrideV() + transform_.crop_x / 2;
+    libyuv::I420Rotate(decoded->DataY() + transform_.crop_y * decoded->StrideY() + transform_.crop_x,
+                       decoded->StrideY(), decoded->DataU() + chroma_offset_u, decoded->StrideU(),
+                       decoded->DataV() + chroma_offset_v, decoded->StrideV(), i420_buffer->MutableDataY(),
+                       i420_buffer->StrideY(), i420_buffer->MutableDataU(), i420_buffer->StrideU(),
+                       i420_buffer->MutableDataV(), i420_buffer->StrideV(), transform_.crop_width,
+                       transform_.crop_height, static_cast<libyuv::RotationMode>(transform_.rotation));
   } else {
-    if (libyuv::ConvertToI420(is_buffer_copied ? data_.get() : (uint8_t *) buffer_.start, size_,
-                              i420_buffer.get()->MutableDataY(), i420_buffer.get()->StrideY(),
-                              i420_buffer.get()->MutableDataU(), i420_buffer.get()->StrideU(),
-                              i420_buffer.get()->MutableDataV(), i420_buffer.get()->StrideV(), 0, 0, width_, height_,
-                              width_, height_, libyuv::kRotate0, libyuv::FOURCC_MJPG) < 0) {
-      ERROR_PRINT("Mjpeg ConvertToI420 Failed");
+    // Crops and rotates in the same call, for raw formats without a second pass over the frame.
+    const bool full = !transform_.IsCropped();
+    if (libyuv::ConvertToI420(data, size_, i420_buffer->MutableDataY(), i420_buffer->StrideY(),
+                              i420_buffer->MutableDataU(), i420_buffer->StrideU(), i420_buffer->MutableDataV(),
+                              i420_buffer->StrideV(), full ? 0 : transform_.crop_x, full ? 0 : transform_.crop_y,
+                              width_, height_, full ? width_ : transform_.crop_width,
+                              full ? height_ : transform_.crop_height,
+                              static_cast<libyuv::RotationMode>(transform_.rotation), format_) < 0) {
+      ERROR_PRINT("%s ConvertToI420 Failed", V4L2Util::FourccToString(format_).c_str());
     }
   }
 
+  i420_ = i420_buffer;
   return i420_buffer;
 }
 
@@ -1,11 +1,14 @@
 #ifndef V4L2_FRAME_BUFFER_H_
 #define V4L2_FRAME_BUFFER_H_
 
+#include "common/frame_transform.h"
 #include "common/v4l2_utils.h"
 
+#include <functional>
 #include <iostream>
 #include <linux/videodev2.h>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <boost/align/aligned_alloc.hpp>
@@ -17,6 +20,9 @@ struct BoostAlignedFree {
 class I420Buffer {
 public:
   static std::shared_ptr<I420Buffer> Create(int width, int height, int align);
+  // Planes owned by someone else, `release` runs once the buffer is no longer referenced.
+  static std::shared_ptr<I420Buffer> Wrap(int width, int height, uint8_t *y, int stride_y, uint8_t *u, int stride_u,
+                                          uint8_t *v, int stride_v, std::function<void()> release);
 
   int width() const noexcept { return w_; }
   int height() const noexcept { return h_; }
@@ -34,7 +40,14 @@ public:
 
   size_t ByteSize() const noexcept { return size_t(sy_) * h_ + size_t(su_) * (h_ / 2) + size_t(sv_) * (h_ / 2); }
 
-  ~I420Buffer() = default;
+  uint64_t frame_id() const noexcept { return frame_id_; }
+  void SetFrameId(uint64_t frame_id) noexcept { frame_id_ = frame_id; }
+
+  ~I420Buffer() {
+    if (release_) {
+      release_();
+    }
+  }
 
   I420Buffer(const I420Buffer &) = delete;
   I420Buffer &operator=(const I420Buffer &) = delete;
@@ -50,31 +63,41 @@ private:
   int h_{};
   int sy_{}, su_{}, sv_{};
   int align_{};
+  uint64_t frame_id_{};
 
   std::unique_ptr<uint8_t, BoostAlignedFree> mem_{nullptr, BoostAlignedFree{}};
   uint8_t *y_{nullptr};
   uint8_t *u_{nullptr};
   uint8_t *v_{nullptr};
+  std::function<void()> release_;
 };
 
 class V4L2FrameBuffer {
 public:
   static std::shared_ptr<V4L2FrameBuffer> Create(int width, int height, int size, uint32_t format);
   static std::shared_ptr<V4L2FrameBuffer> Create(int width, int height, V4L2Buffer buffer);
+  // A frame already in I420, ToI420() hands out `i420` itself.
+  static std::shared_ptr<V4L2FrameBuffer> Create(std::shared_ptr<I420Buffer> i420, timeval timestamp);
 
   V4L2FrameBuffer(int width, int height, int size, uint32_t format);
   V4L2FrameBuffer(int width, int height, V4L2Buffer buffer);
+  V4L2FrameBuffer(std::shared_ptr<I420Buffer> i420, timeval timestamp);
 
   ~V4L2FrameBuffer();
 
   int width() const;
   int height() const;
+  // Converted once and shared, every consumer of a capture gets the same buffer.
   std::shared_ptr<I420Buffer> ToI420();
+  // Cropped and rotated by ToI420(), set before the frame is handed out.
+  void SetTransform(const FrameTransform &transform);
 
   uint32_t format() const;
   unsigned int size() const;
   unsigned int flags() const;
   timeval timestamp() const;
+  uint64_t frame_id() const;
+  void SetFrameId(uint64_t frame_id);
 
   void CopyBufferData();
   const void *Data() const;
@@ -88,7 +111,11 @@ private:
   unsigned int flags_;
   bool is_buffer_copied;
   timeval timestamp_;
+  uint64_t frame_id_;
   V4L2Buffer buffer_;
+  FrameTransform transform_;
+  std::mutex i420_mtx_;
+  std::shared_ptr<I420Buffer> i420_;
 
   const std::unique_ptr<uint8_t, BoostAlignedFree> data_;
 };
@@ -8,7 +8,16 @@
 #pragma once
 
 #include "capturer/video_capturer.h"
-#include "common/h264_frame_buffer.h"
+#include "common/encoded_frame_buffer.h"
+
+// Runtime encoder settings, a field left at 0 keeps its current value.
+struct EncoderSettings {
+  int bitrate = 0; // kbps
+  int width = 0;
+  int height = 0;
+  int fps = 0;
+  int gop = 0;
+};
 
 class Encoder {
 public:
@@ -18,19 +27,31 @@ public:
     frame_buffer_subject_.UnSubscribe();
   }
 
-  std::shared_ptr<Observable<std::shared_ptr<H264FrameBuffer>>> AsFrameBufferObservable() {
+  std::shared_ptr<Observable<std::shared_ptr<EncodedFrameBuffer>>> AsFrameBufferObservable() {
     return frame_buffer_subject_.AsObservable();
   }
 
+  // Thread-safe, the change is applied before the next frame is encoded.
+  virtual void Reconfigure(EncoderSettings settings) = 0;
+  virtual EncoderSettings settings() const = 0;
+  // Thread-safe, the next encoded frame will be an IDR. In intra-refresh mode a
+  // recovery point may answer instead.
+  virtual void ForceKeyFrame() = 0;
+  // Thread-safe, the next encoded frame will be an IDR in any mode, for consumers
+  // that must start on parameter sets.
+  virtual void ForceIdr() = 0;
+  // The codec of every frame this encoder emits.
+  virtual VideoCodec codec() const = 0;
+
 protected:
   virtual void EncodeBuffer(std::shared_ptr<V4L2FrameBuffer> buffer) = 0;
 
   virtual void SubscribeVideoSource(std::shared_ptr<VideoCapturer> video_src) = 0;
 
-  void NextFrameBuffer(std::shared_ptr<H264FrameBuffer> frame_buffer) { frame_buffer_subject_.Next(frame_buffer); }
+  void NextFrameBuffer(std::shared_ptr<EncodedFrameBuffer> frame_buffer) { frame_buffer_subject_.Next(frame_buffer); }
 
   std::shared_ptr<Observable<std::shared_ptr<V4L2FrameBuffer>>> video_observer_;
 
 private:
-  Subject<std::shared_ptr<H264FrameBuffer>> frame_buffer_subject_;
+  Subject<std::shared_ptr<EncodedFrameBuffer>> frame_buffer_subject_;
 };
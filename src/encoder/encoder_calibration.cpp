@@ -0,0 +1,246 @@
+#include "encoder/encoder_calibration.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+#include "encoder/libav_encoder.hpp"
+
+// Ordered from the fastest to the highest quality.
+static const std::vector<std::string> kPresets = {"ultrafast", "superfast", "veryfast", "faster"};
+// The share of the frame interval encoding may take, the rest is left for
+// capture, conversion and the other pipelines.
+static const double kBudgetShare = 0.6;
+// x264's first frames are slower, they are encoded but not timed.
+static const int kWarmupFrames = 5;
+// Distinct frames generated, the pan wraps around seamlessly after them.
+static const int kSyntheticFrames = 32;
+static const int kBufferAlignment = 64;
+static const char *kMetricLabels = "{stage=\"calibration\"}";
+
+EncoderTuning EncoderCalibration::Tune(Args &args) {
+  // The encoder gets the cropped and rotated frames, rotating in the driver keeps the pixel count.
+  Args encoded_args = args;
+  FrameTransform transform = FrameTransform::Create(args.width, args.height, args.crop, args.rotation);
+  encoded_args.width = transform.OutputWidth();
+  encoded_args.height = transform.OutputHeight();
+
+  const std::string key = CacheKey(encoded_args);
+  EncoderTuning tuning;
+  std::string source = "cache";
+  if (args.calibration_file.empty() || !Load(args.calibration_file, key, tuning)) {
+    source = "benchmark";
+    tuning = Measure(encoded_args);
+    if (!args.calibration_file.empty()) {
+      Store(args.calibration_file, key, tuning);
+    }
+  }
+
+  args.encoder_preset = tuning.preset;
+  args.encoder_thread_type = "slice";
+  args.encoder_threads = tuning.threads;
+  args.encoder_slices = tuning.slices;
+  INFO_PRINT("Encoder calibration (%s) for %s: preset %s, %d threads, %d slices, p95 encode %.1f ms of %.1f ms",
+             source.c_str(), key.c_str(), tuning.preset.c_str(), tuning.threads, tuning.slices, tuning.encode_ms,
+             1000.0 / args.fps);
+  ReportMetrics(args, tuning, source);
+  return tuning;
+}
+
+EncoderTuning EncoderCalibration::Measure(const Args &args) {
+  const double budget_ms = 1000.0 / std::max(args.fps, 1) * kBudgetShare;
+  const int max_threads = MaxThreads(args);
+  std::vector<int> thread_counts;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  auto frames = SyntheticFrames(args.width, args.height, kSyntheticFrames);
+  // Runs where the encoder will, so the thread count is measured on the cores it gets.
+  ScopedThreadPolicy policy(args.encode_policy, "encode");
+
+  EncoderTuning best;
+  EncoderTuning fastest;
+  for (const auto &preset: kPresets) {
+    EncoderTuning fitting;
+    for (int threads: thread_counts) {
+      EncoderTuning candidate = {preset, threads, threads, 0};
+      Args candidate_args = args;
+      candidate_args.encoder_preset = preset;
+      candidate_args.encoder_thread_type = "slice";
+      candidate_args.encoder_threads = threads;
+      candidate_args.encoder_slices = threads;
+      candidate.encode_ms = EncodeTimeMs(candidate_args, frames);
+      DEBUG_PRINT("calibration: %s, %d threads: %.2f ms", preset.c_str(), threads, candidate.encode_ms);
+
+      if (fastest.preset.empty() || candidate.encode_ms < fastest.encode_ms) {
+        fastest = candidate;
+      }
+      if (candidate.encode_ms <= budget_ms) {
+        fitting = candidate;
+        break;
+      }
+    }
+    // Slower presets will not fit where this one did not.
+    if (fitting.preset.empty()) {
+      break;
+    }
+    best = fitting;
+  }
+
+  if (best.preset.empty()) {
+    ERROR_PRINT("calibration: no encoder setting fits %.1f ms per frame at %dx%d, the fastest takes %.1f ms",
+                budget_ms, args.width, args.height, fastest.encode_ms);
+    return fastest;
+  }
+  return best;
+}
+
+double EncoderCalibration::EncodeTimeMs(const Args &args, const std::vector<std::shared_ptr<I420Buffer>> &frames) {
+  Args encoder_args = args;
+  encoder_args.camera_name.clear();
+  encoder_args.adaptive_quality = false;
+  encoder_args.static_threshold = 0;
+  encoder_args.latency_probe = false;
+  LibAvEncoder encoder(encoder_args, kMetricLabels);
+
+  std::vector<double> samples_ms;
+  const int64_t interval_us = 1000000 / std::max(args.fps, 1);
+  for (int i = 0; i < args.calibration_frames + kWarmupFrames; i++) {
+    auto start = std::chrono::steady_clock::now();
+    encoder.EncodeFrame(frames[i % frames.size()], static_cast<int64_t>(i + 1) * interval_us);
+    auto end = std::chrono::steady_clock::now();
+    if (i >= kWarmupFrames) {
+      samples_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+  }
+
+  auto &metrics = Metrics::Instance();
+  for (const char *name: {"webrtc_encoder_convert_ms", "webrtc_encoder_encode_ms", "webrtc_encoder_deliver_ms",
+                          "webrtc_encoder_frames_total", "webrtc_encoder_frames_dropped_total",
+                          "webrtc_encoder_forced_idr_total"}) {
+    metrics.Remove(name + std::string(kMetricLabels));
+  }
+
+  if (samples_ms.empty()) {
+    return 0;
+  }
+  auto p95 = samples_ms.begin() + (samples_ms.size() - 1) * 95 / 100;
+  std::nth_element(samples_ms.begin(), p95, samples_ms.end());
+  return *p95;
+}
+
+std::vector<std::shared_ptr<I420Buffer>> EncoderCalibration::SyntheticFrames(int width, int height, int count) {
+  // A panning gradient under fixed noise, so motion search and residual coding both have work to do.
+  std::vector<uint8_t> noise(static_cast<size_t>(width) * height);
+  uint32_t seed = 12345;
+  for (auto &value: noise) {
+    seed = seed * 1664525 + 1013904223;
+    value = seed >> 27;
+  }
+
+  std::vector<std::shared_ptr<I420Buffer>> frames;
+  for (int i = 0; i < count; i++) {
+    auto frame = I420Buffer::Create(width, height, kBufferAlignment);
+    frame->SetFrameId(i);
+    for (int y = 0; y < height; y++) {
+      uint8_t *row = frame->MutableDataY() + y * frame->StrideY();
+      for (int x = 0; x < width; x++) {
+        row[x] = static_cast<uint8_t>(((x + y + i * 8) & 0xff) / 2 + noise[y * width + x]);
+      }
+    }
+    for (int y = 0; y < (height + 1) / 2; y++) {
+      uint8_t *u = frame->MutableDataU() + y * frame->StrideU();
+      uint8_t *v = frame->MutableDataV() + y * frame->StrideV();
+      for (int x = 0; x < (width + 1) / 2; x++) {
+        u[x] = static_cast<uint8_t>(64 + ((x + i * 4) & 0x7f));
+        v[x] = static_cast<uint8_t>(64 + ((y + i * 4) & 0x7f));
+      }
+    }
+    frames.push_back(std::move(frame));
+  }
+  return frames;
+}
+
+int EncoderCalibration::MaxThreads(const Args &args) {
+  if (args.encoder_threads > 0) {
+    return args.encoder_threads;
+  }
+  if (!args.encode_policy.cpus.empty()) {
+    return static_cast<int>(args.encode_policy.cpus.size());
+  }
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+std::string EncoderCalibration::CacheKey(const Args &args) {
+  // Temporal layers and intra refresh change the reference structure, and so the encode time.
+  return std::to_string(args.width) + "x" + std::to_string(args.height) + "@" + std::to_string(args.fps) + "/" +
+         std::to_string(MaxThreads(args)) + "t/" + std::to_string(args.temporal_layers) + "l" +
+         (args.intra_refresh ? "/ir" : "");
+}
+
+bool EncoderCalibration::Load(const std::string &file, const std::string &key, EncoderTuning &tuning) {
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string entry_key;
+    EncoderTuning entry;
+    if (!(fields >> entry_key >> entry.preset >> entry.threads >> entry.slices >> entry.encode_ms) ||
+        entry_key != key) {
+      continue;
+    }
+    // An entry this build would not produce, e.g. from an edited file, is measured again.
+    if (std::find(kPresets.begin(), kPresets.end(), entry.preset) == kPresets.end() || entry.threads < 1 ||
+        entry.slices < 1) {
+      return false;
+    }
+    tuning = entry;
+    return true;
+  }
+  return false;
+}
+
+void EncoderCalibration::Store(const std::string &file, const std::string &key, const EncoderTuning &tuning) {
+  std::vector<std::string> lines;
+  {
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.compare(0, key.size() + 1, key + " ") != 0) {
+        lines.push_back(line);
+      }
+    }
+  }
+
+  std::ostringstream entry;
+  entry << key << " " << tuning.preset << " " << tuning.threads << " " << tuning.slices << " " << tuning.encode_ms;
+  lines.push_back(entry.str());
+
+  std::ofstream out(file, std::ios::trunc);
+  for (const auto &line: lines) {
+    out << line << "\n";
+  }
+  if (!out) {
+    ERROR_PRINT("calibration: cannot write %s", file.c_str());
+  }
+}
+
+void EncoderCalibration::ReportMetrics(const Args &args, const EncoderTuning &tuning, const std::string &source) {
+  const std::string labels = Metrics::WithLabel("", "camera", args.camera_name);
+  std::string info_labels = Metrics::WithLabel("", "source", source);
+  info_labels = Metrics::WithLabel(info_labels, "slices", std::to_string(tuning.slices));
+  info_labels = Metrics::WithLabel(info_labels, "threads", std::to_string(tuning.threads));
+  info_labels = Metrics::WithLabel(info_labels, "preset", tuning.preset);
+  info_labels = Metrics::WithLabel(info_labels, "camera", args.camera_name);
+
+  auto &metrics = Metrics::Instance();
+  metrics.SetGauge("webrtc_encoder_calibration_info" + info_labels, 1);
+  metrics.SetGauge("webrtc_encoder_calibration_encode_ms" + labels, tuning.encode_ms);
+  metrics.SetGauge("webrtc_encoder_calibration_budget_ms" + labels, 1000.0 / std::max(args.fps, 1));
+}
@@ -0,0 +1,48 @@
+#ifndef ENCODER_CALIBRATION_H_
+#define ENCODER_CALIBRATION_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "common/v4l2_frame_buffer.h"
+
+// An x264 setting chosen for this host, in slice threading mode.
+struct EncoderTuning {
+  std::string preset;
+  int threads = 1;
+  int slices = 1;
+  // The 95th percentile encode time of the setting, in ms.
+  double encode_ms = 0;
+};
+
+/*
+ * Picks the x264 preset and slice thread count for a pipeline by encoding
+ * synthetic frames at its resolution. Presets are tried from the fastest up,
+ * each with as few threads (one slice per thread) as keep the 95th percentile
+ * encode time within a share of the frame interval; the slowest preset that
+ * fits wins, as the fewest slices cost the least quality. Results are cached
+ * per resolution, fps and thread limit, so a restart reuses them.
+ */
+class EncoderCalibration {
+public:
+  // Writes the tuning for `args` into its encoder options, from the cache file
+  // when it has an entry and by measuring otherwise.
+  static EncoderTuning Tune(Args &args);
+
+  static EncoderTuning Measure(const Args &args);
+  // The 95th percentile time of encoding `args.calibration_frames` of `frames`, repeated
+  // as needed, with the encoder options of `args`.
+  static double EncodeTimeMs(const Args &args, const std::vector<std::shared_ptr<I420Buffer>> &frames);
+  static std::vector<std::shared_ptr<I420Buffer>> SyntheticFrames(int width, int height, int count);
+
+private:
+  static int MaxThreads(const Args &args);
+  static std::string CacheKey(const Args &args);
+  static bool Load(const std::string &file, const std::string &key, EncoderTuning &tuning);
+  static void Store(const std::string &file, const std::string &key, const EncoderTuning &tuning);
+  static void ReportMetrics(const Args &args, const EncoderTuning &tuning, const std::string &source);
+};
+
+#endif // ENCODER_CALIBRATION_H_
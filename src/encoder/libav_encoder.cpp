@@ -5,17 +5,59 @@
  * libav_encoder.cpp - libav video encoder.
  */
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
+#include <libyuv.h>
+
+#include "common/frame_tracer.h"
+#include "common/latency_probe.h"
 #include "common/logging.h"
+#include "common/metrics.h"
 #include "libav_encoder.hpp"
 
 namespace {
 
+const int kBufferAlignment = 64;
+const int64_t kMinRateReopenUs = 1000000;
+// Encoders that read the rate only when opened are reopened once the target has moved this far
+// from the rate they were opened with, smaller steps are set in place.
+const double kRateReopenFraction = 0.2;
+
+int64_t TimevalToUs(const timeval &tv) { return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec; }
+
+// Whether an Annex B access unit holds an IDR slice, as opposed to a recovery
+// point x264 also flags as a keyframe in intra-refresh mode.
+bool HasIdrSlice(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i + 3 < size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1 && (data[i + 3] & 0x1f) == 5) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void encoderOptionsGeneral(Args args, AVCodecContext *codec) {
   codec->framerate = {args.fps * 1000, 1000};
-  codec->profile = FF_PROFILE_UNKNOWN;
+  codec->level = FF_LEVEL_UNKNOWN;
+  codec->gop_size = args.gop > 0 ? args.gop : args.fps;
 
+  codec->bit_rate = args.bitrate * 1000;
+  // Left at 0, the encoders size their pools by the machine's cores rather than the pinned set.
+  codec->thread_count = args.encoder_threads > 0 ? args.encoder_threads : args.encode_policy.cpus.size();
+}
+
+// x264 presets from the fastest, other encoders map the position to their own speed levels.
+int presetSlowness(const std::string &preset) {
+  static const std::vector<std::string> presets = {"ultrafast", "superfast", "veryfast", "faster", "fast", "medium"};
+  auto it = std::find(presets.begin(), presets.end(), preset);
+  return it == presets.end() ? 0 : static_cast<int>(it - presets.begin());
+}
+
+void encoderOptionsLibx264(Args args, AVCodecContext *codec) {
+  codec->profile = FF_PROFILE_UNKNOWN;
+  // What WebRTC receivers decode, no B-frames. Temporal layers are encoded by OpenH264.
   std::string h264_profile = "constrained baseline";
   const AVCodecDescriptor *desc = avcodec_descriptor_get(codec->codec_id);
   for (const AVProfile *profile = desc->profiles; profile && profile->profile != FF_PROFILE_UNKNOWN; profile++) {
@@ -27,22 +69,18 @@ void encoderOptionsGeneral(Args args, AVCodecContext *codec) {
   if (codec->profile == FF_PROFILE_UNKNOWN)
     throw std::runtime_error("libav: no such profile " + h264_profile);
 
-  codec->level = FF_LEVEL_UNKNOWN;
-  codec->gop_size = args.fps;
-
-  codec->bit_rate = args.bitrate * 1000;
-}
-
-void encoderOptionsLibx264([[maybe_unused]] Args args, AVCodecContext *codec) {
   codec->me_range = 16;
   codec->me_cmp = 1; // No chroma ME
   codec->me_subpel_quality = 0;
-  codec->thread_count = 0;
 
-  codec->thread_type = FF_THREAD_SLICE;
-  codec->slices = 4;
+  if (args.encoder_thread_type == "frame") {
+    codec->thread_type = FF_THREAD_FRAME;
+  } else {
+    codec->thread_type = FF_THREAD_SLICE;
+    codec->slices = args.encoder_slices;
+  }
   codec->refs = 1;
-  av_opt_set(codec->priv_data, "preset", "ultrafast", 0);
+  av_opt_set(codec->priv_data, "preset", args.encoder_preset.c_str(), 0);
   av_opt_set(codec->priv_data, "tune", "zerolatency", 0);
 
   av_opt_set(codec->priv_data, "weightp", "none", 0);
@@ -51,20 +89,103 @@ void encoderOptionsLibx264([[maybe_unused]] Args args, AVCodecContext *codec) {
   av_opt_set(codec->priv_data, "sc_threshold", "0", 0);
   av_opt_set(codec->priv_data, "rc-lookahead", "0", 0);
   av_opt_set(codec->priv_data, "mixed_ref", "0", 0);
+  // Frames sent with pict_type I become IDRs, so a forced keyframe is a valid switch point.
+  av_opt_set(codec->priv_data, "forced-idr", "1", 0);
+
+  if (args.intra_refresh) {
+    // The refresh wave spans one GOP and ends in a recovery point, the only IDR is the first frame.
+    av_opt_set(codec->priv_data, "intra-refresh", "1", 0);
+  }
+  codec->max_b_frames = 0;
+}
+
+void encoderOptionsLibvpx(Args args, AVCodecContext *codec, bool vp9) {
+  const int slowness = presetSlowness(args.encoder_preset);
+  // VP8 takes speeds up to 16, libvpx caps VP9 at 9.
+  const int cpu_used = vp9 ? std::max(9 - slowness, 5) : std::max(16 - 2 * slowness, 6);
+  av_opt_set(codec->priv_data, "deadline", "realtime", 0);
+  av_opt_set_int(codec->priv_data, "cpu-used", cpu_used, 0);
+  av_opt_set_int(codec->priv_data, "lag-in-frames", 0, 0);
+  av_opt_set(codec->priv_data, "error-resilient", "default", 0);
+  if (vp9) {
+    av_opt_set_int(codec->priv_data, "row-mt", 1, 0);
+  }
+  // Cap the rate as well, a VBR overshoot is queueing delay on the link. Both follow
+  // `args.bitrate`, a bitrate change reopens the encoder with new ones.
+  codec->rc_max_rate = static_cast<int64_t>(args.bitrate) * 1000;
+  codec->rc_buffer_size = args.bitrate * 500;
+}
+
+void encoderOptionsAv1(Args args, AVCodecContext *codec, const AVCodec *encoder) {
+  const int slowness = presetSlowness(args.encoder_preset);
+  if (!strcmp(encoder->name, "libsvtav1")) {
+    av_opt_set_int(codec->priv_data, "preset", std::max(12 - slowness, 8), 0);
+    // Low-delay prediction structure, no look-ahead.
+    av_opt_set(codec->priv_data, "svtav1-params", "pred-struct=1", 0);
+  } else {
+    av_opt_set(codec->priv_data, "usage", "realtime", 0);
+    av_opt_set_int(codec->priv_data, "cpu-used", std::max(8 - slowness, 6), 0);
+    av_opt_set_int(codec->priv_data, "lag-in-frames", 0, 0);
+    av_opt_set_int(codec->priv_data, "row-mt", 1, 0);
+  }
+}
+
+// The libav encoders tried for a codec, in order of preference.
+std::vector<const char *> encoderNames(VideoCodec codec) {
+  switch (codec) {
+    case VideoCodec::H264:
+      return {"libx264"};
+    case VideoCodec::VP8:
+      return {"libvpx"};
+    case VideoCodec::VP9:
+      return {"libvpx-vp9"};
+    case VideoCodec::AV1:
+      // SVT-AV1 is several times faster at real-time speeds.
+      return {"libsvtav1", "libaom-av1"};
+  }
+  return {};
+}
+
+VideoCodec parseCodec(const std::string &name) {
+  VideoCodec codec;
+  if (!ParseVideoCodec(name, codec))
+    throw std::invalid_argument("libav: unknown codec " + name);
+  return codec;
 }
 
 } // namespace
 
-std::shared_ptr<LibAvEncoder> LibAvEncoder::Create(std::shared_ptr<VideoCapturer> video_src, Args args) {
-  auto ptr = std::make_shared<LibAvEncoder>(args);
+std::shared_ptr<LibAvEncoder> LibAvEncoder::Create(std::shared_ptr<VideoCapturer> video_src, Args args,
+                                                   std::string metric_labels) {
+  auto ptr = std::make_shared<LibAvEncoder>(args, std::move(metric_labels));
   ptr->SubscribeVideoSource(video_src);
 
   return ptr;
 }
 
-LibAvEncoder::LibAvEncoder(Args args) : config_(args), video_start_ts_(0) {
+bool LibAvEncoder::HasEncoder(VideoCodec codec) {
+  for (const char *name: encoderNames(codec)) {
+    if (avcodec_find_encoder_by_name(name))
+      return true;
+  }
+  return false;
+}
+
+LibAvEncoder::LibAvEncoder(Args args, std::string metric_labels) :
+    config_(args), codec_(parseCodec(args.codec)),
+    metric_labels_(Metrics::WithLabel(metric_labels, "camera", args.camera_name)), source_fps_(args.fps),
+    has_pending_settings_(false), last_reopen_us_(0), opened_bitrate_(args.bitrate), force_key_frame_(false),
+    recovery_start_us_(0), last_recovery_request_us_(0), video_start_ts_(0), next_frame_ts_(0), deliver_ms_(0) {
   av_log_set_level(AV_LOG_INFO);
 
+  if (config_.adaptive_quality) {
+    quality_ = std::make_unique<QualityController>(config_, metric_labels_);
+  }
+  if (config_.static_threshold > 0) {
+    static_detector_ =
+            std::make_unique<StaticFrameDetector>(config_.static_threshold, config_.static_refresh_ms, metric_labels_);
+  }
+
   initVideoCodec();
 
   pkt_[Video] = av_packet_alloc();
@@ -78,21 +199,232 @@ LibAvEncoder::~LibAvEncoder() {
   DEBUG_PRINT("libav: codec closed");
 }
 
+void LibAvEncoder::Reconfigure(EncoderSettings settings) {
+  if (settings.bitrate < 0 || settings.fps < 0 || settings.gop < 0 || settings.width < 0 || settings.height < 0)
+    throw std::invalid_argument("encoder settings must not be negative");
+  if ((settings.width > 0) != (settings.height > 0))
+    throw std::invalid_argument("width and height must be changed together");
+  if (settings.width % 2 || settings.height % 2)
+    throw std::invalid_argument("width and height must be even");
+  if (settings.fps > source_fps_)
+    throw std::invalid_argument("fps can not exceed the capture rate of " + std::to_string(source_fps_));
+
+  std::lock_guard<std::mutex> lock(settings_mtx_);
+  if (settings.bitrate)
+    pending_settings_.bitrate = settings.bitrate;
+  if (settings.width) {
+    pending_settings_.width = settings.width;
+    pending_settings_.height = settings.height;
+  }
+  if (settings.fps)
+    pending_settings_.fps = settings.fps;
+  if (settings.gop)
+    pending_settings_.gop = settings.gop;
+  has_pending_settings_.store(true);
+}
+
+EncoderSettings LibAvEncoder::settings() const {
+  std::lock_guard<std::mutex> lock(settings_mtx_);
+  return {config_.bitrate, config_.width, config_.height, config_.fps, config_.gop > 0 ? config_.gop : config_.fps};
+}
+
+VideoCodec LibAvEncoder::codec() const { return codec_; }
+
+void LibAvEncoder::ForceKeyFrame() {
+  if (!config_.intra_refresh) {
+    force_key_frame_.store(true);
+    return;
+  }
+
+  // In intra-refresh mode every GOP already ends in a recovery point, so a PLI is answered
+  // within one refresh period without an IDR spike. Only a receiver that keeps asking for
+  // longer than two periods, e.g. one that will start only on an IDR, gets one forced.
+  std::lock_guard<std::mutex> lock(recovery_mtx_);
+  const EncoderSettings current = settings();
+  const int64_t period_us = static_cast<int64_t>(current.gop) * 1000000 / std::max(current.fps, 1);
+  const int64_t now_us = FrameTracer::NowUs();
+  if (now_us - last_recovery_request_us_ > 2 * period_us) {
+    recovery_start_us_ = now_us;
+  }
+  last_recovery_request_us_ = now_us;
+  Metrics::Instance().AddCounter("webrtc_encoder_recovery_requests_total" + metric_labels_);
+
+  if (now_us - recovery_start_us_ >= 2 * period_us) {
+    force_key_frame_.store(true);
+    recovery_start_us_ = now_us;
+    Metrics::Instance().AddCounter("webrtc_encoder_forced_idr_total" + metric_labels_);
+  }
+}
+
+void LibAvEncoder::ForceIdr() {
+  if (!force_key_frame_.exchange(true) && config_.intra_refresh) {
+    Metrics::Instance().AddCounter("webrtc_encoder_forced_idr_total" + metric_labels_);
+  }
+}
+
+void LibAvEncoder::applyPendingSettings() {
+  std::lock_guard<std::mutex> lock(settings_mtx_);
+  EncoderSettings settings = pending_settings_;
+  // Only libx264 and OpenH264 follow every rate change in place. The others are reopened, which
+  // costs a keyframe, for a change beyond kRateReopenFraction of the rate they were opened with,
+  // measured from that rate so a target wandering around the threshold does not reopen each
+  // time. Such reopens happen at most once per kMinRateReopenUs, the latest value stays pending.
+  const int64_t now_us = FrameTracer::NowUs();
+  const bool rate_only = !settings.width && !settings.fps && !settings.gop;
+  const bool in_place = codec_ == VideoCodec::H264 ||
+                        std::abs(settings.bitrate - opened_bitrate_) < opened_bitrate_ * kRateReopenFraction;
+  if (!in_place && rate_only && settings.bitrate && settings.bitrate != config_.bitrate &&
+      now_us - last_reopen_us_ < kMinRateReopenUs) {
+    return;
+  }
+  pending_settings_ = {};
+  has_pending_settings_.store(false);
+
+  bool reopen = false;
+  if (settings.bitrate && settings.bitrate != config_.bitrate) {
+    config_.bitrate = settings.bitrate;
+    if (openh264_) {
+      openh264_->SetBitrate(settings.bitrate);
+    } else if (in_place) {
+      // libx264 picks up a changed bit_rate on the next frame through x264_encoder_reconfig. Wrappers
+      // that read it only when opened keep a rate within kRateReopenFraction of the new one.
+      codec_ctx_[Video]->bit_rate = settings.bitrate * 1000;
+      if (codec_ == VideoCodec::VP8 || codec_ == VideoCodec::VP9) {
+        codec_ctx_[Video]->rc_max_rate = static_cast<int64_t>(settings.bitrate) * 1000;
+        codec_ctx_[Video]->rc_buffer_size = settings.bitrate * 500;
+      }
+    } else {
+      reopen = true;
+    }
+  }
+  if (settings.width && (settings.width != config_.width || settings.height != config_.height)) {
+    config_.width = settings.width;
+    config_.height = settings.height;
+    reopen = true;
+  }
+  if (settings.fps && settings.fps != config_.fps) {
+    config_.fps = settings.fps;
+    reopen = true;
+  }
+  if (settings.gop && settings.gop != config_.gop) {
+    config_.gop = settings.gop;
+    reopen = true;
+  }
+
+  INFO_PRINT("Encoder reconfigured: %dx%d@%d, %d kbps, gop %d%s", config_.width, config_.height, config_.fps,
+             config_.bitrate, config_.gop, reopen ? ", codec reopened" : "");
+  Metrics::Instance().SetGauge("webrtc_encoder_bitrate_kbps" + metric_labels_, config_.bitrate);
+  Metrics::Instance().AddCounter("webrtc_encoder_reconfigurations_total" + metric_labels_);
+
+  if (reopen) {
+    last_reopen_us_ = now_us;
+    if (quality_) {
+      quality_ = std::make_unique<QualityController>(config_, metric_labels_);
+    }
+    // A fresh context starts with an IDR carrying SPS/PPS, so viewers resync without renegotiation.
+    reopenVideoCodec();
+  }
+}
+
 void LibAvEncoder::EncodeBuffer(std::shared_ptr<V4L2FrameBuffer> buffer) {
-  auto t_start = std::chrono::high_resolution_clock::now();
-  AVFrame *frame = av_frame_alloc();
-  if (!frame)
-    throw std::runtime_error("libav: could not allocate AVFrame");
+  const int64_t ts_us = TimevalToUs(buffer->timestamp());
+  if (!beginFrame(ts_us)) {
+    return;
+  }
+
+  auto t_start = std::chrono::steady_clock::now();
+  std::shared_ptr<I420Buffer> i420_buffer;
+  {
+    ScopedTrace trace(buffer->frame_id(), TraceStage::Convert);
+    i420_buffer = buffer->ToI420();
+  }
+  double convert_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
 
-  auto tv_to_us = [](const timeval &tv) { return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec; };
+  encodeI420(i420_buffer, ts_us, convert_ms);
+}
+
+void LibAvEncoder::EncodeFrame(std::shared_ptr<I420Buffer> buffer, int64_t ts_us) {
+  if (!beginFrame(ts_us)) {
+    return;
+  }
+  encodeI420(buffer, ts_us, 0);
+}
+
+bool LibAvEncoder::beginFrame(int64_t ts_us) {
+  if (has_pending_settings_.load()) {
+    applyPendingSettings();
+  }
 
   if (!video_start_ts_) {
-    video_start_ts_ = tv_to_us(buffer->timestamp());
+    video_start_ts_ = ts_us;
 
     DEBUG_PRINT("Video start timestamp : %" PRId64 "", video_start_ts_);
   }
 
-  auto i420_buffer = buffer->ToI420();
+  if (!acceptFrame(ts_us)) {
+    Metrics::Instance().AddCounter("webrtc_encoder_frames_dropped_total" + metric_labels_);
+    return false;
+  }
+  return true;
+}
+
+void LibAvEncoder::encodeI420(std::shared_ptr<I420Buffer> buffer, int64_t ts_us, double convert_ms) {
+  // A requested keyframe is never skipped, a viewer is waiting for it.
+  if (static_detector_ && !force_key_frame_.load() && static_detector_->IsStatic(*buffer, ts_us)) {
+    return;
+  }
+
+  auto t_start = std::chrono::steady_clock::now();
+  std::shared_ptr<I420Buffer> i420_buffer = scaleToCodec(buffer);
+  auto t_converted = std::chrono::steady_clock::now();
+
+  const int64_t pts = ts_us - video_start_ts_;
+  const bool key = force_key_frame_.exchange(false);
+  const bool tracing = FrameTracer::Enabled();
+  const int64_t submit_us = tracing ? FrameTracer::NowUs() : 0;
+  pending_frames_[pts] = {i420_buffer->frame_id(), submit_us, ts_us};
+  deliver_ms_ = 0;
+
+  if (openh264_) {
+    int temporal_id = 0;
+    const bool encoded = openh264_->Encode(*i420_buffer, pts, key, pkt_[Video], temporal_id);
+    if (tracing) {
+      FrameTracer::Instance().Record(i420_buffer->frame_id(), TraceStage::EncodeSubmit, submit_us,
+                                     FrameTracer::NowUs());
+    }
+    if (encoded) {
+      deliver(pkt_[Video], temporal_id);
+    } else {
+      pending_frames_.erase(pts);
+    }
+  } else {
+    sendFrame(i420_buffer, pts, key);
+    if (tracing) {
+      FrameTracer::Instance().Record(i420_buffer->frame_id(), TraceStage::EncodeSubmit, submit_us,
+                                     FrameTracer::NowUs());
+    }
+    encode(pkt_[Video], Video);
+  }
+
+  auto t_end = std::chrono::steady_clock::now();
+  convert_ms += std::chrono::duration<double, std::milli>(t_converted - t_start).count();
+  // Packetizing, pacing and sending to the peers is not the codec's time, the quality
+  // controller would lower the resolution for a slow network path.
+  double encode_ms = std::chrono::duration<double, std::milli>(t_end - t_converted).count() - deliver_ms_;
+  Metrics::Instance().SetGauge("webrtc_encoder_convert_ms" + metric_labels_, convert_ms);
+  Metrics::Instance().SetGauge("webrtc_encoder_encode_ms" + metric_labels_, encode_ms);
+  Metrics::Instance().SetGauge("webrtc_encoder_deliver_ms" + metric_labels_, deliver_ms_);
+  Metrics::Instance().AddCounter("webrtc_encoder_frames_total" + metric_labels_);
+
+  if (quality_ && quality_->Update(convert_ms, encode_ms)) {
+    reopenVideoCodec();
+  }
+}
+
+void LibAvEncoder::sendFrame(std::shared_ptr<I420Buffer> i420_buffer, int64_t pts, bool key) {
+  AVFrame *frame = av_frame_alloc();
+  if (!frame)
+    throw std::runtime_error("libav: could not allocate AVFrame");
 
   frame->format = codec_ctx_[Video]->pix_fmt;
   frame->width = i420_buffer->width();
@@ -102,62 +434,147 @@ void LibAvEncoder::EncodeBuffer(std::shared_ptr<V4L2FrameBuffer> buffer) {
   frame->linesize[1] = i420_buffer->StrideU();
   frame->linesize[2] = i420_buffer->StrideV();
 
-  const int64_t ts_us = tv_to_us(buffer->timestamp());
-  frame->pts = ts_us - video_start_ts_;
+  frame->pts = pts;
+  if (key) {
+    frame->pict_type = AV_PICTURE_TYPE_I;
+  }
 
   auto *holder = new std::shared_ptr<I420Buffer>(i420_buffer);
 
   frame->buf[0] = av_buffer_create(i420_buffer->MutableDataY(), i420_buffer->ByteSize(), &LibAvEncoder::releaseBuffer,
                                    holder, 0);
-  av_image_fill_pointers(frame->data, AV_PIX_FMT_YUV420P, frame->height, frame->buf[0]->data, frame->linesize);
+  // The planes need not be contiguous, e.g. frames encoded in place from a producer's shared memory.
+  frame->data[0] = i420_buffer->MutableDataY();
+  frame->data[1] = i420_buffer->MutableDataU();
+  frame->data[2] = i420_buffer->MutableDataV();
   av_frame_make_writable(frame);
 
   int ret = avcodec_send_frame(codec_ctx_[Video], frame);
+  av_frame_free(&frame);
   if (ret < 0)
     throw std::runtime_error("libav: error encoding frame: " + std::to_string(ret));
+}
 
-  encode(pkt_[Video], Video);
+bool LibAvEncoder::acceptFrame(int64_t ts_us) {
+  const int fps = quality_ ? quality_->level().fps : config_.fps;
+  if (fps >= source_fps_) {
+    return true;
+  }
 
-  av_frame_free(&frame);
+  // Decimate the capture rate down to the target fps, tolerating half a source frame of jitter.
+  const int64_t interval = 1000000 / fps;
+  const int64_t tolerance = 1000000 / source_fps_ / 2;
+  if (ts_us + tolerance < next_frame_ts_) {
+    return false;
+  }
+  next_frame_ts_ = ts_us - next_frame_ts_ > interval ? ts_us + interval : next_frame_ts_ + interval;
+  return true;
+}
 
-  // 记录结束时间
-  auto t_end = std::chrono::high_resolution_clock::now();
-  double elapsed_ms = std::chrono::duration<double, std::milli>(t_end - t_start).count();
+std::shared_ptr<I420Buffer> LibAvEncoder::scaleToCodec(std::shared_ptr<I420Buffer> src) {
+  const int width = openh264_ ? openh264_->width() : codec_ctx_[Video]->width;
+  const int height = openh264_ ? openh264_->height() : codec_ctx_[Video]->height;
+  if (src->width() == width && src->height() == height) {
+    return src;
+  }
 
-  // 打印单次耗时
-  std::cout << "[media] EncodeBuffer耗时: " << elapsed_ms << " ms" << std::endl;
+  ScopedTrace trace(src->frame_id(), TraceStage::Convert);
+  auto dst = I420Buffer::Create(width, height, kBufferAlignment);
+  dst->SetFrameId(src->frame_id());
+  libyuv::I420Scale(src->DataY(), src->StrideY(), src->DataU(), src->StrideU(), src->DataV(), src->StrideV(),
+                    src->width(), src->height(), dst->MutableDataY(), dst->StrideY(), dst->MutableDataU(),
+                    dst->StrideU(), dst->MutableDataV(), dst->StrideV(), width, height, libyuv::kFilterBilinear);
+  return dst;
+}
+
+Args LibAvEncoder::effectiveConfig() const {
+  Args args = config_;
+  if (quality_) {
+    const QualityLevel &level = quality_->level();
+    args.fps = level.fps;
+    args.width = level.width;
+    args.height = level.height;
+    args.encoder_preset = level.preset;
+  }
+  return args;
+}
+
+void LibAvEncoder::reopenVideoCodec() {
+  // Drain what the old context still holds so no frame is lost across the switch.
+  if (codec_ctx_[Video]) {
+    avcodec_send_frame(codec_ctx_[Video], nullptr);
+    encode(pkt_[Video], Video);
+    avcodec_free_context(&codec_ctx_[Video]);
+  }
+  openh264_.reset();
+  pending_frames_.clear();
+
+  initVideoCodec();
 }
 
 void LibAvEncoder::SubscribeVideoSource(std::shared_ptr<VideoCapturer> video_src) {
   video_observer_ = video_src->AsFrameBufferObservable();
-  video_observer_->Subscribe([this](std::shared_ptr<V4L2FrameBuffer> buffer) { EncodeBuffer(buffer); });
+  // Hold the encoder for the duration of a frame, so one released by its last viewer is
+  // destroyed between frames instead of underneath the capture thread.
+  std::weak_ptr<LibAvEncoder> weak_encoder = shared_from_this();
+  video_observer_->Subscribe([weak_encoder](std::shared_ptr<V4L2FrameBuffer> buffer) {
+    if (auto encoder = weak_encoder.lock()) {
+      encoder->EncodeBuffer(buffer);
+    }
+  });
 }
 
 void LibAvEncoder::initVideoCodec() {
-  const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+  codec_ctx_[Video] = nullptr;
+  if (codec_ == VideoCodec::H264 && config_.temporal_layers > 1) {
+    // libx264 would need B-frames for the layers, OpenH264 layers P frames.
+    const Args config = effectiveConfig();
+    const int threads = config.encoder_threads > 0 ? config.encoder_threads : config.encode_policy.cpus.size();
+    openh264_ = std::make_unique<OpenH264Context>(config, threads, presetSlowness(config.encoder_preset));
+    return;
+  }
+
+  const AVCodec *codec = nullptr;
+  for (const char *name: encoderNames(codec_)) {
+    if ((codec = avcodec_find_encoder_by_name(name)))
+      break;
+  }
   if (!codec)
-    throw std::runtime_error("libav: cannot find video encoder libx264");
+    throw std::runtime_error(std::string("libav: cannot find a video encoder for ") + VideoCodecName(codec_));
 
   codec_ctx_[Video] = avcodec_alloc_context3(codec);
   if (!codec_ctx_[Video])
     throw std::runtime_error("libav: Cannot allocate video context");
 
-  codec_ctx_[Video]->width = config_.width;
-  codec_ctx_[Video]->height = config_.height;
+  const Args config = effectiveConfig();
+  codec_ctx_[Video]->width = config.width;
+  codec_ctx_[Video]->height = config.height;
   // usec timebase
   codec_ctx_[Video]->time_base = {1, 1000 * 1000};
   codec_ctx_[Video]->sw_pix_fmt = AV_PIX_FMT_YUV420P;
   codec_ctx_[Video]->pix_fmt = AV_PIX_FMT_YUV420P;
 
-  // Apply specific options.
-  encoderOptionsLibx264(config_, codec_ctx_[Video]);
-
   // Apply general options.
-  encoderOptionsGeneral(config_, codec_ctx_[Video]);
+  encoderOptionsGeneral(config, codec_ctx_[Video]);
+
+  // Apply specific options.
+  if (codec_ == VideoCodec::H264) {
+    encoderOptionsLibx264(config, codec_ctx_[Video]);
+  } else if (codec_ == VideoCodec::AV1) {
+    encoderOptionsAv1(config, codec_ctx_[Video], codec);
+  } else {
+    encoderOptionsLibvpx(config, codec_ctx_[Video], codec_ == VideoCodec::VP9);
+  }
 
-  int ret = avcodec_open2(codec_ctx_[Video], codec, nullptr);
+  // The encoder starts its threads here, they keep the encode stage's placement.
+  int ret;
+  {
+    ScopedThreadPolicy policy(config.encode_policy, "encode");
+    ret = avcodec_open2(codec_ctx_[Video], codec, nullptr);
+  }
   if (ret < 0)
     throw std::runtime_error("libav: unable to open video codec: " + std::to_string(ret));
+  opened_bitrate_ = config.bitrate;
 }
 
 void LibAvEncoder::encode(AVPacket *pkt, unsigned int stream_id) {
@@ -172,12 +589,67 @@ void LibAvEncoder::encode(AVPacket *pkt, unsigned int stream_id) {
     } else if (ret < 0)
       throw std::runtime_error("libav: error receiving packet: " + std::to_string(ret));
 
-    bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
-    auto frame_buffer = H264FrameBuffer::Create(pkt->data, pkt->size, key, pkt->pts);
-    NextFrameBuffer(frame_buffer);
+    deliver(pkt, 0);
+  }
+}
 
-    av_packet_unref(pkt);
+void LibAvEncoder::deliver(AVPacket *pkt, int temporal_id) {
+  bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+  uint64_t frame_id = 0;
+  int64_t capture_us = pkt->pts + video_start_ts_;
+  auto pending = pending_frames_.find(pkt->pts);
+  if (pending != pending_frames_.end()) {
+    frame_id = pending->second.frame_id;
+    capture_us = pending->second.capture_us;
+    if (FrameTracer::Enabled() && pending->second.submit_us) {
+      FrameTracer::Instance().Record(pending->second.frame_id, TraceStage::PacketOut, pending->second.submit_us,
+                                     FrameTracer::NowUs());
+    }
+    pending_frames_.erase(pending);
+  }
+  // Packets leave in decode order, frames shown before this packet's dts were already returned.
+  pending_frames_.erase(pending_frames_.begin(), pending_frames_.lower_bound(pkt->dts));
+
+  std::shared_ptr<EncodedFrameBuffer> frame_buffer;
+  if (config_.latency_probe && codec_ == VideoCodec::H264) {
+    frame_buffer = withLatencyProbe(pkt, key, frame_id, capture_us);
+  } else {
+    // Take a reference on the packet's buffer (no copy), so consumers may keep the frame past delivery.
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref)
+      throw std::runtime_error("libav: could not reference encoded packet");
+    frame_buffer = EncodedFrameBuffer::Create(ref->data, ref->size, key, ref->pts,
+                                              [ref](uint8_t *) mutable { av_packet_free(&ref); });
+  }
+  frame_buffer->SetFrameId(frame_id);
+  frame_buffer->SetCaptureTime(capture_us);
+  frame_buffer->SetDecodeDelay(pkt->pts - pkt->dts);
+  frame_buffer->SetCodec(codec_);
+  frame_buffer->SetTemporalId(temporal_id);
+  if (codec_ == VideoCodec::H264 && key && config_.intra_refresh) {
+    frame_buffer->SetIdr(HasIdrSlice(pkt->data, pkt->size));
   }
+
+  auto t_deliver = std::chrono::steady_clock::now();
+  NextFrameBuffer(frame_buffer);
+  deliver_ms_ += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_deliver).count();
+
+  av_packet_unref(pkt);
+}
+
+std::shared_ptr<EncodedFrameBuffer> LibAvEncoder::withLatencyProbe(const AVPacket *pkt, bool key, uint64_t frame_id,
+                                                                   int64_t capture_us) {
+  LatencyProbe probe;
+  probe.capture_us = capture_us;
+  probe.frame_id = frame_id;
+  const std::vector<uint8_t> sei = probe.ToSei();
+
+  // The SEI has to precede the slices, so the access unit is copied once behind it.
+  const size_t size = sei.size() + pkt->size;
+  uint8_t *data = new uint8_t[size];
+  std::copy(sei.begin(), sei.end(), data);
+  std::copy(pkt->data, pkt->data + pkt->size, data + sei.size());
+  return EncodedFrameBuffer::Create(data, size, key, pkt->pts, [](uint8_t *p) { delete[] p; });
 }
 
 extern "C" void LibAvEncoder::releaseBuffer(void *opaque, uint8_t *) {
@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 
 extern "C" {
 #include "libavcodec/avcodec.h"
@@ -18,14 +21,32 @@ extern "C" {
 
 #include "args.h"
 #include "encoder.hpp"
+#include "encoder/openh264_context.h"
+#include "encoder/quality_controller.h"
+#include "encoder/static_frame_detector.h"
 
-class LibAvEncoder : public Encoder {
+class LibAvEncoder : public Encoder, public std::enable_shared_from_this<LibAvEncoder> {
 public:
-  static std::shared_ptr<LibAvEncoder> Create(std::shared_ptr<VideoCapturer> video_src, Args args);
+  static std::shared_ptr<LibAvEncoder> Create(std::shared_ptr<VideoCapturer> video_src, Args args,
+                                              std::string metric_labels = "");
+  // Whether libav was built with an encoder for `codec`, e.g. AV1 needs libsvtav1 or libaom.
+  static bool HasEncoder(VideoCodec codec);
 
-  LibAvEncoder(Args args);
+  // `metric_labels` is appended to the metric names, e.g. `{layer="1"}` when several encoders run,
+  // together with a `camera` label when `args.camera_name` is set.
+  LibAvEncoder(Args args, std::string metric_labels = "");
   ~LibAvEncoder();
 
+  void Reconfigure(EncoderSettings settings) override;
+  EncoderSettings settings() const override;
+  void ForceKeyFrame() override;
+  void ForceIdr() override;
+  VideoCodec codec() const override;
+
+  // Encodes a frame that is already I420, for stages that share one conversion
+  // between several encoders. `ts_us` is the capture time.
+  void EncodeFrame(std::shared_ptr<I420Buffer> buffer, int64_t ts_us);
+
 protected:
   void EncodeBuffer(std::shared_ptr<V4L2FrameBuffer> buffer) override;
 
@@ -33,17 +54,61 @@ protected:
 
 private:
   void initVideoCodec();
+  void reopenVideoCodec();
+  void applyPendingSettings();
+  Args effectiveConfig() const;
+
+  bool beginFrame(int64_t ts_us);
+  bool acceptFrame(int64_t ts_us);
+  void encodeI420(std::shared_ptr<I420Buffer> buffer, int64_t ts_us, double convert_ms);
+  void sendFrame(std::shared_ptr<I420Buffer> i420_buffer, int64_t pts, bool key);
+  std::shared_ptr<I420Buffer> scaleToCodec(std::shared_ptr<I420Buffer> src);
 
   void encode(AVPacket *pkt, unsigned int stream_id);
+  // Hands an encoded packet to the subscribers as a frame of layer `temporal_id`.
+  void deliver(AVPacket *pkt, int temporal_id);
+  // Copies the packet behind a LatencyProbe SEI carrying its capture time, H.264 only.
+  std::shared_ptr<EncodedFrameBuffer> withLatencyProbe(const AVPacket *pkt, bool key, uint64_t frame_id,
+                                                       int64_t capture_us);
 
   static void releaseBuffer(void *opaque, uint8_t *data);
 
   Args config_;
+  const VideoCodec codec_;
+  const std::string metric_labels_;
+  const int source_fps_;
+
+  mutable std::mutex settings_mtx_;
+  std::atomic<bool> has_pending_settings_;
+  EncoderSettings pending_settings_;
+  int64_t last_reopen_us_;
+  // The rate the libav context was opened with, in kbps.
+  int opened_bitrate_;
+  std::atomic<bool> force_key_frame_;
+  std::mutex recovery_mtx_;
+  int64_t recovery_start_us_;
+  int64_t last_recovery_request_us_;
 
   uint64_t video_start_ts_;
+  int64_t next_frame_ts_;
+
+  std::unique_ptr<QualityController> quality_;
+  std::unique_ptr<StaticFrameDetector> static_detector_;
+
+  struct PendingFrame {
+    uint64_t frame_id;
+    int64_t submit_us;
+    int64_t capture_us;
+  };
+  // Frames handed to the codec but not yet returned as packets, keyed by pts.
+  std::map<int64_t, PendingFrame> pending_frames_;
+  // Time spent handing this frame's packets to the subscribers, kept out of the encode time.
+  double deliver_ms_;
 
   enum Context { Video = 0, Audio = 1 };
   AVCodecContext *codec_ctx_[2];
+  // Replaces the video context when H.264 is encoded with temporal layers.
+  std::unique_ptr<OpenH264Context> openh264_;
 
   AVPacket *pkt_[2];
 };
@@ -0,0 +1,153 @@
+#include "encoder/openh264_context.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef HAVE_OPENH264
+#include <wels/codec_api.h>
+#endif
+
+#include "common/thread_policy.h"
+
+int OpenH264Context::width() const { return width_; }
+
+int OpenH264Context::height() const { return height_; }
+
+#ifdef HAVE_OPENH264
+
+OpenH264Context::OpenH264Context(const Args &args, int threads, int slowness) :
+    width_(args.width), height_(args.height), encoder_(nullptr) {
+  if (WelsCreateSVCEncoder(&encoder_) != 0 || !encoder_) {
+    throw std::runtime_error("openh264: cannot create an encoder");
+  }
+
+  SEncParamExt param;
+  encoder_->GetDefaultParams(&param);
+  param.iUsageType = CAMERA_VIDEO_REAL_TIME;
+  param.iPicWidth = args.width;
+  param.iPicHeight = args.height;
+  param.fMaxFrameRate = static_cast<float>(args.fps);
+  param.iRCMode = RC_BITRATE_MODE;
+  param.iTargetBitrate = args.bitrate * 1000;
+  param.iMaxBitrate = args.bitrate * 1000;
+  // A late frame is better than a frozen one, the pacer and the layers absorb overshoots.
+  param.bEnableFrameSkip = false;
+  param.iTemporalLayerNum = args.temporal_layers;
+  param.iSpatialLayerNum = 1;
+  param.uiIntraPeriod = args.gop > 0 ? args.gop : args.fps;
+  param.eSpsPpsIdStrategy = CONSTANT_ID;
+  param.bPrefixNalAddingCtrl = false;
+  param.iEntropyCodingModeFlag = 0;
+  param.iComplexityMode = slowness < 2 ? LOW_COMPLEXITY : slowness < 4 ? MEDIUM_COMPLEXITY : HIGH_COMPLEXITY;
+  param.iMultipleThreadIdc = static_cast<unsigned short>(std::max(threads, 1));
+
+  SSpatialLayerConfig &layer = param.sSpatialLayers[0];
+  layer.iVideoWidth = args.width;
+  layer.iVideoHeight = args.height;
+  layer.fFrameRate = static_cast<float>(args.fps);
+  layer.iSpatialBitrate = param.iTargetBitrate;
+  layer.iMaxSpatialBitrate = param.iMaxBitrate;
+  layer.uiProfileIdc = PRO_BASELINE;
+  // Each thread encodes its own slices.
+  const int slices = std::max({args.encoder_slices, threads, 1});
+  layer.sSliceArgument.uiSliceMode = slices > 1 ? SM_FIXEDSLCNUM_SLICE : SM_SINGLE_SLICE;
+  layer.sSliceArgument.uiSliceNum = static_cast<unsigned int>(slices);
+
+  // The encoder starts its threads here, they keep the encode stage's placement.
+  int ret;
+  {
+    ScopedThreadPolicy policy(args.encode_policy, "encode");
+    ret = encoder_->InitializeExt(&param);
+  }
+  if (ret != 0) {
+    WelsDestroySVCEncoder(encoder_);
+    throw std::runtime_error("openh264: unable to open the encoder: " + std::to_string(ret));
+  }
+}
+
+OpenH264Context::~OpenH264Context() {
+  encoder_->Uninitialize();
+  WelsDestroySVCEncoder(encoder_);
+}
+
+void OpenH264Context::SetBitrate(int kbps) {
+  SBitrateInfo bitrate;
+  bitrate.iLayer = SPATIAL_LAYER_ALL;
+  bitrate.iBitrate = kbps * 1000;
+  encoder_->SetOption(ENCODER_OPTION_MAX_BITRATE, &bitrate);
+  encoder_->SetOption(ENCODER_OPTION_BITRATE, &bitrate);
+}
+
+bool OpenH264Context::Encode(const I420Buffer &frame, int64_t pts, bool idr, AVPacket *pkt, int &temporal_id) {
+  SSourcePicture picture;
+  memset(&picture, 0, sizeof(picture));
+  picture.iColorFormat = videoFormatI420;
+  picture.iPicWidth = frame.width();
+  picture.iPicHeight = frame.height();
+  picture.iStride[0] = frame.StrideY();
+  picture.iStride[1] = frame.StrideU();
+  picture.iStride[2] = frame.StrideV();
+  picture.pData[0] = const_cast<uint8_t *>(frame.DataY());
+  picture.pData[1] = const_cast<uint8_t *>(frame.DataU());
+  picture.pData[2] = const_cast<uint8_t *>(frame.DataV());
+  picture.uiTimeStamp = pts / 1000;
+
+  if (idr) {
+    encoder_->ForceIntraFrame(true);
+  }
+  SFrameBSInfo info;
+  memset(&info, 0, sizeof(info));
+  const int ret = encoder_->EncodeFrame(&picture, &info);
+  if (ret != 0) {
+    throw std::runtime_error("openh264: error encoding frame: " + std::to_string(ret));
+  }
+  if (info.eFrameType == videoFrameTypeSkip || info.eFrameType == videoFrameTypeInvalid) {
+    return false;
+  }
+
+  // The layers of one frame lie back to back: parameter sets first, then the slices.
+  size_t size = 0;
+  for (int i = 0; i < info.iLayerNum; i++) {
+    const SLayerBSInfo &layer = info.sLayerInfo[i];
+    for (int nal = 0; nal < layer.iNalCount; nal++) {
+      size += layer.pNalLengthInByte[nal];
+    }
+  }
+  if (av_new_packet(pkt, static_cast<int>(size)) < 0) {
+    throw std::runtime_error("openh264: could not allocate a packet");
+  }
+  size_t offset = 0;
+  temporal_id = 0;
+  for (int i = 0; i < info.iLayerNum; i++) {
+    const SLayerBSInfo &layer = info.sLayerInfo[i];
+    size_t layer_size = 0;
+    for (int nal = 0; nal < layer.iNalCount; nal++) {
+      layer_size += layer.pNalLengthInByte[nal];
+    }
+    memcpy(pkt->data + offset, layer.pBsBuf, layer_size);
+    offset += layer_size;
+    if (layer.uiLayerType == VIDEO_CODING_LAYER) {
+      temporal_id = layer.uiTemporalId;
+    }
+  }
+  pkt->pts = pts;
+  pkt->dts = pts;
+  pkt->flags = info.eFrameType == videoFrameTypeIDR ? AV_PKT_FLAG_KEY : 0;
+  return true;
+}
+
+#else
+
+OpenH264Context::OpenH264Context(const Args &, int, int) : width_(0), height_(0), encoder_(nullptr) {
+  throw std::runtime_error("openh264: temporal layers need a build with OpenH264");
+}
+
+OpenH264Context::~OpenH264Context() {}
+
+void OpenH264Context::SetBitrate(int) {}
+
+bool OpenH264Context::Encode(const I420Buffer &, int64_t, bool, AVPacket *, int &) { return false; }
+
+#endif // HAVE_OPENH264
@@ -0,0 +1,52 @@
+#ifndef OPENH264_CONTEXT_H_
+#define OPENH264_CONTEXT_H_
+
+#include <cstdint>
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+}
+
+#include "args.h"
+#include "common/v4l2_frame_buffer.h"
+
+class ISVCEncoder;
+
+/*
+ * An OpenH264 encoder standing in for the libx264 context when the stream has
+ * temporal layers. x264 keeps every P frame as a reference, so it can only
+ * layer with B-frames, which WebRTC receivers do not decode and which delay
+ * every frame. OpenH264 layers P frames instead: 1-2 for two layers, 1-3-2-3
+ * for three, with the top layer's frames left out of the reference lists
+ * (nal_ref_idc 0) so a congested viewer can skip them. Constrained Baseline
+ * throughout, the output is Annex B with SPS/PPS ahead of every IDR.
+ */
+class OpenH264Context {
+public:
+  // Opens an encoder for `args`, with `threads` slice threads and a complexity
+  // from `slowness`, the position of the x264 preset from the fastest.
+  // Throws std::runtime_error when OpenH264 rejects the configuration.
+  OpenH264Context(const Args &args, int threads, int slowness);
+  ~OpenH264Context();
+
+  OpenH264Context(const OpenH264Context &) = delete;
+  OpenH264Context &operator=(const OpenH264Context &) = delete;
+
+  int width() const;
+  int height() const;
+
+  // Takes effect from the next frame, the encoder is not reopened.
+  void SetBitrate(int kbps);
+
+  // Encodes `frame` into `pkt` with `pts` as both pts and dts, the stream has
+  // no reordering. Returns false when the rate control skipped the frame.
+  // `temporal_id` is the layer of the frame, 0 for the base layer.
+  bool Encode(const I420Buffer &frame, int64_t pts, bool idr, AVPacket *pkt, int &temporal_id);
+
+private:
+  const int width_;
+  const int height_;
+  ISVCEncoder *encoder_;
+};
+
+#endif // OPENH264_CONTEXT_H_
@@ -0,0 +1,113 @@
+#include "encoder/quality_controller.h"
+
+#include <algorithm>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// Load is (convert + encode time) / frame interval, smoothed over ~10 frames.
+static const double kLoadSmoothing = 0.1;
+static const double kOverloadThreshold = 0.85;
+static const double kIdleThreshold = 0.5;
+static const double kStepDownSeconds = 0.5;
+static const double kStepUpSeconds = 3.0;
+static const double kMaxStepUpSeconds = 60.0;
+// An up-step that survives this long is considered good and resets the back-off.
+static const auto kStableDuration = std::chrono::seconds(10);
+
+QualityController::QualityController(Args args, std::string metric_labels) :
+    metric_labels_(std::move(metric_labels)), index_(0), load_(0), overload_frames_(0), idle_frames_(0),
+    up_hold_frames_(0), last_change_(std::chrono::steady_clock::now()), last_change_was_up_(false) {
+  QualityLevel level = {args.fps, args.width, args.height, args.encoder_preset};
+  ladder_.push_back(level);
+
+  auto push = [this](QualityLevel next) {
+    next.width = std::max(next.width & ~1, 16);
+    next.height = std::max(next.height & ~1, 16);
+    next.fps = std::max(next.fps, 1);
+    ladder_.push_back(next);
+  };
+
+  if (level.preset != "ultrafast") {
+    level.preset = "ultrafast";
+    push(level);
+  }
+  level.fps = args.fps * 2 / 3;
+  push(level);
+  level.width = args.width * 3 / 4;
+  level.height = args.height * 3 / 4;
+  push(level);
+  level.fps = args.fps / 2;
+  push(level);
+  level.width = args.width / 2;
+  level.height = args.height / 2;
+  push(level);
+
+  up_hold_frames_ = static_cast<int>(kStepUpSeconds * args.fps);
+  ReportMetrics();
+}
+
+const QualityLevel &QualityController::level() const { return ladder_[index_]; }
+
+int QualityController::level_index() const { return index_; }
+
+double QualityController::load() const { return load_; }
+
+bool QualityController::Update(double convert_ms, double encode_ms) {
+  const QualityLevel &current = ladder_[index_];
+  const double budget_ms = 1000.0 / current.fps;
+  load_ += kLoadSmoothing * ((convert_ms + encode_ms) / budget_ms - load_);
+
+  Metrics::Instance().SetGauge("webrtc_encoder_load" + metric_labels_, load_);
+
+  overload_frames_ = load_ > kOverloadThreshold ? overload_frames_ + 1 : 0;
+  idle_frames_ = load_ < kIdleThreshold ? idle_frames_ + 1 : 0;
+
+  auto now = std::chrono::steady_clock::now();
+  const int base_hold_frames = static_cast<int>(kStepUpSeconds * ladder_[0].fps);
+  if (last_change_was_up_ && now - last_change_ > kStableDuration) {
+    up_hold_frames_ = base_hold_frames;
+    last_change_was_up_ = false;
+  }
+
+  if (overload_frames_ >= kStepDownSeconds * current.fps && index_ + 1 < static_cast<int>(ladder_.size())) {
+    if (last_change_was_up_) {
+      // The previous step up did not hold, wait longer before trying again.
+      up_hold_frames_ = std::min(up_hold_frames_ * 2, static_cast<int>(kMaxStepUpSeconds * ladder_[0].fps));
+    }
+    SetLevel(index_ + 1);
+    last_change_was_up_ = false;
+    return true;
+  }
+
+  if (idle_frames_ >= up_hold_frames_ && index_ > 0) {
+    SetLevel(index_ - 1);
+    last_change_was_up_ = true;
+    return true;
+  }
+
+  return false;
+}
+
+void QualityController::SetLevel(int index) {
+  const QualityLevel &from = ladder_[index_];
+  const QualityLevel &to = ladder_[index];
+  INFO_PRINT("Quality level %d -> %d: %dx%d@%d %s -> %dx%d@%d %s (load %.2f)", index_, index, from.width,
+             from.height, from.fps, from.preset.c_str(), to.width, to.height, to.fps, to.preset.c_str(), load_);
+
+  index_ = index;
+  overload_frames_ = 0;
+  idle_frames_ = 0;
+  last_change_ = std::chrono::steady_clock::now();
+  Metrics::Instance().AddCounter("webrtc_quality_changes_total" + metric_labels_);
+  ReportMetrics();
+}
+
+void QualityController::ReportMetrics() const {
+  const QualityLevel &current = ladder_[index_];
+  auto &metrics = Metrics::Instance();
+  metrics.SetGauge("webrtc_quality_level" + metric_labels_, index_);
+  metrics.SetGauge("webrtc_quality_fps" + metric_labels_, current.fps);
+  metrics.SetGauge("webrtc_quality_width" + metric_labels_, current.width);
+  metrics.SetGauge("webrtc_quality_height" + metric_labels_, current.height);
+}
@@ -0,0 +1,51 @@
+#ifndef QUALITY_CONTROLLER_H_
+#define QUALITY_CONTROLLER_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "args.h"
+
+struct QualityLevel {
+  int fps;
+  int width;
+  int height;
+  std::string preset;
+};
+
+/*
+ * Keeps convert + encode time inside the frame interval. The ladder starts at
+ * the configured fps/resolution/preset and degrades one knob per step. A step
+ * down needs a sustained overload, a step up needs a longer sustained idle
+ * period, and every failed step up doubles the wait before the next attempt,
+ * so a board hovering around its thermal limit does not oscillate.
+ */
+class QualityController {
+public:
+  // `metric_labels` is appended to the metric names, as for the encoder it steers.
+  QualityController(Args args, std::string metric_labels = "");
+
+  // Feeds one encoded frame's timings. Returns true when the level changed.
+  bool Update(double convert_ms, double encode_ms);
+
+  const QualityLevel &level() const;
+  int level_index() const;
+  double load() const;
+
+private:
+  void SetLevel(int index);
+  void ReportMetrics() const;
+
+  const std::string metric_labels_;
+  std::vector<QualityLevel> ladder_;
+  int index_;
+  double load_;
+  int overload_frames_;
+  int idle_frames_;
+  int up_hold_frames_;
+  std::chrono::steady_clock::time_point last_change_;
+  bool last_change_was_up_;
+};
+
+#endif // QUALITY_CONTROLLER_H_
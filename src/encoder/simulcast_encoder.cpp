@@ -0,0 +1,144 @@
+#include "encoder/simulcast_encoder.h"
+
+#include <algorithm>
+
+#include <libyuv.h>
+
+#include "common/frame_tracer.h"
+#include "common/logging.h"
+#include "common/metrics.h"
+
+namespace {
+
+const int kBufferAlignment = 64;
+const int kMinLayerBitrate = 100;
+
+std::shared_ptr<I420Buffer> Downscale(const std::shared_ptr<I420Buffer> &src, int width, int height) {
+  if (src->width() == width && src->height() == height) {
+    return src;
+  }
+
+  auto dst = I420Buffer::Create(width, height, kBufferAlignment);
+  dst->SetFrameId(src->frame_id());
+  libyuv::I420Scale(src->DataY(), src->StrideY(), src->DataU(), src->StrideU(), src->DataV(), src->StrideV(),
+                    src->width(), src->height(), dst->MutableDataY(), dst->StrideY(), dst->MutableDataU(),
+                    dst->StrideU(), dst->MutableDataV(), dst->StrideV(), width, height, libyuv::kFilterBox);
+  return dst;
+}
+
+std::string LayerLabel(int index) { return "{layer=\"" + std::to_string(index) + "\"}"; }
+
+} // namespace
+
+std::shared_ptr<SimulcastEncoder> SimulcastEncoder::Create(std::shared_ptr<VideoCapturer> video_src, Args args) {
+  auto ptr = std::make_shared<SimulcastEncoder>(args);
+  ptr->SubscribeVideoSource(video_src);
+  return ptr;
+}
+
+SimulcastEncoder::SimulcastEncoder(Args args) :
+    metric_labels_(Metrics::WithLabel("", "camera", args.camera_name)), encode_policy_(args.encode_policy),
+    running_(true) {
+  for (int i = 0; i < args.simulcast_layers; i++) {
+    Args layer_args = args;
+    layer_args.width = std::max((args.width >> i) & ~1, 16);
+    layer_args.height = std::max((args.height >> i) & ~1, 16);
+    layer_args.bitrate = std::max(args.bitrate >> (2 * i), std::min(args.bitrate, kMinLayerBitrate));
+    // Layers keep a fixed resolution ladder, peers move between them instead.
+    layer_args.adaptive_quality = false;
+
+    auto layer = std::make_unique<Layer>();
+    layer->index = i;
+    layer->width = layer_args.width;
+    layer->height = layer_args.height;
+    layer->pending_ts_us = 0;
+    layer->metric_labels = Metrics::WithLabel(LayerLabel(i), "camera", args.camera_name);
+    layer->encoder = std::make_shared<LibAvEncoder>(layer_args, LayerLabel(i));
+    INFO_PRINT("Simulcast layer %d: %dx%d@%d, %d kbps", i, layer_args.width, layer_args.height, layer_args.fps,
+               layer_args.bitrate);
+    layers_.push_back(std::move(layer));
+  }
+
+  for (auto &layer: layers_) {
+    Layer *p = layer.get();
+    layer->worker = std::thread([this, p]() { RunLayer(*p); });
+  }
+}
+
+SimulcastEncoder::~SimulcastEncoder() {
+  video_observer_.reset();
+  running_.store(false);
+  for (auto &layer: layers_) {
+    {
+      std::lock_guard<std::mutex> lock(layer->mtx);
+      layer->cv.notify_all();
+    }
+    if (layer->worker.joinable()) {
+      layer->worker.join();
+    }
+  }
+}
+
+std::vector<std::shared_ptr<Encoder>> SimulcastEncoder::layers() const {
+  std::vector<std::shared_ptr<Encoder>> encoders;
+  for (const auto &layer: layers_) {
+    encoders.push_back(layer->encoder);
+  }
+  return encoders;
+}
+
+void SimulcastEncoder::SubscribeVideoSource(std::shared_ptr<VideoCapturer> video_src) {
+  video_observer_ = video_src->AsFrameBufferObservable();
+  video_observer_->Subscribe([this](std::shared_ptr<V4L2FrameBuffer> buffer) { OnFrame(buffer); });
+}
+
+void SimulcastEncoder::OnFrame(std::shared_ptr<V4L2FrameBuffer> buffer) {
+  const timeval tv = buffer->timestamp();
+  const int64_t ts_us = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+
+  // The V4L2 buffer is requeued once this call returns, everything below works on owned copies.
+  auto t_start = std::chrono::steady_clock::now();
+  std::shared_ptr<I420Buffer> frame;
+  {
+    ScopedTrace trace(buffer->frame_id(), TraceStage::Convert);
+    frame = buffer->ToI420();
+    for (auto &layer: layers_) {
+      frame = Downscale(frame, layer->width, layer->height);
+      Post(*layer, frame, ts_us);
+    }
+  }
+  Metrics::Instance().SetGauge(
+          "webrtc_simulcast_convert_ms" + metric_labels_,
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count());
+}
+
+void SimulcastEncoder::Post(Layer &layer, std::shared_ptr<I420Buffer> frame, int64_t ts_us) {
+  {
+    std::lock_guard<std::mutex> lock(layer.mtx);
+    if (layer.pending) {
+      // The queued frame is stale by now, encode the newest capture instead.
+      Metrics::Instance().AddCounter("webrtc_simulcast_frames_dropped_total" + layer.metric_labels);
+    }
+    layer.pending = std::move(frame);
+    layer.pending_ts_us = ts_us;
+  }
+  layer.cv.notify_one();
+}
+
+void SimulcastEncoder::RunLayer(Layer &layer) {
+  ApplyThreadPolicy(encode_policy_, "encode");
+  while (running_.load()) {
+    std::shared_ptr<I420Buffer> frame;
+    int64_t ts_us;
+    {
+      std::unique_lock<std::mutex> lock(layer.mtx);
+      layer.cv.wait(lock, [this, &layer] { return layer.pending || !running_.load(); });
+      if (!running_.load()) {
+        break;
+      }
+      frame = std::move(layer.pending);
+      ts_us = layer.pending_ts_us;
+    }
+    layer.encoder->EncodeFrame(frame, ts_us);
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef SIMULCAST_ENCODER_H_
+#define SIMULCAST_ENCODER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "args.h"
+#include "capturer/video_capturer.h"
+#include "encoder/libav_encoder.hpp"
+
+/*
+ * One capture encoded at several resolutions. Each frame is converted to I420
+ * once on the capture thread, then downscaled layer by layer, each layer from
+ * the one above it. Every layer has its own encoder thread with a single-frame
+ * slot: when a layer is still busy the new frame replaces the queued one for that
+ * layer only, so a slow full-resolution encode never stalls the smaller ones and
+ * always resumes on the newest capture.
+ */
+class SimulcastEncoder {
+public:
+  static std::shared_ptr<SimulcastEncoder> Create(std::shared_ptr<VideoCapturer> video_src, Args args);
+
+  SimulcastEncoder(Args args);
+  ~SimulcastEncoder();
+
+  // Layer 0 is the capture resolution at `--bitrate`, every further layer halves
+  // the resolution and quarters the bitrate.
+  std::vector<std::shared_ptr<Encoder>> layers() const;
+
+private:
+  struct Layer {
+    int index;
+    std::shared_ptr<LibAvEncoder> encoder;
+    int width;
+    int height;
+    std::string metric_labels;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::shared_ptr<I420Buffer> pending;
+    int64_t pending_ts_us;
+    std::thread worker;
+  };
+
+  void SubscribeVideoSource(std::shared_ptr<VideoCapturer> video_src);
+  void OnFrame(std::shared_ptr<V4L2FrameBuffer> buffer);
+  void Post(Layer &layer, std::shared_ptr<I420Buffer> frame, int64_t ts_us);
+  void RunLayer(Layer &layer);
+
+  const std::string metric_labels_;
+  const ThreadPolicy encode_policy_;
+  std::atomic<bool> running_;
+  std::vector<std::unique_ptr<Layer>> layers_;
+  std::shared_ptr<Observable<std::shared_ptr<V4L2FrameBuffer>>> video_observer_;
+};
+
+#endif // SIMULCAST_ENCODER_H_
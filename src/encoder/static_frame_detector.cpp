@@ -0,0 +1,73 @@
+#include "encoder/static_frame_detector.h"
+
+#include <chrono>
+#include <cstring>
+
+#include <libyuv.h>
+
+#include "common/metrics.h"
+
+// Comparing a quarter of the rows is plenty to notice motion and keeps the reference small.
+static const int kRowStep = 4;
+static const int64_t kRatioWindowUs = 1000000;
+
+StaticFrameDetector::StaticFrameDetector(double threshold, int refresh_ms, std::string metric_labels) :
+    threshold_(threshold), refresh_us_(static_cast<int64_t>(refresh_ms) * 1000),
+    metric_labels_(std::move(metric_labels)), width_(0), height_(0), last_kept_us_(0), window_start_us_(0),
+    window_frames_(0), window_skipped_(0) {}
+
+bool StaticFrameDetector::IsStatic(const I420Buffer &frame, int64_t ts_us) {
+  auto t_start = std::chrono::steady_clock::now();
+  bool skip = false;
+  if (frame.width() == width_ && frame.height() == height_ && ts_us - last_kept_us_ < refresh_us_) {
+    skip = Compare(frame) < threshold_;
+  }
+  if (!skip) {
+    Keep(frame, ts_us);
+  }
+  double detect_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+
+  ReportMetrics(skip, detect_ms, ts_us);
+  return skip;
+}
+
+double StaticFrameDetector::Compare(const I420Buffer &frame) const {
+  uint64_t sse = 0;
+  const uint8_t *reference = reference_.data();
+  for (int y = 0; y < height_; y += kRowStep, reference += width_) {
+    sse += libyuv::ComputeSumSquareError(frame.DataY() + static_cast<size_t>(y) * frame.StrideY(), reference,
+                                         width_);
+  }
+  const size_t samples = reference_.size();
+  return samples ? static_cast<double>(sse) / samples : 0;
+}
+
+void StaticFrameDetector::Keep(const I420Buffer &frame, int64_t ts_us) {
+  width_ = frame.width();
+  height_ = frame.height();
+  const int rows = (height_ + kRowStep - 1) / kRowStep;
+  reference_.resize(static_cast<size_t>(rows) * width_);
+  uint8_t *reference = reference_.data();
+  for (int y = 0; y < height_; y += kRowStep, reference += width_) {
+    std::memcpy(reference, frame.DataY() + static_cast<size_t>(y) * frame.StrideY(), width_);
+  }
+  last_kept_us_ = ts_us;
+}
+
+void StaticFrameDetector::ReportMetrics(bool skipped, double detect_ms, int64_t ts_us) {
+  auto &metrics = Metrics::Instance();
+  metrics.SetGauge("webrtc_encoder_static_detect_ms" + metric_labels_, detect_ms);
+  if (skipped) {
+    metrics.AddCounter("webrtc_encoder_static_frames_skipped_total" + metric_labels_);
+  }
+
+  window_frames_++;
+  window_skipped_ += skipped;
+  if (ts_us - window_start_us_ >= kRatioWindowUs) {
+    metrics.SetGauge("webrtc_encoder_static_skip_ratio" + metric_labels_,
+                     static_cast<double>(window_skipped_) / window_frames_);
+    window_start_us_ = ts_us;
+    window_frames_ = 0;
+    window_skipped_ = 0;
+  }
+}
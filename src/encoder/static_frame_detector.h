@@ -0,0 +1,46 @@
+#ifndef STATIC_FRAME_DETECTOR_H_
+#define STATIC_FRAME_DETECTOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/v4l2_frame_buffer.h"
+
+/*
+ * Decides before encoding whether a frame differs from the last encoded one.
+ * Every `kRowStep`-th row of the Y plane is compared with libyuv's SIMD sum of
+ * squared errors, which takes well under a millisecond at 1080p. Frames whose
+ * mean squared error stays below the threshold are skipped, except one every
+ * `refresh_ms` so receivers keep seeing the stream alive.
+ */
+class StaticFrameDetector {
+public:
+  // `threshold` is the mean squared luma error per sampled pixel below which a frame is static.
+  StaticFrameDetector(double threshold, int refresh_ms, std::string metric_labels = "");
+
+  // Returns true when the frame should be skipped. The frame becomes the new
+  // reference whenever it is not.
+  bool IsStatic(const I420Buffer &frame, int64_t ts_us);
+
+private:
+  double Compare(const I420Buffer &frame) const;
+  void Keep(const I420Buffer &frame, int64_t ts_us);
+  void ReportMetrics(bool skipped, double detect_ms, int64_t ts_us);
+
+  const double threshold_;
+  const int64_t refresh_us_;
+  const std::string metric_labels_;
+
+  int width_;
+  int height_;
+  std::vector<uint8_t> reference_;
+  int64_t last_kept_us_;
+
+  int64_t window_start_us_;
+  int window_frames_;
+  int window_skipped_;
+};
+
+#endif // STATIC_FRAME_DETECTOR_H_
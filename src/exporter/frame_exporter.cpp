@@ -0,0 +1,249 @@
+#include "exporter/frame_exporter.h"
+
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// The row alignment of the buffers V4L2FrameBuffer::ToI420() converts into.
+static const int kI420RowAlignment = 64;
+
+static uint32_t I420Capacity(int width, int height) {
+  const uint32_t stride_y = (width + kI420RowAlignment - 1) / kI420RowAlignment * kI420RowAlignment;
+  return stride_y * height + 2 * (stride_y / 2) * ((height + 1) / 2);
+}
+
+static uint8_t *CopyPlane(uint8_t *dst, const uint8_t *src, int stride, int rows) {
+  memcpy(dst, src, static_cast<size_t>(stride) * rows);
+  return dst + static_cast<size_t>(stride) * rows;
+}
+
+std::shared_ptr<FrameExporter> FrameExporter::Create(std::shared_ptr<VideoCapturer> capturer,
+                                                     std::shared_ptr<Encoder> encoder, Args args) {
+  auto ptr = std::make_shared<FrameExporter>(std::move(capturer), std::move(encoder), args);
+  ptr->Subscribe();
+  return ptr;
+}
+
+FrameExporter::FrameExporter(std::shared_ptr<VideoCapturer> capturer, std::shared_ptr<Encoder> encoder, Args args) :
+    socket_path_(args.export_socket), metric_labels_(Metrics::WithLabel("", "camera", args.camera_name)),
+    capturer_(std::move(capturer)), encoder_(std::move(encoder)), listen_fd_(-1), stop_fd_(-1) {
+  const int width = capturer_->width();
+  const int height = capturer_->height();
+  if (capturer_->format() != V4L2_PIX_FMT_H264) {
+    i420_ring_ = std::make_unique<ShmRingWriter>("webrtc-ros-i420", ShmFrameFormat::Raw, args.export_slots,
+                                                 I420Capacity(width, height));
+  }
+  if (args.export_h264) {
+    // Far above any encoded frame at sane bitrates, larger ones are dropped and counted.
+    h264_ring_ = std::make_unique<ShmRingWriter>("webrtc-ros-h264", ShmFrameFormat::H264, args.export_slots,
+                                                 width * height / 2);
+  }
+  if (!i420_ring_ && !h264_ring_) {
+    throw std::runtime_error("export: an H.264 camera has no I420 frames, add --export-h264");
+  }
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("export: socket path too long: " + socket_path_);
+  }
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(socket_path_.c_str());
+  if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(listen_fd_, 8) < 0) {
+    std::string error = strerror(errno);
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+    }
+    throw std::runtime_error("export: cannot listen on " + socket_path_ + ": " + error);
+  }
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+
+  INFO_PRINT("export: serving frame rings on %s", socket_path_.c_str());
+  server_ = std::thread([this]() { Serve(); });
+}
+
+FrameExporter::~FrameExporter() {
+  capture_observer_.reset();
+  encoded_observer_.reset();
+
+  uint64_t one = 1;
+  if (write(stop_fd_, &one, sizeof(one)) < 0) {
+    ERROR_PRINT("export: cannot stop the server thread: %s", strerror(errno));
+  }
+  if (server_.joinable()) {
+    server_.join();
+  }
+  for (const auto &[conn_fd, event_fd]: readers_) {
+    close(conn_fd);
+    close(event_fd);
+  }
+  close(stop_fd_);
+  close(listen_fd_);
+  unlink(socket_path_.c_str());
+  Metrics::Instance().Remove("webrtc_export_readers" + metric_labels_);
+}
+
+void FrameExporter::Subscribe() {
+  if (i420_ring_) {
+    capture_observer_ = capturer_->AsFrameBufferObservable();
+    capture_observer_->Subscribe([this](std::shared_ptr<V4L2FrameBuffer> buffer) { OnCapture(std::move(buffer)); });
+  }
+  if (h264_ring_) {
+    encoded_observer_ = encoder_->AsFrameBufferObservable();
+    encoded_observer_->Subscribe([this](std::shared_ptr<EncodedFrameBuffer> frame) { OnEncoded(std::move(frame)); });
+  }
+}
+
+void FrameExporter::OnCapture(std::shared_ptr<V4L2FrameBuffer> buffer) {
+  {
+    std::lock_guard<std::mutex> lock(readers_mtx_);
+    if (readers_.empty()) {
+      return;
+    }
+  }
+
+  // Converted once per capture, the encoder gets the same buffer.
+  auto i420 = buffer->ToI420();
+  const timeval tv = buffer->timestamp();
+  const int chroma_rows = (i420->height() + 1) / 2;
+  ShmFrameMeta meta{};
+  meta.capture_us = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+  meta.frame_id = buffer->frame_id();
+  meta.size = i420->StrideY() * i420->height() + (i420->StrideU() + i420->StrideV()) * chroma_rows;
+  meta.flags = kShmFrameKey;
+  meta.pixel_format = V4L2_PIX_FMT_YUV420;
+  meta.width = i420->width();
+  meta.height = i420->height();
+  meta.stride_y = i420->StrideY();
+  meta.stride_u = i420->StrideU();
+  meta.stride_v = i420->StrideV();
+  uint8_t *dst = i420_ring_->Begin(meta.size);
+  if (!dst) {
+    Metrics::Instance().AddCounter("webrtc_export_oversize_total" + Metrics::WithLabel(metric_labels_, "ring", "i420"));
+    return;
+  }
+  dst = CopyPlane(dst, i420->DataY(), i420->StrideY(), i420->height());
+  dst = CopyPlane(dst, i420->DataU(), i420->StrideU(), chroma_rows);
+  CopyPlane(dst, i420->DataV(), i420->StrideV(), chroma_rows);
+  i420_ring_->Commit(meta);
+  Metrics::Instance().AddCounter("webrtc_export_frames_total" + Metrics::WithLabel(metric_labels_, "ring", "i420"));
+  Notify();
+}
+
+void FrameExporter::OnEncoded(std::shared_ptr<EncodedFrameBuffer> frame) {
+  {
+    std::lock_guard<std::mutex> lock(readers_mtx_);
+    if (readers_.empty()) {
+      return;
+    }
+  }
+
+  ShmFrameMeta meta{};
+  meta.capture_us = frame->capture_time_us();
+  meta.frame_id = frame->frame_id();
+  meta.size = frame->size();
+  meta.flags = frame->isKeyFrame() ? kShmFrameKey : 0;
+  if (!h264_ring_->Write(meta, frame->data())) {
+    Metrics::Instance().AddCounter("webrtc_export_oversize_total" + Metrics::WithLabel(metric_labels_, "ring", "h264"));
+    return;
+  }
+  Metrics::Instance().AddCounter("webrtc_export_frames_total" + Metrics::WithLabel(metric_labels_, "ring", "h264"));
+  Notify();
+}
+
+void FrameExporter::Notify() {
+  // The eventfds are non-blocking, a reader that stopped reading its own never holds us up.
+  uint64_t one = 1;
+  std::lock_guard<std::mutex> lock(readers_mtx_);
+  for (const auto &[conn_fd, event_fd]: readers_) {
+    if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      DEBUG_PRINT("export: cannot notify reader %d: %s", conn_fd, strerror(errno));
+    }
+  }
+}
+
+void FrameExporter::Serve() {
+  while (true) {
+    std::vector<pollfd> fds = {{stop_fd_, POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+    {
+      std::lock_guard<std::mutex> lock(readers_mtx_);
+      for (const auto &[conn_fd, event_fd]: readers_) {
+        fds.push_back({conn_fd, POLLIN, 0});
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ERROR_PRINT("export: poll failed: %s", strerror(errno));
+      return;
+    }
+
+    if (fds[0].revents) {
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      int conn_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (conn_fd >= 0) {
+        AddReader(conn_fd);
+      }
+    }
+    // Readers send nothing, anything readable on their connection is them hanging up.
+    for (size_t i = 2; i < fds.size(); i++) {
+      if (fds[i].revents) {
+        RemoveReader(fds[i].fd);
+      }
+    }
+  }
+}
+
+void FrameExporter::AddReader(int conn_fd) {
+  int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (event_fd < 0) {
+    ERROR_PRINT("export: cannot create an eventfd: %s", strerror(errno));
+    close(conn_fd);
+    return;
+  }
+
+  std::vector<int> ring_fds;
+  if (i420_ring_) {
+    ring_fds.push_back(i420_ring_->fd());
+  }
+  if (h264_ring_) {
+    ring_fds.push_back(h264_ring_->fd());
+  }
+  if (!SendRings(conn_fd, ring_fds, event_fd)) {
+    ERROR_PRINT("export: cannot hand the rings to a reader: %s", strerror(errno));
+    close(event_fd);
+    close(conn_fd);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(readers_mtx_);
+  readers_[conn_fd] = event_fd;
+  DEBUG_PRINT("export: reader %d connected", conn_fd);
+  Metrics::Instance().SetGauge("webrtc_export_readers" + metric_labels_, readers_.size());
+}
+
+void FrameExporter::RemoveReader(int conn_fd) {
+  std::lock_guard<std::mutex> lock(readers_mtx_);
+  auto it = readers_.find(conn_fd);
+  if (it == readers_.end()) {
+    return;
+  }
+  close(it->second);
+  close(it->first);
+  readers_.erase(it);
+  DEBUG_PRINT("export: reader %d disconnected", conn_fd);
+  Metrics::Instance().SetGauge("webrtc_export_readers" + metric_labels_, readers_.size());
+}
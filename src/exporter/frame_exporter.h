@@ -0,0 +1,59 @@
+#ifndef FRAME_EXPORTER_H_
+#define FRAME_EXPORTER_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "args.h"
+#include "capturer/video_capturer.h"
+#include "common/shm_frame_ring.h"
+#include "encoder/encoder.hpp"
+
+/*
+ * Publishes the captured frames, after the one I420 conversion they share with
+ * the encoder, and optionally the encoded H.264, to shared-memory rings so local
+ * processes can use the camera without opening it again or decoding the
+ * WebRTC stream. Readers connecting to a Unix socket receive a ShmRingHello
+ * with the I420 ring, the H.264 ring if exported, and an eventfd of their own.
+ */
+class FrameExporter {
+public:
+  // Throws std::runtime_error if the rings or the socket can not be set up.
+  static std::shared_ptr<FrameExporter> Create(std::shared_ptr<VideoCapturer> capturer,
+                                               std::shared_ptr<Encoder> encoder, Args args);
+
+  FrameExporter(std::shared_ptr<VideoCapturer> capturer, std::shared_ptr<Encoder> encoder, Args args);
+  ~FrameExporter();
+
+private:
+  void Subscribe();
+  void OnCapture(std::shared_ptr<V4L2FrameBuffer> buffer);
+  void OnEncoded(std::shared_ptr<EncodedFrameBuffer> frame);
+  void Notify();
+  void Serve();
+  void AddReader(int conn_fd);
+  void RemoveReader(int conn_fd);
+
+  const std::string socket_path_;
+  const std::string metric_labels_;
+  std::shared_ptr<VideoCapturer> capturer_;
+  std::shared_ptr<Encoder> encoder_;
+  std::shared_ptr<Observable<std::shared_ptr<V4L2FrameBuffer>>> capture_observer_;
+  std::shared_ptr<Observable<std::shared_ptr<EncodedFrameBuffer>>> encoded_observer_;
+  std::unique_ptr<ShmRingWriter> i420_ring_;
+  std::unique_ptr<ShmRingWriter> h264_ring_;
+
+  int listen_fd_;
+  // Wakes the server thread up to exit.
+  int stop_fd_;
+  std::thread server_;
+
+  std::mutex readers_mtx_;
+  // Connection fd to the eventfd handed to that reader.
+  std::map<int, int> readers_;
+};
+
+#endif // FRAME_EXPORTER_H_
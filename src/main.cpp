@@ -1,15 +1,48 @@
+#include "common/frame_tracer.h"
+#include "encoder/encoder_calibration.h"
 #include "parser.h"
 #include "signaling/http_service.h"
 #include "v4l2_webrtc.h"
 
+#include <csignal>
+
+static void WaitTraceSignal(boost::asio::signal_set &signals, const std::string &trace_file) {
+  signals.async_wait([&signals, trace_file](const boost::system::error_code &ec, int) {
+    if (ec) {
+      return;
+    }
+    FrameTracer::Instance().ExportChromeTrace(trace_file);
+    WaitTraceSignal(signals, trace_file);
+  });
+}
+
 int main(int argc, char *argv[]) {
   Args args;
   Parser::ParseArgs(argc, argv, args);
-  auto v4l2_webrtc = V4L2Webrtc::Create(args);
+  if (args.trace) {
+    FrameTracer::Instance().Start();
+  }
+  // All pipelines share the HTTP server, libdatachannel's threads and the metrics.
+  std::vector<std::shared_ptr<V4L2Webrtc>> cameras;
+  for (auto &camera_args: Parser::CameraArgs(args)) {
+    // The calibration tunes x264, other codecs keep their preset.
+    if (args.calibrate_encoder && camera_args.codec == "h264") {
+      EncoderCalibration::Tune(camera_args);
+    }
+    cameras.push_back(V4L2Webrtc::Create(camera_args));
+  }
+
+  // The HTTP server runs on this thread; libdatachannel's pool is started from it
+  // right away so its threads inherit the same placement.
+  ApplyThreadPolicy(args.io_policy, "io");
+  rtc::Preload();
 
   boost::asio::io_context ioc;
-  auto http_service = HttpService::Create(args, v4l2_webrtc, ioc);
+  auto http_service = HttpService::Create(args, cameras, ioc);
   http_service->Start();
 
+  boost::asio::signal_set trace_signals(ioc, SIGUSR1);
+  WaitTraceSignal(trace_signals, args.trace_file);
+
   ioc.run();
 }
@@ -1,10 +1,14 @@
 #include "parser.h"
+#include "encoder/libav_encoder.hpp"
 #include "rtc/rtc_peer.h"
 
 #include <algorithm>
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <regex>
+#include <sstream>
 #include <string>
+#include <thread>
 
 namespace bpo = boost::program_options;
 
@@ -25,28 +29,134 @@ inline int ParseEnum(const std::unordered_map<std::string, int> table, const std
 
 void Parser::ParseArgs(int argc, char *argv[], Args &args) {
   bpo::options_description opts("Options");
+  std::vector<std::string> profile_specs;
+  std::vector<std::string> camera_specs;
+  std::vector<std::string> affinity_specs;
+  std::vector<std::string> priority_specs;
+  std::string codecs = args.codec;
+  std::string crop;
 
   // clang-format off
     opts.add_options()
         ("help,h", "Display the help message")
         ("camera", bpo::value<std::string>(&args.camera)->default_value(args.camera),
             "Specify the camera using V4L2. "
-            "e.g. \"v4l2:0\" for V4L2 at `/dev/video0`.")
+            "e.g. \"v4l2:0\" for V4L2 at `/dev/video0`, \"synthetic:0\" for a generated test pattern, "
+            "\"shm:/run/webrtc-ros-input.sock\" for frames written to shared memory by another process.")
+        ("add-camera", bpo::value<std::vector<std::string>>(&camera_specs)->composing(),
+            "Run a capture pipeline served at `/whep/<name>`, as `name=CAMERA[,width=W,height=H,fps=F,"
+            "bitrate=KBPS,rotation=R,crop=CROP,format=FMT,codec=CODEC]`, e.g. `front=v4l2:0,width=1280,height=720`. "
+            "Repeatable, replaces `--camera`; `/whep` serves the first one. Unset fields take the global options.")
         ("v4l2-format", bpo::value<std::string>(&args.v4l2_format)->default_value(args.v4l2_format),
             "The input format (`i420`, `yuyv`, `mjpeg`, `h264`) of the V4L2 camera.")
         ("fps", bpo::value<int>(&args.fps)->default_value(args.fps), "Specify the camera frames per second.")
         ("width", bpo::value<int>(&args.width)->default_value(args.width), "Set camera frame width.")
         ("height", bpo::value<int>(&args.height)->default_value(args.height), "Set camera frame height.")
         ("rotation", bpo::value<int>(&args.rotation)->default_value(args.rotation),
-            "Set the rotation angle of the camera (0, 90, 180, 270).")
+            "Set the rotation angle of the camera (0, 90, 180, 270). Done in software, together with the crop "
+            "and the conversion to I420, when the driver has no rotation control.")
+        ("crop", bpo::value<std::string>(&crop)->default_value(crop),
+            "Encode only a region of the captured frame, as `WIDTHxHEIGHT+X+Y` in capture pixels before the "
+            "rotation, or `WIDTHxHEIGHT` for the centre. Not for h264 or shm input.")
+        ("codec", bpo::value<std::string>(&codecs)->default_value(codecs),
+            "The video codec (`h264`, `vp8`, `vp9`, `av1`), or a preference list such as `h264,av1`. The first "
+            "is always encoded, a viewer whose WHEP offer lacks it gets the first later one it offers, encoded "
+            "while watched. Recording, export, temporal layers, intra refresh and the latency probe need `h264` first.")
 		("bitrate", bpo::value<int>(&args.bitrate)->default_value(args.bitrate),
 			"Set the video bitrate for encoding.")
+        ("adaptive-bitrate", bpo::bool_switch(&args.adaptive_bitrate)->default_value(args.adaptive_bitrate),
+            "Lower the bitrate to the slowest viewer's REMB estimate and RTCP loss, `--bitrate` is the ceiling.")
+        ("min-bitrate", bpo::value<int>(&args.min_bitrate)->default_value(args.min_bitrate),
+            "The lowest bitrate (kbps) adaptive bitrate may select.")
+        ("gop", bpo::value<int>(&args.gop)->default_value(args.gop),
+            "The keyframe interval in frames, 0 uses one keyframe per second.")
+        ("encoder-preset", bpo::value<std::string>(&args.encoder_preset)->default_value(args.encoder_preset),
+            "The x264 preset, e.g. `ultrafast`, `superfast`, `veryfast`.")
+        ("encoder-thread-type", bpo::value<std::string>(&args.encoder_thread_type)->default_value(args.encoder_thread_type),
+            "The libav threading mode of the encoder (`slice`, `frame`).")
+        ("encoder-threads", bpo::value<int>(&args.encoder_threads)->default_value(args.encoder_threads),
+            "The encoder thread count, 0 lets libav pick one per core.")
+        ("encoder-slices", bpo::value<int>(&args.encoder_slices)->default_value(args.encoder_slices),
+            "The number of slices per frame in slice threading mode.")
+        ("calibrate-encoder", bpo::bool_switch(&args.calibrate_encoder)->default_value(args.calibrate_encoder),
+            "At startup, pick the slowest x264 preset and the fewest slice threads whose encode time fits "
+            "the frame interval with headroom, replacing `--encoder-preset`, `--encoder-thread-type`, "
+            "`--encoder-threads` and `--encoder-slices`. `--encoder-threads` or the encode CPU set caps the "
+            "threads. Cameras whose `--codec` is not h264 are left as configured.")
+        ("calibration-file", bpo::value<std::string>(&args.calibration_file)->default_value(args.calibration_file),
+            "Cache of calibration results per resolution, fps and thread cap; a hit skips the measurement. "
+            "Empty always measures. Delete it after a hardware change.")
+        ("calibration-frames", bpo::value<int>(&args.calibration_frames)->default_value(args.calibration_frames),
+            "Synthetic frames encoded per calibrated setting.")
+        ("adaptive-quality", bpo::bool_switch(&args.adaptive_quality)->default_value(args.adaptive_quality),
+            "Step fps, resolution and preset down when convert + encode overruns the frame interval.")
+        ("simulcast-layers", bpo::value<int>(&args.simulcast_layers)->default_value(args.simulcast_layers),
+            "Encode 1-3 layers, each at half the resolution and a quarter of the bitrate of the one above. "
+            "With `--adaptive-bitrate` every viewer gets the layer its bandwidth supports.")
+        ("temporal-layers", bpo::value<int>(&args.temporal_layers)->default_value(args.temporal_layers),
+            "Encode 1-3 temporal layers of P frames, the top one left unreferenced (H.264 with OpenH264, "
+            "no intra refresh). With `--adaptive-bitrate` congested viewers get half or a quarter of the frame rate.")
+        ("intra-refresh", bpo::bool_switch(&args.intra_refresh)->default_value(args.intra_refresh),
+            "Replace periodic IDR frames with a column of intra blocks sweeping across every GOP, "
+            "so no single frame bursts the link.")
+        ("static-threshold", bpo::value<double>(&args.static_threshold)->default_value(args.static_threshold),
+            "Skip frames whose mean squared luma difference to the last encoded frame is below this, "
+            "e.g. 4 for a typical sensor's noise. 0 encodes every frame.")
+        ("static-refresh-ms", bpo::value<int>(&args.static_refresh_ms)->default_value(args.static_refresh_ms),
+            "While the scene is static, still encode one frame this often.")
+        ("profile", bpo::value<std::vector<std::string>>(&profile_specs)->composing(),
+            "Add a variant viewers can request with `/whep?profile=<name>`, as `name=WIDTHxHEIGHT@KBPS`. "
+            "Repeatable. Its encoder runs only while someone watches it. Defaults to `thumb=320x240@200`.")
+        ("pacing-factor", bpo::value<double>(&args.pacing_factor)->default_value(args.pacing_factor),
+            "Pace RTP packets at this multiple of the target bitrate, 0 sends every frame as one burst.")
+        ("nack-history-ms", bpo::value<int>(&args.nack_history_ms)->default_value(args.nack_history_ms),
+            "Keep sent frames this long to answer NACKs from viewers, 0 disables retransmission.")
+        ("nack-history-kb", bpo::value<int>(&args.nack_history_kb)->default_value(args.nack_history_kb),
+            "The most encoded video kept for retransmission, shared by all viewers.")
+        ("latency-probe", bpo::bool_switch(&args.latency_probe)->default_value(args.latency_probe),
+            "Prefix every frame with an SEI carrying its capture time and frame ID, read by "
+            "`webrtc-ros-latency-probe` to measure glass-to-glass latency.")
+        ("playout-delay-ms", bpo::value<int>(&args.playout_delay_ms)->default_value(args.playout_delay_ms),
+            "Ask receivers for a playout delay of at most this, via the `playout-delay` RTP header extension. "
+            "0 renders frames as soon as they are decoded, -1 leaves the receiver's jitter buffer alone.")
+        ("abs-capture-time", bpo::value<bool>(&args.abs_capture_time)->default_value(args.abs_capture_time),
+            "Send the camera capture time with the `abs-capture-time` RTP header extension.")
         ("peer-timeout", bpo::value<int>(&args.peer_timeout)->default_value(args.peer_timeout),
             "The connection timeout (in seconds) after receiving a remote offer")
         ("stun-url", bpo::value<std::string>(&args.stun_url)->default_value(args.stun_url),
             "Set the STUN server URL for WebRTC. e.g. `stun:xxx.xxx.xxx`.")
         ("http-port", bpo::value<uint16_t>(&args.http_port)->default_value(args.http_port),
-            "Local HTTP server port to handle signaling when using WHEP.");
+            "Local HTTP server port to handle signaling when using WHEP.")
+        ("record-dir", bpo::value<std::string>(&args.record_dir)->default_value(args.record_dir),
+            "Record the encoded stream, without re-encoding, as fragmented MP4 segments in this directory.")
+        ("record-segment-sec", bpo::value<int>(&args.record_segment_sec)->default_value(args.record_segment_sec),
+            "Start a new recording segment at the first keyframe after this many seconds.")
+        ("record-retention", bpo::value<int>(&args.record_retention)->default_value(args.record_retention),
+            "Keep at most this many recording segments, removing the oldest. 0 keeps all.")
+        ("event-dir", bpo::value<std::string>(&args.event_dir)->default_value(args.event_dir),
+            "Keep a pre-roll of the encoded stream in memory and write event clips, triggered by "
+            "`POST /event?seconds=N`, to this directory.")
+        ("preroll-sec", bpo::value<int>(&args.preroll_sec)->default_value(args.preroll_sec),
+            "Seconds of video held in memory to start event clips with.")
+        ("preroll-mb", bpo::value<int>(&args.preroll_mb)->default_value(args.preroll_mb),
+            "Memory limit of the event pre-roll in MiB, older GOPs are dropped first.")
+        ("export-socket", bpo::value<std::string>(&args.export_socket)->default_value(args.export_socket),
+            "Publish captured I420 frames to shared-memory rings handed out to local readers on this Unix socket.")
+        ("export-slots", bpo::value<int>(&args.export_slots)->default_value(args.export_slots),
+            "Frames each export ring holds, a reader falling further behind loses frames.")
+        ("export-h264", bpo::bool_switch(&args.export_h264)->default_value(args.export_h264),
+            "Export the encoded H.264 frames as well.")
+        ("cpu-affinity", bpo::value<std::vector<std::string>>(&affinity_specs)->composing(),
+            "Pin a stage's threads to CPUs, as `STAGE=CPUS`, e.g. `capture=0`, `encode=1-2`. Stages are "
+            "`capture` (also decodes and encodes a single layer), `encode` (x264 and simulcast threads, whose "
+            "count follows the set), `send` (pacers) and `io` (HTTP and libdatachannel). Repeatable.")
+        ("realtime-priority", bpo::value<std::vector<std::string>>(&priority_specs)->composing(),
+            "Run the `capture` or `send` stage with SCHED_FIFO at this priority (1-99), as `STAGE=PRIO`. "
+            "Needs CAP_SYS_NICE or an RLIMIT_RTPRIO allowance. Repeatable.")
+        ("trace", bpo::bool_switch(&args.trace)->default_value(args.trace),
+            "Record per-frame stage latency, exported via `GET /trace` or SIGUSR1.")
+        ("trace-file", bpo::value<std::string>(&args.trace_file)->default_value(args.trace_file),
+            "The Chrome trace-event JSON file written on SIGUSR1.");
   // clang-format on
 
   bpo::variables_map vm;
@@ -68,7 +178,316 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
     exit(1);
   }
 
-  ParseDevice(args);
+  if (args.simulcast_layers < 1 || args.simulcast_layers > 3) {
+    std::cout << "Simulcast layers should be between 1 and 3" << std::endl;
+    exit(1);
+  }
+
+  if (args.playout_delay_ms < -1 || args.playout_delay_ms > 40950) {
+    std::cout << "Playout delay should be -1 or between 0 and 40950 ms" << std::endl;
+    exit(1);
+  }
+
+  if (args.temporal_layers < 1 || args.temporal_layers > 3) {
+    std::cout << "Temporal layers should be between 1 and 3" << std::endl;
+    exit(1);
+  }
+
+  if (args.temporal_layers > 1) {
+#ifndef HAVE_OPENH264
+    std::cout << "Temporal layers need a build with OpenH264" << std::endl;
+    exit(1);
+#endif
+    if (args.intra_refresh) {
+      std::cout << "Temporal layers and intra refresh can not be combined" << std::endl;
+      exit(1);
+    }
+  }
+
+  if (!args.event_dir.empty() && (args.preroll_sec < 0 || args.preroll_mb < 1)) {
+    std::cout << "Pre-roll seconds should not be negative and its memory limit at least 1 MiB" << std::endl;
+    exit(1);
+  }
+
+  if (args.calibrate_encoder && args.calibration_frames < 1) {
+    std::cout << "Calibration frames should be positive" << std::endl;
+    exit(1);
+  }
+
+  if (args.export_slots < 2 || args.export_slots > 64) {
+    std::cout << "Export slots should be between 2 and 64" << std::endl;
+    exit(1);
+  }
+
+  if (!crop.empty()) {
+    try {
+      args.crop = ParseCropRect(crop);
+    } catch (const std::invalid_argument &e) {
+      std::cout << "Invalid crop \"" << crop << "\", expected `WIDTHxHEIGHT+X+Y` or `WIDTHxHEIGHT`" << std::endl;
+      exit(1);
+    }
+  }
+
+  ParseCodecs(codecs, args);
+  ParseProfiles(profile_specs, args);
+  ParseCameras(camera_specs, args);
+  ParseThreadPolicies(affinity_specs, priority_specs, args);
+  if (args.cameras.empty()) {
+    CheckCodecFeatures(args);
+    ParseDevice(args);
+    CheckTransform(args);
+  }
+}
+
+void Parser::ParseCodecs(const std::string &list, Args &args) {
+  std::vector<std::string> codecs;
+  std::string name;
+  std::stringstream ss(list);
+  while (std::getline(ss, name, ',')) {
+    VideoCodec codec;
+    if (!ParseVideoCodec(name, codec)) {
+      std::cout << "Invalid codec \"" << name << "\", expected `h264`, `vp8`, `vp9` or `av1`" << std::endl;
+      exit(1);
+    }
+    if (std::find(codecs.begin(), codecs.end(), name) == codecs.end()) {
+      codecs.push_back(name);
+    }
+  }
+  if (codecs.empty()) {
+    std::cout << "At least one codec is needed" << std::endl;
+    exit(1);
+  }
+  args.codec = codecs.front();
+  args.fallback_codecs.assign(codecs.begin() + 1, codecs.end());
+}
+
+void Parser::CheckCodecFeatures(const Args &args) {
+  // A fallback without an encoder would only fail once a viewer negotiates it.
+  std::vector<std::string> codecs = {args.codec};
+  codecs.insert(codecs.end(), args.fallback_codecs.begin(), args.fallback_codecs.end());
+  for (const auto &name: codecs) {
+    VideoCodec codec;
+    ParseVideoCodec(name, codec);
+    // OpenH264 encodes H.264 with temporal layers, checked with them.
+    const bool openh264 = codec == VideoCodec::H264 && args.temporal_layers > 1;
+    if (!openh264 && !LibAvEncoder::HasEncoder(codec)) {
+      std::cout << "This libav build has no encoder for `" << name << "`" << std::endl;
+      exit(1);
+    }
+  }
+
+  if (args.codec == "h264") {
+    return;
+  }
+  if (args.temporal_layers > 1 || args.intra_refresh || !args.record_dir.empty() || !args.event_dir.empty() ||
+      args.export_h264 || args.latency_probe) {
+    std::cout << "Temporal layers, intra refresh, recording, event clips, `--export-h264` and the latency probe need "
+              << "the `h264` codec, not `" << args.codec << "`" << std::endl;
+    exit(1);
+  }
+}
+
+void Parser::CheckTransform(const Args &args) {
+  try {
+    FrameTransform::Create(args.width, args.height, args.crop, args.rotation);
+  } catch (const std::invalid_argument &e) {
+    std::cout << "Invalid crop or rotation: " << e.what() << std::endl;
+    exit(1);
+  }
+  // Frames that are not converted here can only be rotated by the camera driver.
+  const bool converted = args.device_type != "shm" && args.format != V4L2_PIX_FMT_H264;
+  if (!converted && (args.crop.width > 0 || (args.device_type == "shm" && args.rotation != 0))) {
+    std::cout << "Crop and software rotation apply while converting to I420, which h264 and shm input skip"
+              << std::endl;
+    exit(1);
+  }
+}
+
+void Parser::ParseProfiles(const std::vector<std::string> &specs, Args &args) {
+  if (specs.empty()) {
+    args.profiles["thumb"] = {320, 240, 200};
+    return;
+  }
+
+  const std::regex spec_regex(R"(^([A-Za-z0-9_-]+)=(\d+)x(\d+)@(\d+)$)");
+  for (const auto &spec: specs) {
+    std::smatch match;
+    if (!std::regex_match(spec, match, spec_regex)) {
+      std::cout << "Invalid profile \"" << spec << "\", expected `name=WIDTHxHEIGHT@KBPS`" << std::endl;
+      exit(1);
+    }
+
+    EncoderProfile profile = {std::stoi(match[2]), std::stoi(match[3]), std::stoi(match[4])};
+    if (profile.width < 16 || profile.height < 16 || profile.width % 2 || profile.height % 2 || profile.bitrate <= 0) {
+      std::cout << "Invalid profile \"" << spec << "\", the size must be even and the bitrate positive" << std::endl;
+      exit(1);
+    }
+    args.profiles[match[1]] = profile;
+  }
+}
+
+void Parser::ParseCameras(const std::vector<std::string> &specs, Args &args) {
+  const std::regex name_regex(R"(^[A-Za-z0-9_-]+$)");
+  for (const auto &spec: specs) {
+    std::vector<std::string> fields;
+    std::string field;
+    std::stringstream ss(spec);
+    while (std::getline(ss, field, ',')) {
+      fields.push_back(field);
+    }
+
+    CameraSpec camera;
+    size_t eq = fields.empty() ? std::string::npos : fields[0].find('=');
+    if (eq != std::string::npos) {
+      camera.name = fields[0].substr(0, eq);
+      camera.camera = fields[0].substr(eq + 1);
+    }
+    if (!std::regex_match(camera.name, name_regex) || camera.camera.find(':') == std::string::npos) {
+      std::cout << "Invalid camera \"" << spec << "\", expected `name=CAMERA[,key=value...]`" << std::endl;
+      exit(1);
+    }
+
+    for (size_t i = 1; i < fields.size(); i++) {
+      eq = fields[i].find('=');
+      std::string key = fields[i].substr(0, eq);
+      std::string value = eq == std::string::npos ? "" : fields[i].substr(eq + 1);
+      try {
+        if (key == "format") {
+          ParseEnum(v4l2_fmt_table, value);
+          camera.v4l2_format = value;
+        } else if (key == "width") {
+          camera.width = std::stoi(value);
+        } else if (key == "height") {
+          camera.height = std::stoi(value);
+        } else if (key == "fps") {
+          camera.fps = std::stoi(value);
+        } else if (key == "bitrate") {
+          camera.bitrate = std::stoi(value);
+        } else if (key == "rotation") {
+          camera.rotation = std::stoi(value);
+        } else if (key == "crop") {
+          camera.crop = ParseCropRect(value);
+        } else if (key == "codec") {
+          VideoCodec codec;
+          if (!ParseVideoCodec(value, codec)) {
+            throw std::invalid_argument("unknown codec");
+          }
+          camera.codec = value;
+        } else {
+          throw std::invalid_argument("unknown key");
+        }
+      } catch (const std::exception &e) {
+        std::cout << "Invalid camera \"" << spec << "\" at `" << fields[i] << "`" << std::endl;
+        exit(1);
+      }
+    }
+
+    if (camera.width.value_or(1) <= 0 || camera.height.value_or(1) <= 0 || camera.fps.value_or(1) <= 0 ||
+        camera.bitrate.value_or(1) <= 0 || camera.rotation.value_or(0) % 90) {
+      std::cout << "Invalid camera \"" << spec << "\", sizes, fps and bitrate must be positive "
+                << "and the rotation a multiple of 90" << std::endl;
+      exit(1);
+    }
+    for (const auto &other: args.cameras) {
+      if (other.name == camera.name) {
+        std::cout << "Camera \"" << camera.name << "\" is added twice" << std::endl;
+        exit(1);
+      }
+    }
+    args.cameras.push_back(camera);
+  }
+}
+
+static ThreadPolicy *StagePolicy(const std::string &stage, Args &args) {
+  if (stage == "capture") {
+    return &args.capture_policy;
+  } else if (stage == "encode") {
+    return &args.encode_policy;
+  } else if (stage == "send") {
+    return &args.send_policy;
+  } else if (stage == "io") {
+    return &args.io_policy;
+  }
+  return nullptr;
+}
+
+void Parser::ParseThreadPolicies(const std::vector<std::string> &affinity_specs,
+                                 const std::vector<std::string> &priority_specs, Args &args) {
+  for (const auto &spec: affinity_specs) {
+    size_t eq = spec.find('=');
+    ThreadPolicy *policy = eq == std::string::npos ? nullptr : StagePolicy(spec.substr(0, eq), args);
+    try {
+      if (!policy) {
+        throw std::invalid_argument("unknown stage");
+      }
+      policy->cpus = ParseCpuList(spec.substr(eq + 1));
+    } catch (const std::exception &e) {
+      std::cout << "Invalid CPU affinity \"" << spec << "\", expected `STAGE=CPUS` with a stage of "
+                << "capture, encode, send or io" << std::endl;
+      exit(1);
+    }
+  }
+
+  const std::regex priority_regex(R"(^(capture|send)=(\d{1,2})$)");
+  for (const auto &spec: priority_specs) {
+    std::smatch match;
+    if (!std::regex_match(spec, match, priority_regex) || std::stoi(match[2]) < 1) {
+      std::cout << "Invalid realtime priority \"" << spec << "\", expected `capture=PRIO` or `send=PRIO` "
+                << "with a priority between 1 and 99" << std::endl;
+      exit(1);
+    }
+    StagePolicy(match[1], args)->priority = std::stoi(match[2]);
+  }
+}
+
+std::vector<Args> Parser::CameraArgs(const Args &args) {
+  if (args.cameras.empty()) {
+    return {args};
+  }
+
+  // x264 starts a thread per core when left to pick, which for several cameras
+  // means several times as many threads as cores contending for them.
+  int encoder_threads = args.encoder_threads;
+  if (encoder_threads == 0) {
+    int cores = args.encode_policy.cpus.empty() ? static_cast<int>(std::thread::hardware_concurrency())
+                                                : static_cast<int>(args.encode_policy.cpus.size());
+    encoder_threads = std::max(1, cores / static_cast<int>(args.cameras.size()));
+  }
+
+  std::vector<Args> pipelines;
+  for (const auto &spec: args.cameras) {
+    Args camera_args = args;
+    camera_args.cameras.clear();
+    camera_args.camera_name = spec.name;
+    camera_args.camera = spec.camera;
+    camera_args.v4l2_format = spec.v4l2_format.value_or(args.v4l2_format);
+    camera_args.width = spec.width.value_or(args.width);
+    camera_args.height = spec.height.value_or(args.height);
+    camera_args.fps = spec.fps.value_or(args.fps);
+    camera_args.rotation = spec.rotation.value_or(args.rotation);
+    camera_args.crop = spec.crop.value_or(args.crop);
+    camera_args.bitrate = spec.bitrate.value_or(args.bitrate);
+    camera_args.codec = spec.codec.value_or(args.codec);
+    auto &fallbacks = camera_args.fallback_codecs;
+    fallbacks.erase(std::remove(fallbacks.begin(), fallbacks.end(), camera_args.codec), fallbacks.end());
+    camera_args.encoder_threads = encoder_threads;
+    // Outputs on the filesystem are split per camera.
+    if (!args.record_dir.empty()) {
+      camera_args.record_dir = args.record_dir + "/" + spec.name;
+    }
+    if (!args.event_dir.empty()) {
+      camera_args.event_dir = args.event_dir + "/" + spec.name;
+    }
+    if (!args.export_socket.empty()) {
+      camera_args.export_socket = args.export_socket + "." + spec.name;
+    }
+    std::cout << "Camera " << spec.name << ":" << std::endl;
+    CheckCodecFeatures(camera_args);
+    ParseDevice(camera_args);
+    CheckTransform(camera_args);
+    pipelines.push_back(camera_args);
+  }
+  return pipelines;
 }
 
 void Parser::ParseDevice(Args &args) {
@@ -79,6 +498,13 @@ void Parser::ParseDevice(Args &args) {
 
   std::string prefix = args.camera.substr(0, pos);
   std::string id = args.camera.substr(pos + 1);
+  args.device_type = prefix;
+
+  if (prefix == "shm") {
+    args.shm_socket = id;
+    std::cout << "Using shared-memory input, socket: " << id << std::endl;
+    return;
+  }
 
   try {
     args.cameraId = std::stoi(id);
@@ -90,6 +516,9 @@ void Parser::ParseDevice(Args &args) {
     args.format = ParseEnum(v4l2_fmt_table, args.v4l2_format);
     std::cout << "Using V4L2, ID: " << args.cameraId << std::endl;
     std::cout << "Using V4L2, format: " << args.v4l2_format << std::endl;
+  } else if (prefix == "synthetic") {
+    args.format = ParseEnum(v4l2_fmt_table, args.v4l2_format);
+    std::cout << "Using synthetic source, format: " << args.v4l2_format << std::endl;
   } else {
     throw std::runtime_error("Unknown device format: " + prefix);
   }
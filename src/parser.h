@@ -1,12 +1,27 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
+#include <string>
+#include <vector>
+
 #include "args.h"
 
 class Parser {
   public:
     static void ParseArgs(int argc, char *argv[], Args &args);
     static void ParseDevice(Args &args);
+    static void ParseCodecs(const std::string &list, Args &args);
+    // Exits when libav has no encoder for a codec of `args`, or a feature of `args`
+    // needs an H.264 encoder and its codec is another.
+    static void CheckCodecFeatures(const Args &args);
+    // Exits when the crop or rotation of `args` does not fit its frames or input.
+    static void CheckTransform(const Args &args);
+    static void ParseProfiles(const std::vector<std::string> &specs, Args &args);
+    static void ParseCameras(const std::vector<std::string> &specs, Args &args);
+    static void ParseThreadPolicies(const std::vector<std::string> &affinity_specs,
+                                    const std::vector<std::string> &priority_specs, Args &args);
+    // One Args per capture pipeline, `args` itself unless `--add-camera` was given.
+    static std::vector<Args> CameraArgs(const Args &args);
 };
 
 #endif // PARSER_H_
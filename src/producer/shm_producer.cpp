@@ -0,0 +1,121 @@
+#include "producer/shm_producer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Rows start on cache lines, as the converters and the encoder read them fastest.
+static const int kRowAlignment = 64;
+
+static int AlignUp(int value) { return (value + kRowAlignment - 1) / kRowAlignment * kRowAlignment; }
+
+ShmProducer::ShmProducer(const std::string &socket_path, uint32_t pixel_format, int width, int height, int slots) :
+    pixel_format_(pixel_format), width_(width), height_(height), plane_count_(0), strides_{}, offsets_{},
+    frame_size_(0), sock_(-1), event_fd_(-1), next_frame_id_(0) {
+  if (width <= 0 || height <= 0) {
+    throw std::runtime_error("shm producer: invalid size");
+  }
+  const int chroma_width = (width + 1) / 2;
+  if (pixel_format == V4L2_PIX_FMT_YUV420) {
+    plane_count_ = 3;
+    strides_[0] = AlignUp(width);
+    strides_[1] = strides_[2] = AlignUp(chroma_width);
+  } else if (pixel_format == V4L2_PIX_FMT_NV12) {
+    plane_count_ = 2;
+    strides_[0] = AlignUp(width);
+    strides_[1] = AlignUp(chroma_width * 2);
+  } else if (pixel_format == V4L2_PIX_FMT_YUYV) {
+    plane_count_ = 1;
+    strides_[0] = AlignUp(chroma_width * 4);
+  } else {
+    throw std::runtime_error("shm producer: unsupported pixel format");
+  }
+  for (int i = 0; i < plane_count_; i++) {
+    offsets_[i] = frame_size_;
+    frame_size_ += static_cast<size_t>(strides_[i]) * PlaneRows(i);
+  }
+
+  ring_ = std::make_unique<ShmRingWriter>("webrtc-ros-input", ShmFrameFormat::Raw, slots, frame_size_, true);
+
+  sock_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  if (sock_ < 0 || connect(sock_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    std::string error = strerror(errno);
+    if (sock_ >= 0) {
+      close(sock_);
+    }
+    throw std::runtime_error("shm producer: cannot connect to " + socket_path + ": " + error);
+  }
+  event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (event_fd_ < 0 || !SendRings(sock_, {ring_->fd()}, event_fd_)) {
+    std::string error = strerror(errno);
+    close(sock_);
+    if (event_fd_ >= 0) {
+      close(event_fd_);
+    }
+    throw std::runtime_error("shm producer: cannot hand the ring to " + socket_path + ": " + error);
+  }
+}
+
+ShmProducer::~ShmProducer() {
+  close(sock_);
+  close(event_fd_);
+}
+
+int ShmProducer::PlaneRows(int plane) const { return plane == 0 ? height_ : (height_ + 1) / 2; }
+
+bool ShmProducer::Send(const Plane *planes, int64_t capture_us) {
+  uint8_t *dst = Begin();
+  if (!dst) {
+    return false;
+  }
+  for (int i = 0; i < plane_count_; i++) {
+    const size_t row_bytes = std::min(strides_[i], planes[i].stride);
+    for (int row = 0; row < PlaneRows(i); row++) {
+      memcpy(dst + offsets_[i] + static_cast<size_t>(row) * strides_[i],
+             planes[i].data + static_cast<size_t>(row) * planes[i].stride, row_bytes);
+    }
+  }
+  Commit(capture_us);
+  return true;
+}
+
+uint8_t *ShmProducer::Begin() { return ring_->Begin(frame_size_); }
+
+void ShmProducer::Commit(int64_t capture_us) {
+  ShmFrameMeta meta{};
+  meta.capture_us = capture_us;
+  meta.frame_id = next_frame_id_++;
+  meta.size = frame_size_;
+  meta.flags = kShmFrameKey;
+  meta.pixel_format = pixel_format_;
+  meta.width = width_;
+  meta.height = height_;
+  meta.stride_y = strides_[0];
+  meta.stride_u = strides_[1];
+  meta.stride_v = strides_[2];
+  ring_->Commit(meta);
+
+  // Only fails once the counter would overflow, when the server has plenty of wakeups pending.
+  uint64_t one = 1;
+  [[maybe_unused]] ssize_t written = write(event_fd_, &one, sizeof(one));
+}
+
+int ShmProducer::plane_count() const { return plane_count_; }
+
+int ShmProducer::stride(int plane) const { return strides_[plane]; }
+
+size_t ShmProducer::offset(int plane) const { return offsets_[plane]; }
+
+bool ShmProducer::connected() const {
+  pollfd pfd = {sock_, POLLIN, 0};
+  return poll(&pfd, 1, 0) == 0;
+}
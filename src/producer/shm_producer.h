@@ -0,0 +1,68 @@
+#ifndef SHM_PRODUCER_H_
+#define SHM_PRODUCER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "common/shm_frame_ring.h"
+
+/*
+ * Feeds raw frames from another process into a server started with
+ * `--camera shm:<socket>`. The producer owns a shared-memory ring which it
+ * hands to the server on connecting; frames are written into a free slot and
+ * announced on an eventfd. The server encodes I420 frames straight out of the
+ * slot, which it holds meanwhile, so a frame is dropped rather than waited for
+ * when every slot is still in use. Only depends on libc, for linking into ROS
+ * nodes as the `webrtc-ros-producer` library.
+ */
+class ShmProducer {
+public:
+  struct Plane {
+    const uint8_t *data;
+    int stride;
+  };
+
+  // Connects and hands over a ring of `slots` frames of `width`x`height` in `pixel_format`,
+  // one of V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12 and V4L2_PIX_FMT_YUYV. Throws
+  // std::runtime_error if the server can not be reached.
+  ShmProducer(const std::string &socket_path, uint32_t pixel_format, int width, int height, int slots = 4);
+  ~ShmProducer();
+
+  ShmProducer(const ShmProducer &) = delete;
+  ShmProducer &operator=(const ShmProducer &) = delete;
+
+  // Copies a frame in, with as many planes as the format has, each with its own stride.
+  // Returns false if the frame was dropped because every slot is in use.
+  bool Send(const Plane *planes, int64_t capture_us);
+
+  // Renders a frame in place instead: Begin() returns the slot's first plane, laid out with
+  // stride(i) bytes per row of plane i, or nullptr if every slot is in use. Commit() publishes it.
+  uint8_t *Begin();
+  void Commit(int64_t capture_us);
+  int plane_count() const;
+  int stride(int plane) const;
+  // The offset of plane `plane` from what Begin() returned.
+  size_t offset(int plane) const;
+
+  // False once the server has gone away.
+  bool connected() const;
+
+private:
+  int PlaneRows(int plane) const;
+
+  const uint32_t pixel_format_;
+  const int width_;
+  const int height_;
+  int plane_count_;
+  int strides_[3];
+  size_t offsets_[3];
+  size_t frame_size_;
+
+  int sock_;
+  int event_fd_;
+  std::unique_ptr<ShmRingWriter> ring_;
+  uint64_t next_frame_id_;
+};
+
+#endif // SHM_PRODUCER_H_
@@ -0,0 +1,179 @@
+#include "recorder/event_recorder.h"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <stdexcept>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// Live frames queued behind a slow disk, on top of the pre-roll the queue shares with the ring.
+static const size_t kMaxLiveQueueBytes = 64 << 20;
+
+std::shared_ptr<EventRecorder> EventRecorder::Create(std::shared_ptr<Encoder> encoder, Args args) {
+  auto ptr = std::make_shared<EventRecorder>(std::move(encoder), args);
+  ptr->Subscribe();
+  return ptr;
+}
+
+EventRecorder::EventRecorder(std::shared_ptr<Encoder> encoder, Args args) :
+    dir_(args.event_dir), metric_labels_(Metrics::WithLabel("", "camera", args.camera_name)),
+    encoder_(std::move(encoder)),
+    ring_(static_cast<int64_t>(args.preroll_sec) * 1000000, static_cast<size_t>(args.preroll_mb) << 20),
+    running_(true), recording_(false), end_us_(0), last_capture_us_(0), live_bytes_(0), waiting_keyframe_(false),
+    writer_(args.fps, metric_labels_), discarding_(false) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  if (ec) {
+    ERROR_PRINT("event recorder: cannot create %s: %s", dir_.c_str(), ec.message().c_str());
+  }
+  worker_ = std::thread([this]() { Run(); });
+}
+
+EventRecorder::~EventRecorder() {
+  observer_.reset();
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  writer_.Close();
+  Metrics::Instance().Remove("webrtc_event_preroll_bytes" + metric_labels_);
+}
+
+void EventRecorder::Subscribe() {
+  observer_ = encoder_->AsFrameBufferObservable();
+  observer_->Subscribe([this](std::shared_ptr<EncodedFrameBuffer> frame) { OnFrame(std::move(frame)); });
+}
+
+void EventRecorder::OnFrame(std::shared_ptr<EncodedFrameBuffer> frame) {
+  if (!frame->isOwned()) {
+    return;
+  }
+  {
+    // The ring is fed under the same lock Trigger() snapshots it with, so every frame lands
+    // either in the pre-roll or in the live part of an event, never both.
+    std::lock_guard<std::mutex> lock(mtx_);
+    ring_.Push(frame);
+    last_capture_us_ = frame->capture_time_us();
+    if (ring_.NeedsIdr()) {
+      encoder_->ForceIdr();
+    }
+    if (frame->isKeyFrame()) {
+      Metrics::Instance().SetGauge("webrtc_event_preroll_bytes" + metric_labels_, ring_.bytes());
+    }
+    if (!recording_) {
+      return;
+    }
+
+    if (waiting_keyframe_ && !frame->isKeyFrame()) {
+      Metrics::Instance().AddCounter("webrtc_event_frames_dropped_total" + metric_labels_);
+    } else if (live_bytes_ + frame->size() > kMaxLiveQueueBytes) {
+      Metrics::Instance().AddCounter("webrtc_event_frames_dropped_total" + metric_labels_);
+      waiting_keyframe_ = true;
+    } else {
+      waiting_keyframe_ = false;
+      live_bytes_ += frame->size();
+      queue_.push_back({frame, ""});
+    }
+    if (frame->capture_time_us() >= end_us_) {
+      recording_ = false;
+      queue_.push_back({nullptr, ""});
+    }
+  }
+  cv_.notify_one();
+}
+
+EventRecorder::Event EventRecorder::Trigger(int post_sec) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  const int64_t end_us = last_capture_us_ + static_cast<int64_t>(post_sec) * 1000000;
+  if (recording_) {
+    end_us_ = std::max(end_us_, end_us);
+    return {path_, 0, false};
+  }
+
+  auto preroll = ring_.Snapshot();
+  if (preroll.empty()) {
+    throw std::runtime_error("no IDR buffered yet");
+  }
+  path_ = NextPath();
+  end_us_ = end_us;
+  recording_ = true;
+  waiting_keyframe_ = false;
+  for (size_t i = 0; i < preroll.size(); i++) {
+    queue_.push_back({std::move(preroll[i]), i == 0 ? path_ : ""});
+  }
+  cv_.notify_one();
+
+  INFO_PRINT("event recorder: recording %s with %zu frames of pre-roll", path_.c_str(), preroll.size());
+  Metrics::Instance().AddCounter("webrtc_event_recordings_total" + metric_labels_);
+  return {path_, preroll.size(), true};
+}
+
+std::string EventRecorder::NextPath() const {
+  char name[64];
+  std::time_t now = std::time(nullptr);
+  std::tm tm;
+  localtime_r(&now, &tm);
+  std::strftime(name, sizeof(name), "%Y%m%d-%H%M%S", &tm);
+  std::string path = dir_ + "/event-" + name + ".mp4";
+  // Two events within a second, the second one keeps its own file.
+  for (int i = 2; std::filesystem::exists(path) || path == path_; i++) {
+    path = dir_ + "/event-" + name + "-" + std::to_string(i) + ".mp4";
+  }
+  return path;
+}
+
+void EventRecorder::Run() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (running_) {
+    cv_.wait(lock, [this]() { return !running_ || !queue_.empty(); });
+    std::deque<Entry> batch;
+    batch.swap(queue_);
+    live_bytes_ = 0;
+    lock.unlock();
+
+    for (const auto &entry: batch) {
+      Write(entry);
+    }
+
+    lock.lock();
+  }
+}
+
+void EventRecorder::Write(const Entry &entry) {
+  if (!entry.frame) {
+    if (writer_.isOpen()) {
+      INFO_PRINT("event recorder: finished %s", writer_.path().c_str());
+    }
+    writer_.Close();
+    discarding_ = false;
+    return;
+  }
+
+  if (!entry.open_path.empty()) {
+    const EncoderSettings settings = encoder_->settings();
+    try {
+      writer_.Open(entry.open_path, *entry.frame, settings.width, settings.height);
+    } catch (const std::runtime_error &e) {
+      ERROR_PRINT("%s", e.what());
+      discarding_ = true;
+      return;
+    }
+  }
+  if (discarding_ || !writer_.isOpen()) {
+    return;
+  }
+  if (entry.frame->isKeyFrame() && !writer_.SameParameterSets(*entry.frame)) {
+    // The stream was reconfigured mid-event; the file's codec setup no longer fits it.
+    ERROR_PRINT("event recorder: stream parameters changed, ending %s early", writer_.path().c_str());
+    writer_.Close();
+    discarding_ = true;
+    return;
+  }
+  writer_.Write(*entry.frame);
+}
@@ -0,0 +1,79 @@
+#ifndef EVENT_RECORDER_H_
+#define EVENT_RECORDER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "args.h"
+#include "common/interface/subject.h"
+#include "encoder/encoder.hpp"
+#include "recorder/frame_ring.h"
+#include "recorder/mp4_writer.h"
+
+/*
+ * Keeps the last seconds of the encoder's output in a FrameRing and, when an
+ * event is triggered, writes that pre-roll followed by the live stream into one
+ * MP4 file. Frames are passed by reference from the ring and the encoder to a
+ * writer thread, so the encoder never waits on the disk and the pre-roll costs
+ * no more memory than the ring's byte limit.
+ */
+class EventRecorder {
+public:
+  struct Event {
+    std::string path;
+    size_t preroll_frames;
+    // False if the trigger only moved out the end of an event already being recorded.
+    bool started;
+  };
+
+  static std::shared_ptr<EventRecorder> Create(std::shared_ptr<Encoder> encoder, Args args);
+
+  EventRecorder(std::shared_ptr<Encoder> encoder, Args args);
+  ~EventRecorder();
+
+  // Records the pre-roll and then `post_sec` seconds of live video. Throws std::runtime_error
+  // while the ring holds no IDR yet.
+  Event Trigger(int post_sec);
+
+private:
+  // A frame for the writer thread. `open_path` is set on the first frame of an event and a
+  // null `frame` ends the event.
+  struct Entry {
+    std::shared_ptr<EncodedFrameBuffer> frame;
+    std::string open_path;
+  };
+
+  void Subscribe();
+  void OnFrame(std::shared_ptr<EncodedFrameBuffer> frame);
+  void Run();
+  void Write(const Entry &entry);
+  std::string NextPath() const;
+
+  const std::string dir_;
+  const std::string metric_labels_;
+  std::shared_ptr<Encoder> encoder_;
+  std::shared_ptr<Observable<std::shared_ptr<EncodedFrameBuffer>>> observer_;
+  FrameRing ring_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool running_;
+  bool recording_;
+  int64_t end_us_;
+  int64_t last_capture_us_;
+  std::string path_;
+  std::deque<Entry> queue_;
+  size_t live_bytes_;
+  bool waiting_keyframe_;
+
+  // Only touched by the worker thread.
+  Mp4Writer writer_;
+  bool discarding_;
+  std::thread worker_;
+};
+
+#endif // EVENT_RECORDER_H_
@@ -0,0 +1,50 @@
+#include "recorder/frame_ring.h"
+
+FrameRing::FrameRing(int64_t max_duration_us, size_t max_bytes) :
+    max_duration_us_(max_duration_us), max_bytes_(max_bytes), bytes_(0), newest_idr_us_(0) {}
+
+void FrameRing::Push(std::shared_ptr<EncodedFrameBuffer> frame) {
+  // A borrowed buffer goes away after delivery, and a ring not starting at an IDR is useless.
+  if (!frame->isOwned()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (frames_.empty() && !frame->isIdr()) {
+    return;
+  }
+  if (frame->isIdr()) {
+    newest_idr_us_ = frame->capture_time_us();
+  }
+
+  bytes_ += frame->size();
+  frames_.push_back(std::move(frame));
+  auto over_limit = [this]() {
+    const int64_t duration_us = frames_.back()->capture_time_us() - frames_.front()->capture_time_us();
+    return bytes_ > max_bytes_ || duration_us > max_duration_us_;
+  };
+  while (!frames_.empty() && over_limit()) {
+    DropOldestGop();
+  }
+}
+
+void FrameRing::DropOldestGop() {
+  do {
+    bytes_ -= frames_.front()->size();
+    frames_.pop_front();
+  } while (!frames_.empty() && !frames_.front()->isIdr());
+}
+
+bool FrameRing::NeedsIdr() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return frames_.empty() || frames_.back()->capture_time_us() - newest_idr_us_ > max_duration_us_ / 2;
+}
+
+std::vector<std::shared_ptr<EncodedFrameBuffer>> FrameRing::Snapshot() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return {frames_.begin(), frames_.end()};
+}
+
+size_t FrameRing::bytes() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return bytes_;
+}
@@ -0,0 +1,45 @@
+#ifndef FRAME_RING_H_
+#define FRAME_RING_H_
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common/encoded_frame_buffer.h"
+
+/*
+ * The last few seconds of encoded frames, held by reference so nothing is
+ * copied. The ring always starts at an IDR, where a clip can be opened: whole
+ * GOPs are dropped from the front once the ring spans more than
+ * `max_duration_us` or holds more than `max_bytes`, so its memory never
+ * exceeds `max_bytes` plus one frame. Intra-refresh recovery points do not
+ * count as GOP starts, they carry no SPS/PPS.
+ */
+class FrameRing {
+public:
+  FrameRing(int64_t max_duration_us, size_t max_bytes);
+
+  void Push(std::shared_ptr<EncodedFrameBuffer> frame);
+  // The frames from the oldest IDR on, oldest first.
+  std::vector<std::shared_ptr<EncodedFrameBuffer>> Snapshot() const;
+  // Whether the newest IDR is over half the ring's duration old, so the next drop
+  // would leave little pre-roll. Only happens without periodic IDRs, e.g. with intra refresh.
+  bool NeedsIdr() const;
+
+  size_t bytes() const;
+
+private:
+  void DropOldestGop();
+
+  const int64_t max_duration_us_;
+  const size_t max_bytes_;
+
+  mutable std::mutex mtx_;
+  std::deque<std::shared_ptr<EncodedFrameBuffer>> frames_;
+  size_t bytes_;
+  int64_t newest_idr_us_;
+};
+
+#endif // FRAME_RING_H_
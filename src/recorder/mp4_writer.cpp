@@ -0,0 +1,211 @@
+#include "recorder/mp4_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// Big enough that a GOP at a few Mbps is one or two writes.
+static const size_t kChunkSize = 1 << 20;
+static const size_t kChunkAlignment = 4096;
+// The muxer's own buffer, it hands its output to OnWrite in pieces of this size.
+static const int kAvioBufferSize = 64 * 1024;
+static const AVRational kMicroseconds = {1, 1000000};
+
+// Collects the SPS and PPS of an Annex B access unit, start codes included.
+static std::vector<uint8_t> ParameterSets(const uint8_t *data, size_t size) {
+  std::vector<uint8_t> sets;
+  size_t i = 0;
+  while (i + 3 < size) {
+    if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+      i++;
+      continue;
+    }
+    const size_t begin = i + 3;
+    size_t end = begin;
+    while (end + 2 < size && !(data[end] == 0 && data[end + 1] == 0 && (data[end + 2] == 1 || data[end + 2] == 0))) {
+      end++;
+    }
+    if (end + 2 >= size) {
+      end = size;
+    }
+    const int nal_type = data[begin] & 0x1f;
+    if (nal_type == 7 || nal_type == 8) {
+      sets.insert(sets.end(), {0, 0, 0, 1});
+      sets.insert(sets.end(), data + begin, data + end);
+    }
+    i = end;
+  }
+  return sets;
+}
+
+Mp4Writer::Mp4Writer(int fps, std::string metric_labels) :
+    frame_us_(1000000 / std::max(fps, 1)), metric_labels_(std::move(metric_labels)), fd_(-1), fmt_ctx_(nullptr),
+    avio_(nullptr), pkt_(av_packet_alloc()),
+    chunk_(static_cast<uint8_t *>(boost::alignment::aligned_alloc(kChunkAlignment, kChunkSize)), BoostAlignedFree{}),
+    chunk_used_(0), start_us_(0), last_dts_(0) {}
+
+Mp4Writer::~Mp4Writer() {
+  Close();
+  av_packet_free(&pkt_);
+}
+
+bool Mp4Writer::isOpen() const { return fmt_ctx_ != nullptr; }
+
+bool Mp4Writer::SameParameterSets(const EncodedFrameBuffer &keyframe) const {
+  auto sets = ParameterSets(keyframe.data(), keyframe.size());
+  return sets.empty() || sets == parameter_sets_;
+}
+
+const std::string &Mp4Writer::path() const { return path_; }
+
+int64_t Mp4Writer::start_us() const { return start_us_; }
+
+void Mp4Writer::Open(const std::string &path, const EncodedFrameBuffer &keyframe, int width, int height) {
+  Close();
+  // Without SPS/PPS the muxer writes an empty avcC and the file does not play.
+  parameter_sets_ = ParameterSets(keyframe.data(), keyframe.size());
+  if (parameter_sets_.empty()) {
+    throw std::runtime_error("recorder: " + path + " would start on a frame without SPS/PPS");
+  }
+
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("recorder: cannot create " + path + ": " + strerror(errno));
+  }
+  path_ = path;
+
+  avformat_alloc_output_context2(&fmt_ctx_, nullptr, "mp4", nullptr);
+  if (!fmt_ctx_) {
+    Close();
+    throw std::runtime_error("recorder: cannot allocate mp4 muxer");
+  }
+
+  auto *avio_buffer = static_cast<unsigned char *>(av_malloc(kAvioBufferSize));
+  avio_ = avio_alloc_context(avio_buffer, kAvioBufferSize, 1, this, nullptr, &Mp4Writer::OnWrite, nullptr);
+  fmt_ctx_->pb = avio_;
+
+  AVStream *stream = avformat_new_stream(fmt_ctx_, nullptr);
+  stream->time_base = kMicroseconds;
+  stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+  stream->codecpar->codec_id = AV_CODEC_ID_H264;
+  stream->codecpar->width = width;
+  stream->codecpar->height = height;
+  // Annex B extradata, the muxer turns it into avcC and converts the packets to match.
+  stream->codecpar->extradata =
+          static_cast<uint8_t *>(av_mallocz(parameter_sets_.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+  std::copy(parameter_sets_.begin(), parameter_sets_.end(), stream->codecpar->extradata);
+  stream->codecpar->extradata_size = static_cast<int>(parameter_sets_.size());
+
+  // An empty moov up front and a fragment per keyframe: the file is playable up to the
+  // last complete fragment even if the process dies mid-segment.
+  AVDictionary *options = nullptr;
+  av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+  int ret = avformat_write_header(fmt_ctx_, &options);
+  av_dict_free(&options);
+  if (ret < 0) {
+    Close();
+    throw std::runtime_error("recorder: cannot write mp4 header: " + std::to_string(ret));
+  }
+
+  start_us_ = keyframe.capture_time_us();
+  last_dts_ = -1;
+}
+
+void Mp4Writer::Write(const EncodedFrameBuffer &frame) {
+  if (!fmt_ctx_) {
+    return;
+  }
+
+  const int64_t pts = frame.capture_time_us() - start_us_;
+  if (pts < 0) {
+    return; // a B-frame displayed before the keyframe the file starts with
+  }
+  // The encoder's decode time, nudged forward should two frames share one; a frame is never dropped for it.
+  const int64_t dts = std::max(frame.decode_time_us() - start_us_, last_dts_ + 1);
+  last_dts_ = dts;
+
+  pkt_->data = const_cast<uint8_t *>(frame.data());
+  pkt_->size = static_cast<int>(frame.size());
+  pkt_->pts = std::max(pts, dts);
+  pkt_->dts = dts;
+  pkt_->duration = frame_us_;
+  pkt_->flags = frame.isKeyFrame() ? AV_PKT_FLAG_KEY : 0;
+  pkt_->stream_index = 0;
+  int ret = av_write_frame(fmt_ctx_, pkt_);
+  pkt_->data = nullptr;
+  pkt_->size = 0;
+  if (ret < 0) {
+    ERROR_PRINT("recorder: failed to write a frame to %s: %d", path_.c_str(), ret);
+  }
+
+  if (frame.isKeyFrame()) {
+    // One batched write per GOP bounds what a crash can lose.
+    avio_flush(avio_);
+    FlushChunk();
+  }
+}
+
+void Mp4Writer::Close() {
+  if (fmt_ctx_) {
+    if (avio_) {
+      av_write_trailer(fmt_ctx_);
+      avio_flush(avio_);
+    }
+    avformat_free_context(fmt_ctx_);
+    fmt_ctx_ = nullptr;
+  }
+  if (avio_) {
+    av_free(avio_->buffer);
+    avio_context_free(&avio_);
+  }
+  if (fd_ >= 0) {
+    FlushChunk();
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int Mp4Writer::OnWrite(void *opaque, const uint8_t *buf, int size) {
+#else
+int Mp4Writer::OnWrite(void *opaque, uint8_t *buf, int size) {
+#endif
+  static_cast<Mp4Writer *>(opaque)->Append(buf, size);
+  return size;
+}
+
+void Mp4Writer::Append(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    const size_t n = std::min(size, kChunkSize - chunk_used_);
+    std::memcpy(chunk_.get() + chunk_used_, data, n);
+    chunk_used_ += n;
+    data += n;
+    size -= n;
+    if (chunk_used_ == kChunkSize) {
+      FlushChunk();
+    }
+  }
+}
+
+void Mp4Writer::FlushChunk() {
+  size_t written = 0;
+  while (written < chunk_used_ && fd_ >= 0) {
+    ssize_t n = ::write(fd_, chunk_.get() + written, chunk_used_ - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      ERROR_PRINT("recorder: write to %s failed: %s", path_.c_str(), strerror(errno));
+      break;
+    }
+    written += n;
+  }
+  Metrics::Instance().AddCounter("webrtc_recorder_bytes_written_total" + metric_labels_, written);
+  chunk_used_ = 0;
+}
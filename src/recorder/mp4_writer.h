@@ -0,0 +1,73 @@
+#ifndef MP4_WRITER_H_
+#define MP4_WRITER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+#include "common/encoded_frame_buffer.h"
+#include "common/v4l2_frame_buffer.h"
+
+/*
+ * Muxes encoded H.264 access units into one fragmented MP4 file without
+ * transcoding, starting a fragment at every keyframe. The muxer's output is
+ * gathered in large page-aligned chunks which are written to the file whole,
+ * so the disk sees a few big writes per GOP instead of one per box. Not
+ * thread-safe; meant to be driven by a single writer thread.
+ */
+class Mp4Writer {
+public:
+  // `metric_labels` are the owner's, added to the bytes written.
+  Mp4Writer(int fps, std::string metric_labels);
+  ~Mp4Writer();
+
+  Mp4Writer(const Mp4Writer &) = delete;
+  Mp4Writer &operator=(const Mp4Writer &) = delete;
+
+  // Starts a new file whose codec configuration comes from the SPS/PPS of `keyframe`.
+  // Throws std::runtime_error if `keyframe` has no SPS/PPS or the file can not be created;
+  // an existing file is never overwritten.
+  void Open(const std::string &path, const EncodedFrameBuffer &keyframe, int width, int height);
+  void Write(const EncodedFrameBuffer &frame);
+  // Writes the last fragment and closes the file, safe to call when nothing is open.
+  void Close();
+
+  bool isOpen() const;
+  // Whether `keyframe` carries the SPS/PPS the file was opened with; a new one needs a new file.
+  bool SameParameterSets(const EncodedFrameBuffer &keyframe) const;
+  const std::string &path() const;
+  // Capture time of the first frame of the file, CLOCK_MONOTONIC microseconds.
+  int64_t start_us() const;
+
+private:
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+  static int OnWrite(void *opaque, const uint8_t *buf, int size);
+#else
+  static int OnWrite(void *opaque, uint8_t *buf, int size);
+#endif
+  void Append(const uint8_t *data, size_t size);
+  void FlushChunk();
+
+  const int64_t frame_us_;
+  const std::string metric_labels_;
+
+  std::string path_;
+  std::vector<uint8_t> parameter_sets_;
+  int fd_;
+  AVFormatContext *fmt_ctx_;
+  AVIOContext *avio_;
+  AVPacket *pkt_;
+
+  std::unique_ptr<uint8_t, BoostAlignedFree> chunk_;
+  size_t chunk_used_;
+
+  int64_t start_us_;
+  int64_t last_dts_;
+};
+
+#endif // MP4_WRITER_H_
@@ -0,0 +1,167 @@
+#include "recorder/recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <vector>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// Well beyond any GOP, reached only when the disk has stopped keeping up.
+static const size_t kMaxQueueBytes = 64 << 20;
+static const char *kSegmentPrefix = "segment-";
+static const char *kSegmentSuffix = ".mp4";
+
+std::shared_ptr<Recorder> Recorder::Create(std::shared_ptr<Encoder> encoder, Args args) {
+  auto ptr = std::make_shared<Recorder>(std::move(encoder), args);
+  ptr->Subscribe();
+  return ptr;
+}
+
+Recorder::Recorder(std::shared_ptr<Encoder> encoder, Args args) :
+    dir_(args.record_dir), segment_us_(static_cast<int64_t>(args.record_segment_sec) * 1000000),
+    retention_(args.record_retention), metric_labels_(Metrics::WithLabel("", "camera", args.camera_name)),
+    encoder_(std::move(encoder)), running_(true), queue_bytes_(0), waiting_keyframe_(true),
+    writer_(args.fps, metric_labels_), idr_requested_(false) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  if (ec) {
+    ERROR_PRINT("recorder: cannot create %s: %s", dir_.c_str(), ec.message().c_str());
+  }
+  worker_ = std::thread([this]() { Run(); });
+}
+
+Recorder::~Recorder() {
+  observer_.reset();
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  writer_.Close();
+  Metrics::Instance().Remove("webrtc_recorder_queue_bytes" + metric_labels_);
+}
+
+void Recorder::Subscribe() {
+  observer_ = encoder_->AsFrameBufferObservable();
+  observer_->Subscribe([this](std::shared_ptr<EncodedFrameBuffer> frame) { OnFrame(std::move(frame)); });
+}
+
+void Recorder::OnFrame(std::shared_ptr<EncodedFrameBuffer> frame) {
+  if (!frame->isOwned()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (waiting_keyframe_ && !frame->isKeyFrame()) {
+      return;
+    }
+    if (queue_bytes_ + frame->size() > kMaxQueueBytes) {
+      // Whatever follows depends on this frame, so skip to the next keyframe.
+      Metrics::Instance().AddCounter("webrtc_recorder_frames_dropped_total" + metric_labels_);
+      waiting_keyframe_ = true;
+      return;
+    }
+    waiting_keyframe_ = false;
+    queue_bytes_ += frame->size();
+    queue_.push_back(std::move(frame));
+  }
+  cv_.notify_one();
+}
+
+void Recorder::Run() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (running_) {
+    cv_.wait(lock, [this]() { return !running_ || !queue_.empty(); });
+    // Take everything queued at once, the encoder keeps queueing while this batch is written.
+    std::deque<std::shared_ptr<EncodedFrameBuffer>> batch;
+    batch.swap(queue_);
+    queue_bytes_ = 0;
+    lock.unlock();
+
+    size_t batch_bytes = 0;
+    for (const auto &frame: batch) {
+      batch_bytes += frame->size();
+    }
+    Metrics::Instance().SetGauge("webrtc_recorder_queue_bytes" + metric_labels_, batch_bytes);
+    for (const auto &frame: batch) {
+      Write(*frame);
+    }
+
+    lock.lock();
+  }
+}
+
+void Recorder::Write(const EncodedFrameBuffer &frame) {
+  if (frame.isKeyFrame()) {
+    const bool due = !writer_.isOpen() || frame.capture_time_us() - writer_.start_us() >= segment_us_;
+    if (frame.isIdr() && (due || !writer_.SameParameterSets(frame))) {
+      StartSegment(frame);
+    } else if (due && !idr_requested_) {
+      // An intra-refresh recovery point has no SPS/PPS to open a file with, ask for an IDR.
+      encoder_->ForceIdr();
+      idr_requested_ = true;
+    }
+  }
+  writer_.Write(frame);
+}
+
+void Recorder::StartSegment(const EncodedFrameBuffer &keyframe) {
+  writer_.Close();
+  idr_requested_ = false;
+
+  // UTC to the millisecond: names sort by start time across DST changes, and a second
+  // rotation within the same second, e.g. after a resolution change, gets a file of its own.
+  const auto now = std::chrono::system_clock::now();
+  const std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+  const int millis = static_cast<int>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+  std::tm tm;
+  gmtime_r(&seconds, &tm);
+  char name[64];
+  const size_t length = std::strftime(name, sizeof(name), "%Y%m%d-%H%M%S", &tm);
+  std::snprintf(name + length, sizeof(name) - length, "-%03dZ", millis);
+  const std::string path = dir_ + "/" + kSegmentPrefix + name + kSegmentSuffix;
+
+  const EncoderSettings settings = encoder_->settings();
+  try {
+    writer_.Open(path, keyframe, settings.width, settings.height);
+  } catch (const std::runtime_error &e) {
+    ERROR_PRINT("%s", e.what());
+    return;
+  }
+  INFO_PRINT("recorder: started %s", path.c_str());
+  Metrics::Instance().AddCounter("webrtc_recorder_segments_total" + metric_labels_);
+  ApplyRetention();
+}
+
+void Recorder::ApplyRetention() {
+  if (retention_ <= 0) {
+    return;
+  }
+
+  // Segment names sort by start time, segments of earlier runs count too.
+  std::vector<std::filesystem::path> segments;
+  std::error_code ec;
+  for (const auto &entry: std::filesystem::directory_iterator(dir_, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.rfind(kSegmentPrefix, 0) == 0 && entry.path().extension() == kSegmentSuffix) {
+      segments.push_back(entry.path());
+    }
+  }
+  std::sort(segments.begin(), segments.end());
+
+  for (size_t i = 0; i + retention_ < segments.size(); i++) {
+    if (segments[i] == writer_.path()) {
+      continue;
+    }
+    DEBUG_PRINT("recorder: removing %s", segments[i].c_str());
+    std::filesystem::remove(segments[i], ec);
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "args.h"
+#include "common/interface/subject.h"
+#include "encoder/encoder.hpp"
+#include "recorder/mp4_writer.h"
+
+/*
+ * Records an encoder's output into rolling fragmented-MP4 segments, without
+ * decoding or re-encoding. The encoder thread only queues a reference to each
+ * frame; muxing and disk writes happen on the recorder's own thread. If the
+ * disk stalls long enough for the queue to fill, frames are dropped up to the
+ * next keyframe rather than holding up the encoder.
+ */
+class Recorder {
+public:
+  static std::shared_ptr<Recorder> Create(std::shared_ptr<Encoder> encoder, Args args);
+
+  Recorder(std::shared_ptr<Encoder> encoder, Args args);
+  ~Recorder();
+
+private:
+  void Subscribe();
+  void OnFrame(std::shared_ptr<EncodedFrameBuffer> frame);
+  void Run();
+  void Write(const EncodedFrameBuffer &frame);
+  // `keyframe` must be an IDR, segments start on SPS/PPS.
+  void StartSegment(const EncodedFrameBuffer &keyframe);
+  void ApplyRetention();
+
+  const std::string dir_;
+  const int64_t segment_us_;
+  const int retention_;
+  const std::string metric_labels_;
+
+  std::shared_ptr<Encoder> encoder_;
+  std::shared_ptr<Observable<std::shared_ptr<EncodedFrameBuffer>>> observer_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool running_;
+  std::deque<std::shared_ptr<EncodedFrameBuffer>> queue_;
+  size_t queue_bytes_;
+  bool waiting_keyframe_;
+
+  // Only touched by the worker thread.
+  Mp4Writer writer_;
+  bool idr_requested_;
+  std::thread worker_;
+};
+
+#endif // RECORDER_H_
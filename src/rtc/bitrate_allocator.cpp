@@ -0,0 +1,55 @@
+#include "rtc/bitrate_allocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// Changes below this fraction of the current bitrate are not applied.
+static const double kMinChangeRatio = 0.05;
+
+std::shared_ptr<BitrateAllocator> BitrateAllocator::Create(std::shared_ptr<Encoder> encoder, int max_kbps,
+                                                           std::string metric_labels) {
+  return std::make_shared<BitrateAllocator>(std::move(encoder), max_kbps, std::move(metric_labels));
+}
+
+BitrateAllocator::BitrateAllocator(std::shared_ptr<Encoder> encoder, int max_kbps, std::string metric_labels) :
+    encoder_(std::move(encoder)), max_kbps_(max_kbps), metric_labels_(std::move(metric_labels)),
+    applied_kbps_(max_kbps) {
+  Metrics::Instance().SetGauge("webrtc_bitrate_target_kbps" + metric_labels_, applied_kbps_);
+}
+
+void BitrateAllocator::Update(const std::string &peer_id, int kbps) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (kbps > 0) {
+    peers_[peer_id] = kbps;
+  } else {
+    peers_.erase(peer_id);
+  }
+  Apply();
+}
+
+int BitrateAllocator::target_kbps() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return applied_kbps_;
+}
+
+void BitrateAllocator::Apply() {
+  int target = max_kbps_;
+  for (const auto &[id, kbps]: peers_) {
+    target = std::min(target, kbps);
+  }
+
+  const bool restore = peers_.empty() && target != applied_kbps_;
+  if (!restore && std::abs(target - applied_kbps_) < applied_kbps_ * kMinChangeRatio) {
+    return;
+  }
+
+  DEBUG_PRINT("Encoder bitrate %d -> %d kbps (%zu peers)", applied_kbps_, target, peers_.size());
+  applied_kbps_ = target;
+  EncoderSettings settings;
+  settings.bitrate = target;
+  encoder_->Reconfigure(settings);
+  Metrics::Instance().SetGauge("webrtc_bitrate_target_kbps" + metric_labels_, applied_kbps_);
+}
@@ -0,0 +1,39 @@
+#ifndef BITRATE_ALLOCATOR_H_
+#define BITRATE_ALLOCATOR_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "encoder/encoder.hpp"
+
+/*
+ * Collects the per-peer target bitrates and drives the shared encoder with the
+ * lowest one, since every peer receives the same stream. Without any peer the
+ * encoder returns to the configured maximum. Small changes are ignored so REMB
+ * jitter does not turn into a stream of reconfigurations.
+ */
+class BitrateAllocator {
+public:
+  static std::shared_ptr<BitrateAllocator> Create(std::shared_ptr<Encoder> encoder, int max_kbps,
+                                                  std::string metric_labels = "");
+
+  BitrateAllocator(std::shared_ptr<Encoder> encoder, int max_kbps, std::string metric_labels = "");
+
+  // Sets the peer's target; a target of 0 removes the peer.
+  void Update(const std::string &peer_id, int kbps);
+  int target_kbps() const;
+
+private:
+  void Apply();
+
+  std::shared_ptr<Encoder> encoder_;
+  const int max_kbps_;
+  const std::string metric_labels_;
+  mutable std::mutex mtx_;
+  std::map<std::string, int> peers_;
+  int applied_kbps_;
+};
+
+#endif // BITRATE_ALLOCATOR_H_
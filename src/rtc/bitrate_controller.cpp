@@ -0,0 +1,77 @@
+#include "rtc/bitrate_controller.h"
+
+#include <algorithm>
+
+// Rising REMB values are followed at 30% per report, falling ones immediately.
+static const double kEstimateRiseSmoothing = 0.3;
+// Stay below the receiver estimate so its queue can drain.
+static const double kEstimateHeadroom = 0.9;
+static const double kHighLoss = 0.10;
+static const double kLowLoss = 0.02;
+// Additive increase per second: 8% of the target, but at least this much.
+static const double kIncreaseRatio = 0.08;
+static const double kMinIncreaseKbps = 20;
+static const auto kDecreaseInterval = std::chrono::milliseconds(300);
+static const auto kHoldAfterDecrease = std::chrono::seconds(1);
+
+BitrateController::BitrateController(int min_kbps, int max_kbps, int start_kbps) :
+    min_kbps_(min_kbps), max_kbps_(max_kbps), target_kbps_(start_kbps), estimate_kbps_(0), fraction_lost_(0),
+    last_increase_(Clock::now()), last_decrease_(Clock::now() - kHoldAfterDecrease) {
+  Clamp();
+}
+
+void BitrateController::OnReceiverEstimate(unsigned int bps, Clock::time_point now) {
+  double kbps = bps / 1000.0;
+  if (estimate_kbps_ <= 0 || kbps < estimate_kbps_) {
+    estimate_kbps_ = kbps;
+  } else {
+    estimate_kbps_ += kEstimateRiseSmoothing * (kbps - estimate_kbps_);
+  }
+
+  if (target_kbps_ > estimate_kbps_ * kEstimateHeadroom) {
+    target_kbps_ = estimate_kbps_ * kEstimateHeadroom;
+    last_decrease_ = now;
+  } else {
+    Increase(now);
+  }
+  Clamp();
+}
+
+void BitrateController::OnPacketLoss(double fraction_lost, Clock::time_point now) {
+  fraction_lost_ = fraction_lost;
+  if (fraction_lost > kHighLoss) {
+    if (now - last_decrease_ >= kDecreaseInterval) {
+      target_kbps_ *= 1.0 - 0.5 * fraction_lost;
+      last_decrease_ = now;
+    }
+  } else if (fraction_lost < kLowLoss) {
+    Increase(now);
+  } else {
+    // Moderate loss: hold the rate and restart the increase timer.
+    last_increase_ = now;
+  }
+  Clamp();
+}
+
+void BitrateController::Increase(Clock::time_point now) {
+  double elapsed = std::chrono::duration<double>(now - last_increase_).count();
+  last_increase_ = now;
+  if (now - last_decrease_ < kHoldAfterDecrease) {
+    return;
+  }
+  target_kbps_ += std::max(kMinIncreaseKbps, target_kbps_ * kIncreaseRatio) * std::min(elapsed, 1.0);
+}
+
+void BitrateController::Clamp() {
+  double cap = max_kbps_;
+  if (estimate_kbps_ > 0) {
+    cap = std::min(cap, estimate_kbps_ * kEstimateHeadroom);
+  }
+  target_kbps_ = std::max(std::min(target_kbps_, cap), static_cast<double>(min_kbps_));
+}
+
+int BitrateController::target_kbps() const { return static_cast<int>(target_kbps_); }
+
+int BitrateController::estimate_kbps() const { return static_cast<int>(estimate_kbps_); }
+
+double BitrateController::fraction_lost() const { return fraction_lost_; }
@@ -0,0 +1,39 @@
+#ifndef BITRATE_CONTROLLER_H_
+#define BITRATE_CONTROLLER_H_
+
+#include <chrono>
+
+/*
+ * Per-peer send bitrate from receiver feedback. REMB estimates cap the target,
+ * falling estimates apply at once and rising ones are smoothed. RTCP receiver
+ * report loss drives an AIMD loop below that cap: heavy loss cuts the target
+ * multiplicatively, a clean link grows it additively.
+ */
+class BitrateController {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  BitrateController(int min_kbps, int max_kbps, int start_kbps);
+
+  void OnReceiverEstimate(unsigned int bps, Clock::time_point now = Clock::now());
+  // `fraction_lost` is the RTCP receiver report loss fraction in [0, 1].
+  void OnPacketLoss(double fraction_lost, Clock::time_point now = Clock::now());
+
+  int target_kbps() const;
+  int estimate_kbps() const;
+  double fraction_lost() const;
+
+private:
+  void Increase(Clock::time_point now);
+  void Clamp();
+
+  const int min_kbps_;
+  const int max_kbps_;
+  double target_kbps_;
+  double estimate_kbps_;
+  double fraction_lost_;
+  Clock::time_point last_increase_;
+  Clock::time_point last_decrease_;
+};
+
+#endif // BITRATE_CONTROLLER_H_
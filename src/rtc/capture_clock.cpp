@@ -0,0 +1,104 @@
+#include "rtc/capture_clock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// Loop gains per frame, close to critically damped: the phase follows 2% of each error, the
+// period 0.02%. 3 ms of driver jitter comes out as about 0.4 ms RMS.
+static const double kPhaseGain = 0.02;
+static const double kPeriodGain = 0.0002;
+// Frames measured before the grid starts, a line fitted through them gives the initial period
+// and phase. The slow period loop could not pull in a wrong guess, e.g. 30 fps configured on a
+// 60 fps source, nor a period from too few frames, whose error would pile up as phase error.
+static const size_t kSeedFrames = 30;
+// Errors beyond this fraction of a period are not jitter; this many in a row restart the grid.
+static const double kOutlierFraction = 0.35;
+static const int kMaxOutliers = 5;
+// A gap this long means capture stopped, the grid starts over from the next frame.
+static const int64_t kMaxGapUs = 1000000;
+
+CaptureClock::CaptureClock(int fps) :
+    period_us_(1e6 / (fps > 0 ? fps : 30)), phase_us_(0), last_capture_us_(0), last_output_us_(0), outliers_(0),
+    started_(false), seeded_(false) {
+  seed_us_.reserve(kSeedFrames);
+}
+
+void CaptureClock::Reset(int64_t capture_us) {
+  phase_us_ = static_cast<double>(capture_us);
+  outliers_ = 0;
+  started_ = true;
+  seeded_ = false;
+  seed_us_.assign(1, capture_us);
+}
+
+void CaptureClock::Seed() {
+  // The median interval ignores the odd dropped frame or late wakeup, and numbers the frames
+  // by the grid points they fall on.
+  std::vector<int64_t> intervals(seed_us_.size() - 1);
+  for (size_t i = 1; i < seed_us_.size(); i++) {
+    intervals[i - 1] = seed_us_[i] - seed_us_[i - 1];
+  }
+  std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+  const double median_us = static_cast<double>(intervals[intervals.size() / 2]);
+
+  // Least squares over (grid point, capture time), relative to the first frame.
+  const double n = static_cast<double>(seed_us_.size());
+  double sum_k = 0, sum_t = 0, sum_kk = 0, sum_kt = 0;
+  for (int64_t capture_us: seed_us_) {
+    const double t = static_cast<double>(capture_us - seed_us_.front());
+    const double k = std::round(t / median_us);
+    sum_k += k;
+    sum_t += t;
+    sum_kk += k * k;
+    sum_kt += k * t;
+  }
+  const double denominator = n * sum_kk - sum_k * sum_k;
+  period_us_ = denominator > 0 ? (n * sum_kt - sum_k * sum_t) / denominator : median_us;
+  const double last_k = std::round((seed_us_.back() - seed_us_.front()) / median_us);
+  phase_us_ = seed_us_.front() + (sum_t - period_us_ * sum_k) / n + period_us_ * last_k;
+  seeded_ = true;
+}
+
+int64_t CaptureClock::Emit(int64_t smoothed_us, int64_t capture_us) {
+  last_output_us_ = smoothed_us > last_output_us_ ? smoothed_us : std::max(capture_us, last_output_us_ + 1);
+  return last_output_us_;
+}
+
+int64_t CaptureClock::Smooth(int64_t capture_us) {
+  if (!started_ || std::llabs(capture_us - last_capture_us_) > kMaxGapUs) {
+    Reset(capture_us);
+  } else if (!seeded_ && capture_us > last_capture_us_) {
+    seed_us_.push_back(capture_us);
+    if (seed_us_.size() >= kSeedFrames) {
+      Seed();
+    }
+  }
+  last_capture_us_ = capture_us;
+  if (!seeded_) {
+    return Emit(capture_us, capture_us);
+  }
+
+  const double steps = std::round((capture_us - phase_us_) / period_us_);
+  const double grid_us = phase_us_ + steps * period_us_;
+  const double error_us = capture_us - grid_us;
+
+  if (std::fabs(error_us) > period_us_ * kOutlierFraction) {
+    if (++outliers_ >= kMaxOutliers) {
+      // The camera changed its timing, e.g. exposure lowered the frame rate off the grid.
+      Reset(capture_us);
+      return Emit(capture_us, capture_us);
+    }
+  } else {
+    outliers_ = 0;
+  }
+
+  // Move the reference to the newest grid point, never back to an older frame's.
+  if (steps > 0) {
+    phase_us_ = grid_us;
+  }
+  phase_us_ += kPhaseGain * error_us;
+  period_us_ += kPeriodGain * error_us;
+
+  return Emit(static_cast<int64_t>(std::llround(grid_us)), capture_us);
+}
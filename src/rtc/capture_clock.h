@@ -0,0 +1,44 @@
+#ifndef CAPTURE_CLOCK_H_
+#define CAPTURE_CLOCK_H_
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Recovers the camera's frame clock from jittery capture timestamps. Every
+ * capture time is snapped to a grid of frame intervals whose phase and period
+ * follow the camera through a second-order loop, so driver jitter is removed
+ * while drift and dropped frames are handled: a frame simply lands on a later
+ * grid point. The period is measured from the first frames rather than taken
+ * from the configured fps, which a camera or shm producer need not keep, and
+ * again after every restart. Results always increase.
+ */
+class CaptureClock {
+public:
+  // `fps` is only the period reported until the first intervals are measured.
+  explicit CaptureClock(int fps);
+
+  // `capture_us` and the result are CLOCK_MONOTONIC microseconds.
+  int64_t Smooth(int64_t capture_us);
+
+  double period_us() const { return period_us_; }
+
+private:
+  // Starts measuring the period again from `capture_us`.
+  void Reset(int64_t capture_us);
+  // Starts the grid from the frames collected since the reset.
+  void Seed();
+  // Returns `smoothed_us`, or the raw capture time when that would not advance the output.
+  int64_t Emit(int64_t smoothed_us, int64_t capture_us);
+
+  double period_us_;
+  double phase_us_;
+  int64_t last_capture_us_;
+  int64_t last_output_us_;
+  int outliers_;
+  bool started_;
+  bool seeded_;
+  std::vector<int64_t> seed_us_;
+};
+
+#endif // CAPTURE_CLOCK_H_
@@ -0,0 +1,116 @@
+#include "rtc/header_extension_writer.h"
+
+#include <algorithm>
+#include <ctime>
+
+static const size_t kRtpHeaderSize = 12;
+static const uint16_t kOneByteProfile = 0xBEDE;
+// Seconds from the NTP epoch (1900) to the Unix epoch.
+static const uint64_t kNtpUnixOffset = 2208988800ULL;
+// playout-delay is in 10 ms units on 12 bits.
+static const int kPlayoutDelayUnitMs = 10;
+static const int kPlayoutDelayLimit = 0xfff;
+
+static int64_t ClockUs(clockid_t clock) {
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint16_t PlayoutDelayUnits(int ms) {
+  return static_cast<uint16_t>(std::clamp(ms / kPlayoutDelayUnitMs, 0, kPlayoutDelayLimit));
+}
+
+HeaderExtensionWriter::HeaderExtensionWriter(int playout_delay_min_ms, int playout_delay_max_ms) :
+    playout_delay_min_(PlayoutDelayUnits(playout_delay_min_ms)),
+    playout_delay_max_(PlayoutDelayUnits(playout_delay_max_ms)), playout_delay_id_(0), abs_capture_time_id_(0),
+    capture_ntp_(0), has_last_timestamp_(false), last_timestamp_(0) {}
+
+void HeaderExtensionWriter::SetPlayoutDelayId(int id) { playout_delay_id_.store(id); }
+
+void HeaderExtensionWriter::SetAbsCaptureTimeId(int id) { abs_capture_time_id_.store(id); }
+
+void HeaderExtensionWriter::SetCaptureTime(int64_t capture_us) {
+  // Move the capture time from the monotonic clock onto the wall clock NTP is based on.
+  const int64_t wall_us = ClockUs(CLOCK_REALTIME) - (ClockUs(CLOCK_MONOTONIC) - capture_us);
+  const uint64_t seconds = static_cast<uint64_t>(wall_us / 1000000) + kNtpUnixOffset;
+  const uint64_t fraction = (static_cast<uint64_t>(wall_us % 1000000) << 32) / 1000000;
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  capture_ntp_ = (seconds << 32) | fraction;
+}
+
+void HeaderExtensionWriter::outgoing(rtc::message_vector &messages, const rtc::message_callback &) {
+  if (!playout_delay_id_.load() && !abs_capture_time_id_.load()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (const auto &message: messages) {
+    if (message && message->type != rtc::Message::Control) {
+      Write(*message);
+    }
+  }
+}
+
+void HeaderExtensionWriter::Write(rtc::Message &message) {
+  if (message.size() < kRtpHeaderSize || (std::to_integer<uint8_t>(message[0]) >> 6) != 2) {
+    return;
+  }
+
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(message.data());
+  const uint32_t timestamp = (uint32_t(p[4]) << 24) | (uint32_t(p[5]) << 16) | (uint32_t(p[6]) << 8) | p[7];
+  if (has_last_timestamp_ && timestamp == last_timestamp_) {
+    return; // not the first packet of the frame
+  }
+  has_last_timestamp_ = true;
+  last_timestamp_ = timestamp;
+
+  std::vector<uint8_t> elements;
+  if (int id = playout_delay_id_.load()) {
+    elements.push_back(static_cast<uint8_t>((id << 4) | (3 - 1)));
+    elements.push_back(static_cast<uint8_t>(playout_delay_min_ >> 4));
+    elements.push_back(static_cast<uint8_t>(((playout_delay_min_ & 0xf) << 4) | (playout_delay_max_ >> 8)));
+    elements.push_back(static_cast<uint8_t>(playout_delay_max_ & 0xff));
+  }
+  if (int id = abs_capture_time_id_.load(); id && capture_ntp_) {
+    elements.push_back(static_cast<uint8_t>((id << 4) | (8 - 1)));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      elements.push_back(static_cast<uint8_t>(capture_ntp_ >> shift));
+    }
+  }
+  if (elements.empty()) {
+    return;
+  }
+
+  const size_t csrc_end = kRtpHeaderSize + 4 * (p[0] & 0x0f);
+  const bool has_extension = p[0] & 0x10;
+  size_t insert_at = csrc_end;
+  size_t block_size = 0;
+  if (has_extension) {
+    if (csrc_end + 4 > message.size() || ((p[csrc_end] << 8) | p[csrc_end + 1]) != kOneByteProfile) {
+      return; // a two-byte extension block from further up the chain, leave it alone
+    }
+    block_size = 4 * size_t((p[csrc_end + 2] << 8) | p[csrc_end + 3]);
+    insert_at = csrc_end + 4 + block_size;
+    if (insert_at > message.size()) {
+      return;
+    }
+  }
+
+  // The block stays a whole number of 32-bit words, zero bytes are padding to the parser.
+  elements.resize((elements.size() + 3) / 4 * 4, 0);
+  std::vector<rtc::byte> bytes;
+  if (!has_extension) {
+    bytes = {rtc::byte(kOneByteProfile >> 8), rtc::byte(kOneByteProfile & 0xff), rtc::byte(0), rtc::byte(0)};
+  }
+  for (uint8_t element: elements) {
+    bytes.push_back(rtc::byte(element));
+  }
+  message.insert(message.begin() + insert_at, bytes.begin(), bytes.end());
+
+  const size_t words = (block_size + elements.size()) / 4;
+  message[0] |= rtc::byte(0x10);
+  message[csrc_end + 2] = rtc::byte(words >> 8);
+  message[csrc_end + 3] = rtc::byte(words & 0xff);
+}
@@ -0,0 +1,44 @@
+#ifndef HEADER_EXTENSION_WRITER_H_
+#define HEADER_EXTENSION_WRITER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "rtc/rtc.hpp"
+
+/*
+ * Adds one-byte RTP header extensions (RFC 8285) to the first packet of every
+ * frame: `playout-delay`, asking the receiver's jitter buffer for a delay in
+ * the negotiated range, and `abs-capture-time`, the NTP time the frame was
+ * captured. An extension with ID 0 is not negotiated and is not written.
+ */
+class HeaderExtensionWriter : public rtc::MediaHandler {
+public:
+  static constexpr const char *kPlayoutDelayUri = "http://www.webrtc.org/experiments/rtp-hdrext/playout-delay";
+  static constexpr const char *kAbsCaptureTimeUri = "http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time";
+
+  HeaderExtensionWriter(int playout_delay_min_ms, int playout_delay_max_ms);
+
+  void SetPlayoutDelayId(int id);
+  void SetAbsCaptureTimeId(int id);
+  // `capture_us` is CLOCK_MONOTONIC microseconds, set before the frame is sent.
+  void SetCaptureTime(int64_t capture_us);
+
+  void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+private:
+  void Write(rtc::Message &message);
+
+  const uint16_t playout_delay_min_;
+  const uint16_t playout_delay_max_;
+  std::atomic<int> playout_delay_id_;
+  std::atomic<int> abs_capture_time_id_;
+
+  std::mutex mtx_;
+  uint64_t capture_ntp_;
+  bool has_last_timestamp_;
+  uint32_t last_timestamp_;
+};
+
+#endif // HEADER_EXTENSION_WRITER_H_
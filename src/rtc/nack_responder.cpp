@@ -0,0 +1,215 @@
+#include "rtc/nack_responder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+static const uint8_t kRtcpTransportFeedback = 205;
+static const uint8_t kGenericNack = 1;
+static const size_t kRtcpHeaderSize = 4;
+static const size_t kRtpHeaderSize = 12;
+static const uint8_t kFuA = 28;
+static const size_t kFuHeaderSize = 2;
+// Must match the descriptors VpxRtpPacketizer writes.
+static const size_t kVp8DescriptorSize = 4;
+static const size_t kVp9DescriptorSize = 3;
+// AV1 aggregation header: Z marks a packet continuing an OBU from the previous one.
+static const size_t kAv1AggregationHeaderSize = 1;
+static const uint8_t kAv1ContinuesObu = 0x80;
+static const uint8_t kAv1ObuExtension = 0x04;
+// Packets remembered per peer, about 5 MB of video at 1200-byte packets.
+static const size_t kHistorySize = 4096;
+// The payload of the next packet starts at most a start code and a NAL header, or an OBU header and
+// size field, past the last one.
+static const size_t kSearchWindow = 16;
+static const size_t kMatchSize = 16;
+
+static uint32_t ReadU32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static uint16_t ReadU16(const uint8_t *p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+
+NackResponder::NackResponder(std::string peer_id, uint32_t ssrc, VideoCodec codec,
+                             std::shared_ptr<RetransmissionCache> cache, std::shared_ptr<Pacer> pacer) :
+    peer_id_(std::move(peer_id)), ssrc_(ssrc), codec_(codec), cache_(std::move(cache)), pacer_(std::move(pacer)),
+    cursor_(0), history_(kHistorySize) {}
+
+void NackResponder::SetFrame(std::shared_ptr<EncodedFrameBuffer> frame) {
+  if (cache_) {
+    cache_->Retain(frame);
+  }
+  std::lock_guard<std::mutex> lock(mtx_);
+  frame_ = std::move(frame);
+  cursor_ = 0;
+}
+
+void NackResponder::outgoing(rtc::message_vector &messages, const rtc::message_callback &) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (const auto &message: messages) {
+    if (message && message->type != rtc::Message::Control) {
+      Remember(*message);
+    }
+  }
+}
+
+void NackResponder::Remember(const rtc::Message &message) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(message.data());
+  const size_t size = message.size();
+  if (size < kRtpHeaderSize || (p[0] >> 6) != 2) {
+    return;
+  }
+
+  const uint16_t seq = ReadU16(p + 2);
+  Packet &packet = history_[seq % kHistorySize];
+  packet.valid = true;
+  packet.seq = seq;
+  packet.frame.reset();
+  packet.offset = 0;
+  packet.length = 0;
+  packet.copy.clear();
+
+  size_t header = kRtpHeaderSize + 4 * (p[0] & 0x0f);
+  if ((p[0] & 0x10) && header + 4 <= size) {
+    header += 4 + 4 * size_t(ReadU16(p + header + 2));
+  }
+  if (header < size) {
+    header += PayloadHeaderSize(p + header, size - header);
+  }
+
+  // Padded or unusual packets are rare enough to simply keep whole.
+  const bool padded = p[0] & 0x20;
+  if (padded || header > kMaxPrefixSize || header > size || !frame_ || !frame_->isOwned()) {
+    packet.prefix_size = 0;
+    packet.copy.assign(message.begin(), message.end());
+    return;
+  }
+
+  packet.prefix_size = static_cast<uint8_t>(header);
+  std::copy(message.begin(), message.begin() + header, packet.prefix.begin());
+
+  const uint8_t *payload = p + header;
+  const size_t length = size - header;
+  const uint8_t *data = frame_->data();
+  const size_t match = std::min(length, kMatchSize);
+  const size_t end = std::min(frame_->size(), cursor_ + kSearchWindow + match);
+  const uint8_t *found = std::search(data + std::min(cursor_, end), data + end, payload, payload + match);
+  if (found != data + end && static_cast<size_t>(found - data) + length <= frame_->size() &&
+      std::memcmp(found, payload, length) == 0) {
+    packet.frame = frame_;
+    packet.offset = found - data;
+    packet.length = length;
+    cursor_ = packet.offset + length;
+  } else {
+    packet.copy.assign(message.begin() + header, message.end());
+  }
+}
+
+size_t NackResponder::PayloadHeaderSize(const uint8_t *p, size_t size) const {
+  switch (codec_) {
+    case VideoCodec::VP8:
+      return kVp8DescriptorSize;
+    case VideoCodec::VP9:
+      return kVp9DescriptorSize;
+    case VideoCodec::AV1:
+      // A packet starting an OBU carries its header with the size field dropped, so
+      // the header is kept and the payload is matched past the frame's size field.
+      if (size > kAv1AggregationHeaderSize && !(p[0] & kAv1ContinuesObu)) {
+        return kAv1AggregationHeaderSize + ((p[1] & kAv1ObuExtension) ? 2 : 1);
+      }
+      return kAv1AggregationHeaderSize;
+    case VideoCodec::H264:
+      // Single NAL units are copied from the frame whole, header included.
+      return (p[0] & 0x1f) == kFuA ? kFuHeaderSize : 0;
+  }
+  return 0;
+}
+
+void NackResponder::incoming(rtc::message_vector &messages, const rtc::message_callback &send) {
+  std::vector<uint16_t> seqs;
+  for (const auto &message: messages) {
+    if (message && message->type == rtc::Message::Control) {
+      ParseNacks(message->data(), message->size(), seqs);
+    }
+  }
+  if (seqs.empty()) {
+    return;
+  }
+
+  auto &metrics = Metrics::Instance();
+  DEBUG_PRINT("peer (%s) NACKed %zu packets", peer_id_.c_str(), seqs.size());
+  metrics.AddCounter("webrtc_rtx_nack_requests_total");
+  for (uint16_t seq: seqs) {
+    rtc::message_ptr packet;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      packet = Rebuild(seq);
+    }
+    if (!packet) {
+      metrics.AddCounter("webrtc_rtx_misses_total");
+      continue;
+    }
+
+    metrics.AddCounter("webrtc_rtx_packets_total");
+    metrics.AddCounter("webrtc_rtx_bytes_total", packet->size());
+    if (pacer_) {
+      pacer_->Enqueue(std::move(packet), Pacer::Priority::Retransmission, send);
+    } else {
+      send(std::move(packet));
+    }
+  }
+}
+
+rtc::message_ptr NackResponder::Rebuild(uint16_t seq) {
+  const Packet &packet = history_[seq % kHistorySize];
+  if (!packet.valid || packet.seq != seq) {
+    return nullptr;
+  }
+
+  const rtc::byte *payload = packet.copy.data();
+  size_t length = packet.copy.size();
+  std::shared_ptr<EncodedFrameBuffer> frame;
+  if (packet.copy.empty()) {
+    frame = packet.frame.lock();
+    if (!frame) {
+      return nullptr;
+    }
+    payload = reinterpret_cast<const rtc::byte *>(frame->data()) + packet.offset;
+    length = packet.length;
+  }
+
+  auto message = rtc::make_message(packet.prefix_size + length, rtc::Message::Binary);
+  std::copy(packet.prefix.begin(), packet.prefix.begin() + packet.prefix_size, message->begin());
+  std::copy(payload, payload + length, message->begin() + packet.prefix_size);
+  return message;
+}
+
+void NackResponder::ParseNacks(const rtc::byte *data, size_t size, std::vector<uint16_t> &seqs) const {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  size_t offset = 0;
+  while (offset + kRtcpHeaderSize <= size) {
+    const uint8_t *packet = p + offset;
+    const size_t length = (size_t((packet[2] << 8) | packet[3]) + 1) * 4;
+    if ((packet[0] >> 6) != 2 || offset + length > size) {
+      return;
+    }
+
+    // Header, sender SSRC and media SSRC, then PID/BLP pairs.
+    if (packet[1] == kRtcpTransportFeedback && (packet[0] & 0x1f) == kGenericNack && length >= 12 &&
+        ReadU32(packet + 8) == ssrc_) {
+      for (size_t fci = 12; fci + 4 <= length; fci += 4) {
+        const uint16_t pid = ReadU16(packet + fci);
+        const uint16_t blp = ReadU16(packet + fci + 2);
+        seqs.push_back(pid);
+        for (int bit = 0; bit < 16; bit++) {
+          if (blp & (1 << bit)) {
+            seqs.push_back(static_cast<uint16_t>(pid + bit + 1));
+          }
+        }
+      }
+    }
+    offset += length;
+  }
+}
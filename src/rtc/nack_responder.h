@@ -0,0 +1,70 @@
+#ifndef NACK_RESPONDER_H_
+#define NACK_RESPONDER_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/encoded_frame_buffer.h"
+#include "rtc/pacer.h"
+#include "rtc/retransmission_cache.h"
+#include "rtc/rtc.hpp"
+
+/*
+ * Answers RTCP generic NACKs for one peer. Rather than copying every outgoing
+ * packet, it remembers where each packet's payload lies inside the encoded frame
+ * and keeps only the RTP header and the codec's payload header (H.264 FU-A, the
+ * VP8/VP9 descriptor, the AV1 aggregation and rewritten OBU header); the frame
+ * itself is held once for all peers by the shared RetransmissionCache. A NACK for a packet whose frame has
+ * left the cache counts as a miss and is left to the receiver's PLI.
+ */
+class NackResponder : public rtc::MediaHandler {
+public:
+  // `pacer` may be null, retransmissions are then sent right away.
+  NackResponder(std::string peer_id, uint32_t ssrc, VideoCodec codec, std::shared_ptr<RetransmissionCache> cache,
+                std::shared_ptr<Pacer> pacer);
+
+  // The frame the next outgoing packets are cut from, set before it is sent.
+  void SetFrame(std::shared_ptr<EncodedFrameBuffer> frame);
+
+  void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override;
+  void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+private:
+  // RTP header with header extensions and the codec's payload header.
+  static const size_t kMaxPrefixSize = 48;
+
+  struct Packet {
+    bool valid = false;
+    uint16_t seq = 0;
+    uint8_t prefix_size = 0;
+    std::array<rtc::byte, kMaxPrefixSize> prefix;
+    std::weak_ptr<EncodedFrameBuffer> frame;
+    size_t offset = 0;
+    size_t length = 0;
+    // Used instead of `frame` when the payload could not be found in it.
+    std::vector<rtc::byte> copy;
+  };
+
+  void Remember(const rtc::Message &message);
+  // The size of the payload header at `p`, which the packetizer wrote rather than copied from the frame.
+  size_t PayloadHeaderSize(const uint8_t *p, size_t size) const;
+  rtc::message_ptr Rebuild(uint16_t seq);
+  void ParseNacks(const rtc::byte *data, size_t size, std::vector<uint16_t> &seqs) const;
+
+  const std::string peer_id_;
+  const uint32_t ssrc_;
+  const VideoCodec codec_;
+  std::shared_ptr<RetransmissionCache> cache_;
+  std::shared_ptr<Pacer> pacer_;
+
+  std::mutex mtx_;
+  std::shared_ptr<EncodedFrameBuffer> frame_;
+  size_t cursor_;
+  std::vector<Packet> history_;
+};
+
+#endif // NACK_RESPONDER_H_
@@ -0,0 +1,137 @@
+#include "rtc/pacer.h"
+
+#include <algorithm>
+
+#include "common/logging.h"
+#include "common/metrics.h"
+
+// The queue is drained within this time even if that exceeds the pacing rate.
+static const auto kMaxQueueDelay = std::chrono::milliseconds(500);
+// Unused tokens accumulate for at most this long, which bounds the burst after an idle period.
+static const double kMaxBurstSeconds = 0.01;
+static const size_t kMinBurstBytes = 1500;
+
+Pacer::Pacer(std::string peer_id, double pacing_factor, int target_kbps, ThreadPolicy policy) :
+    label_("{peer=\"" + peer_id + "\"}"), pacing_factor_(pacing_factor), policy_(std::move(policy)), running_(true),
+    queue_bytes_(0), rate_bytes_per_s_(0), tokens_(0), last_refill_(std::chrono::steady_clock::now()),
+    window_max_delay_ms_(0), window_start_(last_refill_) {
+  SetTargetBitrate(target_kbps);
+  worker_ = std::thread([this]() { Run(); });
+}
+
+Pacer::~Pacer() { Stop(); }
+
+void Pacer::SetTargetBitrate(int kbps) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  rate_bytes_per_s_ = kbps * 1000.0 / 8 * pacing_factor_;
+}
+
+void Pacer::Enqueue(rtc::message_ptr message, Priority priority, rtc::message_callback send) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_) {
+      return;
+    }
+    queue_bytes_ += message->size();
+    queues_[static_cast<int>(priority)].push_back(
+            {std::move(message), std::move(send), std::chrono::steady_clock::now()});
+  }
+  cv_.notify_one();
+}
+
+void Pacer::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    for (auto &queue: queues_) {
+      queue.clear();
+    }
+    queue_bytes_ = 0;
+  }
+  cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+
+  auto &metrics = Metrics::Instance();
+  metrics.Remove("webrtc_peer_pacer_queue_delay_ms" + label_);
+  metrics.Remove("webrtc_peer_pacer_queue_delay_max_ms" + label_);
+  metrics.Remove("webrtc_peer_pacer_queue_bytes" + label_);
+}
+
+void Pacer::Run() {
+  ApplyThreadPolicy(policy_, "send");
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (running_) {
+    auto queue = std::find_if(queues_.begin(), queues_.end(), [](const auto &q) { return !q.empty(); });
+    if (queue == queues_.end()) {
+      cv_.wait(lock);
+      // Idle time earns no credit, but it does clear any debt left by the last frame.
+      last_refill_ = std::chrono::steady_clock::now();
+      tokens_ = std::max(tokens_, 0.0);
+      continue;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    const double drain_rate = queue_bytes_ / std::chrono::duration<double>(kMaxQueueDelay).count();
+    const double rate = std::max(rate_bytes_per_s_, drain_rate);
+    const double capacity = std::max(rate * kMaxBurstSeconds, static_cast<double>(kMinBurstBytes));
+    tokens_ = std::min(capacity, tokens_ + rate * std::chrono::duration<double>(now - last_refill_).count());
+    last_refill_ = now;
+
+    if (tokens_ < 0) {
+      cv_.wait_for(lock, std::chrono::duration<double>(-tokens_ / rate));
+      continue;
+    }
+
+    Packet packet = std::move(queue->front());
+    queue->pop_front();
+    tokens_ -= packet.message->size();
+    queue_bytes_ -= packet.message->size();
+    const double delay_ms = std::chrono::duration<double, std::milli>(now - packet.enqueued).count();
+    const size_t queue_bytes = queue_bytes_;
+
+    lock.unlock();
+    try {
+      packet.send(packet.message);
+    } catch (const std::exception &e) {
+      // The transport closed under a queued packet, the peer is going away.
+      ERROR_PRINT("pacer failed to send: %s", e.what());
+    }
+    ReportMetrics(delay_ms, queue_bytes);
+    lock.lock();
+  }
+}
+
+void Pacer::ReportMetrics(double queue_delay_ms, size_t queue_bytes) {
+  auto now = std::chrono::steady_clock::now();
+  if (now - window_start_ > std::chrono::seconds(1)) {
+    window_start_ = now;
+    window_max_delay_ms_ = 0;
+  }
+  window_max_delay_ms_ = std::max(window_max_delay_ms_, queue_delay_ms);
+
+  auto &metrics = Metrics::Instance();
+  metrics.SetGauge("webrtc_peer_pacer_queue_delay_ms" + label_, queue_delay_ms);
+  metrics.SetGauge("webrtc_peer_pacer_queue_delay_max_ms" + label_, window_max_delay_ms_);
+  metrics.SetGauge("webrtc_peer_pacer_queue_bytes" + label_, static_cast<double>(queue_bytes));
+  metrics.AddCounter("webrtc_pacer_packets_total");
+}
+
+PacedSender::PacedSender(std::shared_ptr<Pacer> pacer, Pacer::Priority priority) :
+    pacer_(std::move(pacer)), priority_(priority) {}
+
+void PacedSender::outgoing(rtc::message_vector &messages, const rtc::message_callback &send) {
+  rtc::message_vector passthrough;
+  for (auto &message: messages) {
+    if (!message || message->type == rtc::Message::Control) {
+      passthrough.push_back(std::move(message));
+    } else {
+      pacer_->Enqueue(std::move(message), priority_, send);
+    }
+  }
+  messages.swap(passthrough);
+}
@@ -0,0 +1,81 @@
+#ifndef PACER_H_
+#define PACER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "common/thread_policy.h"
+#include "rtc/rtc.hpp"
+
+/*
+ * A token-bucket pacer for one peer connection. RTP packets are queued by
+ * priority and released at a multiple of the target bitrate, so a keyframe is
+ * spread over several milliseconds instead of hitting the link as one burst.
+ * When the queue would hold more than `kMaxQueueDelay` the pacer drains faster
+ * rather than let latency grow without bound.
+ */
+class Pacer {
+public:
+  enum class Priority { Audio = 0, Retransmission = 1, Video = 2 };
+
+  // `pacing_factor` multiplies the target bitrate into the pacing rate, `policy` places the send thread.
+  Pacer(std::string peer_id, double pacing_factor, int target_kbps, ThreadPolicy policy = {});
+  ~Pacer();
+
+  void SetTargetBitrate(int kbps);
+  void Enqueue(rtc::message_ptr message, Priority priority, rtc::message_callback send);
+  // Drops what is queued and stops sending, must be called before the transport goes away.
+  void Stop();
+
+private:
+  struct Packet {
+    rtc::message_ptr message;
+    rtc::message_callback send;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  void Run();
+  void ReportMetrics(double queue_delay_ms, size_t queue_bytes);
+
+  const std::string label_;
+  const double pacing_factor_;
+  const ThreadPolicy policy_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool running_;
+  std::array<std::deque<Packet>, 3> queues_;
+  size_t queue_bytes_;
+  double rate_bytes_per_s_;
+  double tokens_;
+  std::chrono::steady_clock::time_point last_refill_;
+
+  double window_max_delay_ms_;
+  std::chrono::steady_clock::time_point window_start_;
+
+  std::thread worker_;
+};
+
+/*
+ * The last media handler of a track's chain. It takes RTP packets out of the
+ * outgoing batch and hands them to the pacer; RTCP passes straight through.
+ */
+class PacedSender : public rtc::MediaHandler {
+public:
+  PacedSender(std::shared_ptr<Pacer> pacer, Pacer::Priority priority);
+
+  void outgoing(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+private:
+  std::shared_ptr<Pacer> pacer_;
+  const Pacer::Priority priority_;
+};
+
+#endif // PACER_H_
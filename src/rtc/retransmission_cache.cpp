@@ -0,0 +1,44 @@
+#include "rtc/retransmission_cache.h"
+
+#include "common/metrics.h"
+
+std::shared_ptr<RetransmissionCache> RetransmissionCache::Create(int max_age_ms, size_t max_bytes) {
+  return std::make_shared<RetransmissionCache>(max_age_ms, max_bytes);
+}
+
+RetransmissionCache::RetransmissionCache(int max_age_ms, size_t max_bytes) :
+    max_age_(max_age_ms), max_bytes_(max_bytes), bytes_(0) {}
+
+RetransmissionCache::~RetransmissionCache() {
+  auto &metrics = Metrics::Instance();
+  metrics.Remove("webrtc_rtx_cache_bytes");
+  metrics.Remove("webrtc_rtx_cache_frames");
+}
+
+void RetransmissionCache::Retain(std::shared_ptr<EncodedFrameBuffer> frame) {
+  // A borrowed buffer is released by the encoder right after delivery, keeping it would dangle.
+  if (!frame || !frame->isOwned()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  const auto now = std::chrono::steady_clock::now();
+  if (retained_.insert(frame.get()).second) {
+    bytes_ += frame->size();
+    frames_.push_back({now, std::move(frame)});
+  }
+  Evict(now);
+
+  auto &metrics = Metrics::Instance();
+  metrics.SetGauge("webrtc_rtx_cache_bytes", bytes_);
+  metrics.SetGauge("webrtc_rtx_cache_frames", frames_.size());
+}
+
+void RetransmissionCache::Evict(std::chrono::steady_clock::time_point now) {
+  // The newest frame always stays, even if it alone is over the byte limit.
+  while (frames_.size() > 1 && (now - frames_.front().added > max_age_ || bytes_ > max_bytes_)) {
+    bytes_ -= frames_.front().frame->size();
+    retained_.erase(frames_.front().frame.get());
+    frames_.pop_front();
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef RETRANSMISSION_CACHE_H_
+#define RETRANSMISSION_CACHE_H_
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+#include "common/encoded_frame_buffer.h"
+
+/*
+ * Keeps recently sent encoded frames alive so peers can answer NACKs from them.
+ * One cache is shared by every peer: a frame sent to N viewers is held once, and
+ * each peer's NackResponder only keeps weak references into it. Frames leave the
+ * cache oldest first once they exceed `max_age_ms` or the cache exceeds `max_bytes`.
+ */
+class RetransmissionCache {
+public:
+  static std::shared_ptr<RetransmissionCache> Create(int max_age_ms, size_t max_bytes);
+
+  RetransmissionCache(int max_age_ms, size_t max_bytes);
+  ~RetransmissionCache();
+
+  // Safe to call once per peer for the same frame, it is only stored once.
+  void Retain(std::shared_ptr<EncodedFrameBuffer> frame);
+
+private:
+  struct Entry {
+    std::chrono::steady_clock::time_point added;
+    std::shared_ptr<EncodedFrameBuffer> frame;
+  };
+
+  void Evict(std::chrono::steady_clock::time_point now);
+
+  const std::chrono::milliseconds max_age_;
+  const size_t max_bytes_;
+
+  std::mutex mtx_;
+  std::deque<Entry> frames_;
+  std::unordered_set<const EncodedFrameBuffer *> retained_;
+  size_t bytes_;
+};
+
+#endif // RETRANSMISSION_CACHE_H_
@@ -1,7 +1,12 @@
 #include "rtc_peer.h"
 
+#include <algorithm>
 #include <regex>
 
+#include "common/metrics.h"
+#include "rtc/rtcp_loss_handler.h"
+#include "rtc/vpx_rtp_packetizer.h"
+
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -14,50 +19,292 @@ std::string GenerateUuid() {
 }
 } // namespace utils
 
-void RtcPeer::SubscribeEncoder(std::shared_ptr<Encoder> encoder) {
-  encoder_observer_ = encoder->AsFrameBufferObservable();
-  encoder_observer_->Subscribe([this](std::shared_ptr<H264FrameBuffer> buffer) {
-    if (track_ && track_->isOpen()) {
-      if (!start_ts_)
-        start_ts_ = buffer->timestamp();
-      const int64_t ts_us = buffer->timestamp();
-      std::cout << "------------ " << ts_us - start_ts_ << " ------------" << std::endl;
-      track_->sendFrame(reinterpret_cast<const rtc::byte *>(buffer->data()), buffer->size(),
-                        std::chrono::duration<double, std::micro>(ts_us - start_ts_));
+// The first track's SSRC, further tracks count up from it.
+static const uint32_t kVideoSsrc = 42;
+// A bundled REMB lists every SSRC of the transport and can reach each track's
+// handler; copies of one report arrive within this window.
+static const auto kDuplicateEstimateWindow = std::chrono::milliseconds(20);
+
+void RtcPeer::SubscribeEncoders(std::weak_ptr<RtcPeer> weak_peer, VideoTrack &track,
+                                std::vector<std::shared_ptr<Encoder>> layers) {
+  track.layers = std::move(layers);
+  for (size_t i = 0; i < track.layers.size(); i++) {
+    auto observer = track.layers[i]->AsFrameBufferObservable();
+    const int layer = static_cast<int>(i);
+    // A frame may be delivered after its observer is released, so hold the peer
+    // for the delivery; tracks live as long as their peer.
+    VideoTrack *p = &track;
+    observer->Subscribe([weak_peer, p, layer](std::shared_ptr<EncodedFrameBuffer> buffer) {
+      if (auto peer = weak_peer.lock()) {
+        peer->OnEncodedFrame(*p, layer, buffer);
+      }
+    });
+    track.encoder_observers.push_back(std::move(observer));
+  }
+}
+
+void RtcPeer::ReleaseEncoders() {
+  // Dropping the encoders here rather than in the destructor lets a profile encoder
+  // stop as soon as its last viewer leaves, not when the peer map is next cleaned.
+  for (auto &track: tracks_) {
+    std::lock_guard<std::mutex> lock(track->send_mtx);
+    track->encoder_observers.clear();
+    track->layers.clear();
+  }
+}
+
+void RtcPeer::OnEncodedFrame(VideoTrack &track, int layer, std::shared_ptr<EncodedFrameBuffer> buffer) {
+  if (!track.track || !track.track->isOpen()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(track.send_mtx);
+  if (layer >= static_cast<int>(track.layers.size())) {
+    return;
+  }
+  if (layer != track.active_layer) {
+    if (layer != track.target_layer.load()) {
+      return;
     }
-  });
+    // A new layer, or the first frame of the stream, can only start on an IDR.
+    if (!buffer->isKeyFrame()) {
+      if (!track.keyframe_requested.exchange(true)) {
+        track.layers[layer]->ForceKeyFrame();
+      }
+      return;
+    }
+    DEBUG_PRINT("peer (%s) track %s switched to layer %d", id_.c_str(), track.mid.c_str(), layer);
+    if (track.active_layer >= 0) {
+      Metrics::Instance().AddCounter("webrtc_peer_layer_switches_total");
+    }
+    track.active_layer = layer;
+    track.keyframe_requested.store(false);
+    if (track.layers.size() > 1) {
+      Metrics::Instance().SetGauge("webrtc_peer_layer" + track.metric_labels, layer);
+    }
+  }
+
+  if (buffer->temporal_id() > track.max_temporal_id.load()) {
+    Metrics::Instance().AddCounter("webrtc_peer_frames_thinned_total");
+    return;
+  }
+
+  // RTP time follows the recovered capture clock, so encoder drops, B-frame reordering
+  // and driver jitter do not turn into jitter at the receiver.
+  const int64_t ts_us = track.capture_clock.Smooth(buffer->capture_time_us());
+  if (!track.start_ts)
+    track.start_ts = ts_us;
+  ScopedTrace trace(buffer->frame_id(), TraceStage::Send, id_.c_str());
+  if (track.nack_responder) {
+    track.nack_responder->SetFrame(buffer);
+  }
+  if (track.extension_writer) {
+    track.extension_writer->SetCaptureTime(buffer->capture_time_us());
+  }
+  track.track->sendFrame(reinterpret_cast<const rtc::byte *>(buffer->data()), buffer->size(),
+                         std::chrono::duration<double, std::micro>(ts_us - track.start_ts));
+}
+
+void RtcPeer::OnPictureLossIndication(VideoTrack &track) {
+  std::lock_guard<std::mutex> lock(track.send_mtx);
+  if (track.layers.empty()) {
+    return;
+  }
+  const int active = track.active_layer >= 0 ? track.active_layer : track.target_layer.load();
+  DEBUG_PRINT("peer (%s) sent PLI on track %s, forcing a keyframe on layer %d", id_.c_str(), track.mid.c_str(),
+              active);
+  track.layers[active]->ForceKeyFrame();
+}
+
+void RtcPeer::SelectLayer(VideoTrack &track, int target_kbps) {
+  // Climb back up only with some headroom over the layer's bitrate, so a target
+  // hovering at a layer boundary does not switch on every report.
+  std::lock_guard<std::mutex> lock(track.send_mtx);
+  if (track.layers.size() < 2) {
+    return;
+  }
+  const int current = track.target_layer.load();
+  int layer = static_cast<int>(track.layers.size()) - 1;
+  for (int i = 0; i < static_cast<int>(track.layers.size()); i++) {
+    const int layer_kbps = track.layers[i]->settings().bitrate;
+    if (target_kbps >= (i < current ? layer_kbps * 1.15 : layer_kbps)) {
+      layer = i;
+      break;
+    }
+  }
+
+  if (layer != current) {
+    DEBUG_PRINT("peer (%s) track %s target %d kbps, requesting layer %d", id_.c_str(), track.mid.c_str(),
+                target_kbps, layer);
+    track.target_layer.store(layer);
+    track.keyframe_requested.store(false);
+  }
+}
+
+void RtcPeer::SelectTemporalLayer(VideoTrack &track, int target_kbps) {
+  if (temporal_layers_ < 2) {
+    return;
+  }
+
+  int encoder_kbps;
+  {
+    std::lock_guard<std::mutex> lock(track.send_mtx);
+    if (track.layers.empty()) {
+      return;
+    }
+    encoder_kbps =
+            track.layers[track.active_layer >= 0 ? track.active_layer : track.target_layer.load()]->settings().bitrate;
+  }
+
+  // Each layer below the top one carries half the frames of the one above it. Thin only
+  // when the target falls clearly short, and come back with the same headroom as SelectLayer.
+  const int current = track.max_temporal_id.load();
+  int max_id = 0;
+  for (int id = temporal_layers_ - 1; id > 0; id--) {
+    const double need_kbps = encoder_kbps * 0.8 / (1 << (temporal_layers_ - 1 - id));
+    if (target_kbps >= (id > current ? need_kbps * 1.15 : need_kbps)) {
+      max_id = id;
+      break;
+    }
+  }
+
+  if (max_id != current) {
+    DEBUG_PRINT("peer (%s) track %s target %d kbps, sending temporal layers 0-%d", id_.c_str(), track.mid.c_str(),
+                target_kbps, max_id);
+    track.max_temporal_id.store(max_id);
+    Metrics::Instance().SetGauge("webrtc_peer_temporal_id" + track.metric_labels, max_id);
+  }
 }
 
 std::shared_ptr<RtcPeer> RtcPeer::Create(std::shared_ptr<Encoder> encoder, PeerConfig config) {
+  return Create(std::vector<std::shared_ptr<Encoder>>{std::move(encoder)}, std::move(config));
+}
+
+std::shared_ptr<RtcPeer> RtcPeer::Create(std::vector<std::shared_ptr<Encoder>> layers, PeerConfig config) {
+  TrackConfig track;
+  track.layers = std::move(layers);
+  track.fps = config.fps;
+  track.max_bitrate = config.max_bitrate;
+  track.rtx_cache = config.rtx_cache;
+  return Create(std::vector<TrackConfig>{std::move(track)}, std::move(config));
+}
+
+std::shared_ptr<RtcPeer> RtcPeer::Create(std::vector<TrackConfig> tracks, PeerConfig config) {
   auto ptr = std::make_shared<RtcPeer>(config);
   auto pc = std::make_shared<rtc::PeerConnection>(config);
   ptr->SetPeer(pc);
 
-  rtc::Description::Video video("0", rtc::Description::Direction::SendOnly);
-  video.addH264Codec(96);
-  video.addSSRC(42, "video-send");
-  auto track = pc->addTrack(video);
-  // create RTP configuration
-  auto rtpConfig =
-          std::make_shared<rtc::RtpPacketizationConfig>(42, "video-send", 96, rtc::H264RtpPacketizer::ClockRate);
+  if (config.pacing_factor > 0) {
+    // One pacer for the transport, the tracks share the link it paces.
+    ptr->pacer_ = std::make_shared<Pacer>(ptr->id(), config.pacing_factor, config.max_bitrate,
+                                          config.send_policy);
+  }
+  const bool labeled = tracks.size() > 1;
+  for (auto &track: tracks) {
+    ptr->AddVideoTrack(ptr, std::move(track), config, labeled);
+  }
+
+  return ptr;
+}
+
+void RtcPeer::AddVideoTrack(std::weak_ptr<RtcPeer> weak_peer, TrackConfig track_config, const PeerConfig &config,
+                            bool labeled) {
+  auto track = std::make_unique<VideoTrack>(track_config.fps);
+  track->mid = std::to_string(tracks_.size());
+  track->ssrc = kVideoSsrc + static_cast<uint32_t>(tracks_.size());
+  track->max_bitrate = std::max(track_config.max_bitrate, 1);
+  track->metric_labels = "{peer=\"" + id_ + "\"}";
+  if (labeled) {
+    track->metric_labels = Metrics::WithLabel(track->metric_labels, "track", track->mid);
+  }
+  track->on_target_bitrate = std::move(track_config.on_target_bitrate);
+  track->max_temporal_id.store(config.temporal_layers - 1);
+
+  const VideoCodec codec = track_config.layers.empty() ? VideoCodec::H264 : track_config.layers.front()->codec();
+  const int payload_type = track_config.payload_type;
+  rtc::Description::Video video(track->mid, rtc::Description::Direction::SendOnly);
+  if (codec == VideoCodec::VP8) {
+    video.addVP8Codec(payload_type);
+  } else if (codec == VideoCodec::VP9) {
+    video.addVP9Codec(payload_type);
+  } else if (codec == VideoCodec::AV1) {
+    video.addAV1Codec(payload_type);
+  } else {
+    video.addH264Codec(payload_type);
+  }
+  if (track_config.name.empty()) {
+    video.addSSRC(track->ssrc, "video-send");
+  } else {
+    video.addSSRC(track->ssrc, "video-send", track_config.name, track_config.name);
+  }
+  track->track = peer_connection_->addTrack(video);
+  // create RTP configuration, every video codec runs at a 90 kHz clock
+  auto rtpConfig = std::make_shared<rtc::RtpPacketizationConfig>(track->ssrc, "video-send", payload_type,
+                                                                  rtc::H264RtpPacketizer::ClockRate);
   // create packetizer
-  auto packetizer = std::make_shared<rtc::H264RtpPacketizer>(rtc::NalUnit::Separator::StartSequence, rtpConfig);
+  std::shared_ptr<rtc::RtpPacketizer> packetizer;
+  if (codec == VideoCodec::AV1) {
+    packetizer = std::make_shared<rtc::AV1RtpPacketizer>(rtc::AV1RtpPacketizer::Packetization::TemporalUnit, rtpConfig);
+  } else if (codec == VideoCodec::VP8 || codec == VideoCodec::VP9) {
+    packetizer = std::make_shared<VpxRtpPacketizer>(codec, rtpConfig);
+  } else {
+    packetizer = std::make_shared<rtc::H264RtpPacketizer>(rtc::NalUnit::Separator::StartSequence, rtpConfig);
+  }
+  if (config.playout_delay_ms >= 0 || config.abs_capture_time) {
+    // The extension IDs are taken from the remote offer in SetRemoteSdp.
+    track->extension_writer = std::make_shared<HeaderExtensionWriter>(0, std::max(config.playout_delay_ms, 0));
+    packetizer->addToChain(track->extension_writer);
+  }
+  // RTCP sender reports let the receiver compute loss and jitter.
+  packetizer->addToChain(std::make_shared<rtc::RtcpSrReporter>(rtpConfig));
+  // Tracks live as long as their peer, so only the peer needs checking.
+  VideoTrack *p = track.get();
+  packetizer->addToChain(std::make_shared<rtc::PliHandler>([weak_peer, p]() {
+    if (auto peer = weak_peer.lock()) {
+      peer->OnPictureLossIndication(*p);
+    }
+  }));
+  if (config.adaptive_bitrate) {
+    packetizer->addToChain(std::make_shared<rtc::RembHandler>([weak_peer](unsigned int bps) {
+      if (auto peer = weak_peer.lock()) {
+        peer->OnReceiverEstimate(bps);
+      }
+    }));
+    packetizer->addToChain(std::make_shared<RtcpLossHandler>(
+            track->ssrc, [weak_peer](uint32_t ssrc, double fraction_lost, uint32_t highest_seq) {
+              if (auto peer = weak_peer.lock()) {
+                peer->OnPacketLoss(ssrc, fraction_lost, highest_seq);
+              }
+            }));
+  }
+  if (track_config.rtx_cache) {
+    // Ahead of the pacer, so packets are remembered before they are queued.
+    track->nack_responder = std::make_shared<NackResponder>(id_, track->ssrc, codec, track_config.rtx_cache, pacer_);
+    packetizer->addToChain(track->nack_responder);
+  }
+  if (pacer_) {
+    // Last in the chain, so the SR reporter has counted each packet before it is queued.
+    packetizer->addToChain(std::make_shared<PacedSender>(pacer_, Pacer::Priority::Video));
+  }
   // set handler
-  track->setMediaHandler(packetizer);
-
-  ptr->SetTrack(track);
-  ptr->SubscribeEncoder(encoder);
+  track->track->setMediaHandler(packetizer);
 
-  return ptr;
+  SubscribeEncoders(weak_peer, *track, std::move(track_config.layers));
+  tracks_.push_back(std::move(track));
 }
 
 RtcPeer::RtcPeer(PeerConfig config) :
     timeout_(config.timeout), id_(utils::GenerateUuid()), has_candidates_in_sdp_(config.has_candidates_in_sdp),
-    is_connected_(false), is_complete_(false), start_ts_(0) {}
+    is_connected_(false), is_complete_(false), temporal_layers_(config.temporal_layers),
+    playout_delay_(config.playout_delay_ms >= 0), abs_capture_time_(config.abs_capture_time), last_estimate_bps_(0) {
+  if (config.adaptive_bitrate) {
+    bitrate_controller_ =
+            std::make_unique<BitrateController>(config.min_bitrate, config.max_bitrate, config.max_bitrate);
+  }
+}
 
 RtcPeer::~RtcPeer() {
   Terminate();
-  encoder_observer_.reset();
   DEBUG_PRINT("peer connection (%s) was destroyed!", id_.c_str());
 }
 
@@ -82,6 +329,11 @@ void RtcPeer::Terminate() {
 
   on_local_sdp_fn_ = nullptr;
   on_local_ice_fn_ = nullptr;
+  ReportPeerClosed();
+  ReleaseEncoders();
+  if (pacer_) {
+    pacer_->Stop();
+  }
   if (peer_connection_) {
     peer_connection_->close();
     peer_connection_ = nullptr;
@@ -104,8 +356,152 @@ void RtcPeer::SetPeer(std::shared_ptr<rtc::PeerConnection> peer) {
 
 std::shared_ptr<rtc::PeerConnection> RtcPeer::GetPeer() { return peer_connection_; }
 
-void RtcPeer::SetTrack(std::shared_ptr<rtc::Track> track) { track_ = std::move(track); }
-std::shared_ptr<rtc::Track> RtcPeer::GetTrack() { return track_; }
+std::shared_ptr<rtc::Track> RtcPeer::GetTrack(size_t index) {
+  return index < tracks_.size() ? tracks_[index]->track : nullptr;
+}
+
+size_t RtcPeer::track_count() const { return tracks_.size(); }
+
+void RtcPeer::OnTargetBitrate(OnTargetBitrateFunc func) {
+  std::lock_guard<std::mutex> lock(bitrate_mtx_);
+  on_target_bitrate_fn_ = std::move(func);
+}
+
+void RtcPeer::OnReceiverEstimate(unsigned int bps) {
+  {
+    std::lock_guard<std::mutex> lock(bitrate_mtx_);
+    if (!bitrate_controller_) {
+      return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (bps == last_estimate_bps_ && now - last_estimate_time_ < kDuplicateEstimateWindow) {
+      return;
+    }
+    last_estimate_bps_ = bps;
+    last_estimate_time_ = now;
+    bitrate_controller_->OnReceiverEstimate(bps, now);
+  }
+  ReportTargetBitrate();
+}
+
+void RtcPeer::OnPacketLoss(uint32_t ssrc, double fraction_lost, uint32_t highest_seq) {
+  {
+    std::lock_guard<std::mutex> lock(bitrate_mtx_);
+    if (!bitrate_controller_) {
+      return;
+    }
+    // Bundled tracks may each see the same compound report, and a late one is stale.
+    LossReport &report = loss_reports_[ssrc];
+    if (report.seen && static_cast<int32_t>(highest_seq - report.highest_seq) <= 0) {
+      return;
+    }
+    // A second report for one SSRC starts the next interval, the others may not send any.
+    bool flushed = false;
+    if (report.pending) {
+      FlushPacketLoss();
+      flushed = true;
+    }
+    report.packets = report.seen ? highest_seq - report.highest_seq : 0;
+    report.highest_seq = highest_seq;
+    report.fraction_lost = fraction_lost;
+    report.seen = true;
+    report.pending = true;
+
+    const bool complete = std::all_of(tracks_.begin(), tracks_.end(), [this](const auto &track) {
+      auto it = loss_reports_.find(track->ssrc);
+      return it != loss_reports_.end() && it->second.pending;
+    });
+    if (complete) {
+      FlushPacketLoss();
+      flushed = true;
+    }
+    if (!flushed) {
+      return;
+    }
+  }
+  ReportTargetBitrate();
+}
+
+void RtcPeer::FlushPacketLoss() {
+  // Weighted by the packets each SSRC sent in its interval, so a thumbnail track losing its
+  // few packets does not outweigh the main one. An SSRC's first report has no count yet, it
+  // only counts when none of the reports has one.
+  double packets = 0, lost = 0, fractions = 0;
+  int reports = 0;
+  for (auto &[ssrc, report]: loss_reports_) {
+    if (!report.pending) {
+      continue;
+    }
+    packets += report.packets;
+    lost += report.fraction_lost * report.packets;
+    fractions += report.fraction_lost;
+    reports++;
+    report.pending = false;
+  }
+  if (reports > 0) {
+    bitrate_controller_->OnPacketLoss(packets > 0 ? lost / packets : fractions / reports);
+  }
+}
+
+void RtcPeer::ReportTargetBitrate() {
+  std::lock_guard<std::mutex> lock(bitrate_mtx_);
+  if (!bitrate_controller_ || is_complete_.load()) {
+    return;
+  }
+
+  const std::string label = "{peer=\"" + id_ + "\"}";
+  auto &metrics = Metrics::Instance();
+  metrics.SetGauge("webrtc_peer_estimate_kbps" + label, bitrate_controller_->estimate_kbps());
+  metrics.SetGauge("webrtc_peer_target_kbps" + label, bitrate_controller_->target_kbps());
+  metrics.SetGauge("webrtc_peer_loss_fraction" + label, bitrate_controller_->fraction_lost());
+
+  const int target_kbps = bitrate_controller_->target_kbps();
+  if (pacer_) {
+    pacer_->SetTargetBitrate(target_kbps);
+  }
+  int64_t total_kbps = 0;
+  for (const auto &track: tracks_) {
+    total_kbps += track->max_bitrate;
+  }
+  for (auto &track: tracks_) {
+    const int share_kbps = static_cast<int>(target_kbps * track->max_bitrate / std::max<int64_t>(total_kbps, 1));
+    SelectLayer(*track, share_kbps);
+    SelectTemporalLayer(*track, share_kbps);
+    if (track->on_target_bitrate) {
+      track->on_target_bitrate(id_, share_kbps);
+    }
+  }
+  if (on_target_bitrate_fn_) {
+    on_target_bitrate_fn_(id_, target_kbps);
+  }
+}
+
+void RtcPeer::ReportPeerClosed() {
+  const std::string label = "{peer=\"" + id_ + "\"}";
+  auto &metrics = Metrics::Instance();
+  for (const auto &track: tracks_) {
+    metrics.Remove("webrtc_peer_layer" + track->metric_labels);
+    metrics.Remove("webrtc_peer_temporal_id" + track->metric_labels);
+  }
+
+  std::lock_guard<std::mutex> lock(bitrate_mtx_);
+  if (!bitrate_controller_) {
+    return;
+  }
+
+  metrics.Remove("webrtc_peer_estimate_kbps" + label);
+  metrics.Remove("webrtc_peer_target_kbps" + label);
+  metrics.Remove("webrtc_peer_loss_fraction" + label);
+
+  for (const auto &track: tracks_) {
+    if (track->on_target_bitrate) {
+      track->on_target_bitrate(id_, 0);
+    }
+  }
+  if (on_target_bitrate_fn_) {
+    on_target_bitrate_fn_(id_, 0);
+  }
+}
 
 std::string RtcPeer::RestartIce(std::string ice_ufrag, std::string ice_pwd) {
   rtc::Description remote_desc = peer_connection_->remoteDescription().value();
@@ -154,6 +550,11 @@ void RtcPeer::OnConnectionChange(rtc::PeerConnection::State state) {
   } else if (state == rtc::PeerConnection::State::Closed) {
     is_connected_.store(false);
     is_complete_.store(true);
+    ReportPeerClosed();
+    ReleaseEncoders();
+    if (pacer_) {
+      pacer_->Stop();
+    }
   }
 }
 
@@ -218,6 +619,10 @@ void RtcPeer::SetRemoteSdp(const std::string &sdp, const std::string &sdp_type)
     return;
   }
 
+  if (type == rtc::Description::Type::Offer) {
+    NegotiateHeaderExtensions(sdp);
+  }
+
   try {
     peer_connection_->setRemoteDescription(remote_desc);
   } catch (const std::exception &e) {
@@ -231,6 +636,79 @@ void RtcPeer::SetRemoteSdp(const std::string &sdp, const std::string &sdp_type)
   peer_connection_->setLocalDescription();
 }
 
+std::vector<RtcPeer::CodecOffer> RtcPeer::OfferedCodecs(const std::string &offer) {
+  // Non-interleaved H.264 is what the packetizer produces, single NAL unit mode is a last resort.
+  // Among those, the Constrained Baseline profile the answer states, temporal layers included.
+  const std::string profile = "42";
+  auto rank = [&offer, &profile](int payload_type) {
+    std::smatch match;
+    std::regex fmtp_regex("a=fmtp:" + std::to_string(payload_type) + " ([^\\r\\n]*)");
+    if (!std::regex_search(offer, match, fmtp_regex)) {
+      return 0;
+    }
+    const std::string fmtp = match[1];
+    std::regex profile_regex("profile-level-id=" + profile, std::regex::icase);
+    return (std::regex_search(fmtp, std::regex("packetization-mode=1")) ? 2 : 0) +
+           (std::regex_search(fmtp, profile_regex) ? 1 : 0);
+  };
+
+  std::vector<CodecOffer> codecs;
+  std::regex rtpmap_regex(R"(a=rtpmap:(\d+) ([A-Za-z0-9]+)/90000)");
+  for (auto it = std::sregex_iterator(offer.begin(), offer.end(), rtpmap_regex); it != std::sregex_iterator(); ++it) {
+    std::string name = (*it)[2];
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    VideoCodec codec;
+    if (!ParseVideoCodec(name, codec)) {
+      continue;
+    }
+    const int payload_type = std::stoi((*it)[1]);
+    auto offered = std::find_if(codecs.begin(), codecs.end(), [codec](const auto &c) { return c.codec == codec; });
+    if (offered == codecs.end()) {
+      codecs.push_back({codec, payload_type});
+    } else if (codec == VideoCodec::H264 && rank(payload_type) > rank(offered->payload_type)) {
+      offered->payload_type = payload_type;
+    }
+  }
+  return codecs;
+}
+
+void RtcPeer::NegotiateHeaderExtensions(const std::string &offer) {
+  if (tracks_.empty() || !tracks_.front()->extension_writer) {
+    return;
+  }
+
+  // Answer each extension we send with the ID the offerer chose for it. Within a
+  // BUNDLE group an extension has the same ID on every m-line.
+  int playout_delay_id = 0;
+  int abs_capture_time_id = 0;
+  std::regex extmap_regex(R"(a=extmap:(\d+)(?:/\w+)? ([^\s]+))");
+  for (auto it = std::sregex_iterator(offer.begin(), offer.end(), extmap_regex); it != std::sregex_iterator(); ++it) {
+    const int id = std::stoi((*it)[1]);
+    const std::string uri = (*it)[2];
+    if (playout_delay_ && !playout_delay_id && uri == HeaderExtensionWriter::kPlayoutDelayUri) {
+      playout_delay_id = id;
+    } else if (abs_capture_time_ && !abs_capture_time_id && uri == HeaderExtensionWriter::kAbsCaptureTimeUri) {
+      abs_capture_time_id = id;
+    }
+  }
+  DEBUG_PRINT("peer (%s) playout-delay id %d, abs-capture-time id %d", id_.c_str(), playout_delay_id,
+              abs_capture_time_id);
+
+  for (auto &track: tracks_) {
+    auto desc = track->track->description();
+    if (playout_delay_id) {
+      desc.addExtMap(rtc::Description::Media::ExtMap(playout_delay_id, HeaderExtensionWriter::kPlayoutDelayUri));
+    }
+    if (abs_capture_time_id) {
+      desc.addExtMap(
+              rtc::Description::Media::ExtMap(abs_capture_time_id, HeaderExtensionWriter::kAbsCaptureTimeUri));
+    }
+    track->track->setDescription(std::move(desc));
+    track->extension_writer->SetPlayoutDelayId(playout_delay_id);
+    track->extension_writer->SetAbsCaptureTimeId(abs_capture_time_id);
+  }
+}
+
 void RtcPeer::SetRemoteIce(const std::string &sdp_mid, const std::string &candidate) {
   if (is_connected_.load()) {
     return;
@@ -2,17 +2,48 @@
 #define RTC_PEER_H_
 
 #include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 
-#include "common/h264_frame_buffer.h"
+#include "common/frame_tracer.h"
+#include "common/encoded_frame_buffer.h"
 #include "common/interface/subject.h"
 #include "common/logging.h"
 #include "encoder/encoder.hpp"
+#include "rtc/bitrate_controller.h"
+#include "rtc/capture_clock.h"
+#include "rtc/header_extension_writer.h"
+#include "rtc/nack_responder.h"
+#include "rtc/pacer.h"
+#include "rtc/retransmission_cache.h"
 #include "rtc/rtc.hpp"
 
 struct PeerConfig : public rtc::Configuration {
   int timeout = 10;
   bool has_candidates_in_sdp = false;
+  // Follow REMB and receiver report loss; bitrates are in kbps.
+  bool adaptive_bitrate = false;
+  int min_bitrate = 150;
+  int max_bitrate = 1000;
+  // Temporal layers in the encoded stream, congested peers skip the upper ones.
+  int temporal_layers = 1;
+  // The nominal capture rate, the starting point of the capture clock recovery.
+  // Multi-track peers take it, and the NACK cache below, from each TrackConfig.
+  int fps = 30;
+  // Pacing rate as a multiple of the target bitrate, 0 disables pacing.
+  double pacing_factor = 0;
+  // Sent frames kept for answering NACKs, shared across peers. Null disables retransmission.
+  std::shared_ptr<RetransmissionCache> rtx_cache;
+  // The largest receiver playout delay asked for with `playout-delay`, -1 does not send it.
+  int playout_delay_ms = -1;
+  // Send the frame's capture time with `abs-capture-time`.
+  bool abs_capture_time = false;
+  // Placement of the pacer thread.
+  ThreadPolicy send_policy;
 };
 
 class SignalingMessageObserver {
@@ -35,7 +66,41 @@ protected:
 
 class RtcPeer : public SignalingMessageObserver {
 public:
+  // Called with the peer's target bitrate in kbps, and with 0 once it goes away.
+  using OnTargetBitrateFunc = std::function<void(const std::string &peer_id, int kbps)>;
+
+  // One send-only video track of a peer.
+  struct TrackConfig {
+    // Simulcast encodes of one source ordered from the highest bitrate down; the
+    // track sends one of them and switches at keyframes as its bandwidth changes.
+    std::vector<std::shared_ptr<Encoder>> layers;
+    // Announced as the track's msid, so a viewer can tell its tracks apart.
+    std::string name;
+    int fps = 30;
+    // The peer's target bitrate is split between its tracks in proportion to this.
+    int max_bitrate = 1000;
+    std::shared_ptr<RetransmissionCache> rtx_cache;
+    // Like OnTargetBitrate, with this track's share of the target.
+    OnTargetBitrateFunc on_target_bitrate;
+    // The RTP payload type of the layers' codec, the offerer's when answering.
+    int payload_type = 96;
+  };
+
+  // A video codec of a remote offer and the payload type it was offered with.
+  struct CodecOffer {
+    VideoCodec codec;
+    int payload_type;
+  };
+  // The video codecs of an SDP offer, one entry each in offer order. For H.264 a
+  // payload type with `packetization-mode=1` is preferred, then one offering the
+  // Constrained Baseline profile the stream is encoded in.
+  static std::vector<CodecOffer> OfferedCodecs(const std::string &offer);
+
   static std::shared_ptr<RtcPeer> Create(std::shared_ptr<Encoder> encoder, PeerConfig config);
+  static std::shared_ptr<RtcPeer> Create(std::vector<std::shared_ptr<Encoder>> layers, PeerConfig config);
+  // The tracks get mids "0", "1", ... and share the one bundled transport, its pacer
+  // and bandwidth estimate. `config.max_bitrate` is the limit for all of them together.
+  static std::shared_ptr<RtcPeer> Create(std::vector<TrackConfig> tracks, PeerConfig config);
 
   RtcPeer(PeerConfig config);
   ~RtcPeer();
@@ -47,20 +112,44 @@ public:
 
   void SetPeer(std::shared_ptr<rtc::PeerConnection> peer);
   std::shared_ptr<rtc::PeerConnection> GetPeer();
-  void SetTrack(std::shared_ptr<rtc::Track> track);
-  std::shared_ptr<rtc::Track> GetTrack();
+  std::shared_ptr<rtc::Track> GetTrack(size_t index = 0);
+  size_t track_count() const;
   std::string RestartIce(std::string ice_ufrag, std::string ice_pwd);
+  void OnTargetBitrate(OnTargetBitrateFunc func);
 
   // SignalingMessageObserver implementation.
   void SetRemoteSdp(const std::string &sdp, const std::string &type) override;
   void SetRemoteIce(const std::string &sdp_mid, const std::string &candidate) override;
 
-protected:
-  void SubscribeEncoder(std::shared_ptr<Encoder> encoder);
-
-  std::shared_ptr<Observable<std::shared_ptr<H264FrameBuffer>>> encoder_observer_;
-
 private:
+  struct VideoTrack {
+    explicit VideoTrack(int fps) : capture_clock(fps) {}
+
+    std::string mid;
+    uint32_t ssrc = 0;
+    int max_bitrate = 0;
+    std::string metric_labels;
+    std::shared_ptr<rtc::Track> track;
+    std::shared_ptr<NackResponder> nack_responder;
+    std::shared_ptr<HeaderExtensionWriter> extension_writer;
+    OnTargetBitrateFunc on_target_bitrate;
+
+    std::mutex send_mtx;
+    std::vector<std::shared_ptr<Encoder>> layers;
+    std::vector<std::shared_ptr<Observable<std::shared_ptr<EncodedFrameBuffer>>>> encoder_observers;
+    int64_t start_ts = 0;
+    CaptureClock capture_clock;
+    int active_layer = -1;
+    std::atomic<int> target_layer{0};
+    std::atomic<bool> keyframe_requested{false};
+    std::atomic<int> max_temporal_id{0};
+  };
+
+  void AddVideoTrack(std::weak_ptr<RtcPeer> weak_peer, TrackConfig track_config, const PeerConfig &config,
+                     bool labeled);
+  void SubscribeEncoders(std::weak_ptr<RtcPeer> weak_peer, VideoTrack &track,
+                         std::vector<std::shared_ptr<Encoder>> layers);
+
   void OnSignalingStateChange(rtc::PeerConnection::SignalingState state);
   void OnIceGatheringChange(rtc::PeerConnection::GatheringState state);
   void OnConnectionChange(rtc::PeerConnection::State state);
@@ -68,6 +157,22 @@ private:
   void OnLocalDescription(rtc::Description desc);
 
   void EmitLocalSdp(int delay_sec = 0);
+  void NegotiateHeaderExtensions(const std::string &offer);
+
+  void OnReceiverEstimate(unsigned int bps);
+  // Collects one receiver report block per SSRC and passes the controller their loss
+  // weighted by packets, once per round of reports rather than once per track.
+  void OnPacketLoss(uint32_t ssrc, double fraction_lost, uint32_t highest_seq);
+  // Caller holds bitrate_mtx_.
+  void FlushPacketLoss();
+  void ReportTargetBitrate();
+  void ReportPeerClosed();
+
+  void ReleaseEncoders();
+  void OnEncodedFrame(VideoTrack &track, int layer, std::shared_ptr<EncodedFrameBuffer> buffer);
+  void OnPictureLossIndication(VideoTrack &track);
+  void SelectLayer(VideoTrack &track, int target_kbps);
+  void SelectTemporalLayer(VideoTrack &track, int target_kbps);
 
   int timeout_;
   std::string id_;
@@ -81,10 +186,28 @@ private:
   rtc::PeerConnection::SignalingState signaling_state_;
   std::unique_ptr<rtc::Description> modified_desc_;
 
-  std::shared_ptr<rtc::Track> track_;
+  // Fixed once Create returns.
+  std::vector<std::unique_ptr<VideoTrack>> tracks_;
   std::shared_ptr<rtc::PeerConnection> peer_connection_;
 
-  uint64_t start_ts_;
+  const int temporal_layers_;
+  std::shared_ptr<Pacer> pacer_;
+  const bool playout_delay_;
+  const bool abs_capture_time_;
+
+  std::mutex bitrate_mtx_;
+  std::unique_ptr<BitrateController> bitrate_controller_;
+  unsigned int last_estimate_bps_;
+  std::chrono::steady_clock::time_point last_estimate_time_;
+  struct LossReport {
+    uint32_t highest_seq = 0;
+    uint32_t packets = 0;
+    double fraction_lost = 0;
+    bool seen = false;
+    bool pending = false;
+  };
+  std::map<uint32_t, LossReport> loss_reports_;
+  OnTargetBitrateFunc on_target_bitrate_fn_;
 };
 
 #endif // RTC_PEER_H_
@@ -0,0 +1,50 @@
+#include "rtc/rtcp_loss_handler.h"
+
+static const uint8_t kRtcpSenderReport = 200;
+static const uint8_t kRtcpReceiverReport = 201;
+static const size_t kRtcpHeaderSize = 8;
+static const size_t kSenderInfoSize = 20;
+static const size_t kReportBlockSize = 24;
+
+static uint32_t ReadU32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+RtcpLossHandler::RtcpLossHandler(uint32_t ssrc, OnLossFunc on_loss) :
+    ssrc_(ssrc), on_loss_fn_(std::move(on_loss)) {}
+
+void RtcpLossHandler::incoming(rtc::message_vector &messages, const rtc::message_callback &) {
+  for (const auto &message: messages) {
+    if (message && message->type == rtc::Message::Control) {
+      ParseCompound(message->data(), message->size());
+    }
+  }
+}
+
+void RtcpLossHandler::ParseCompound(const rtc::byte *data, size_t size) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  size_t offset = 0;
+  while (offset + kRtcpHeaderSize <= size) {
+    const uint8_t *packet = p + offset;
+    const size_t length = (size_t((packet[2] << 8) | packet[3]) + 1) * 4;
+    if ((packet[0] >> 6) != 2 || offset + length > size) {
+      return;
+    }
+
+    const uint8_t type = packet[1];
+    const int count = packet[0] & 0x1f;
+    size_t block = kRtcpHeaderSize;
+    if (type == kRtcpSenderReport) {
+      block += kSenderInfoSize;
+    }
+
+    if (type == kRtcpSenderReport || type == kRtcpReceiverReport) {
+      for (int i = 0; i < count && block + kReportBlockSize <= length; ++i, block += kReportBlockSize) {
+        if (ReadU32(packet + block) == ssrc_ && on_loss_fn_) {
+          on_loss_fn_(ssrc_, packet[block + 4] / 256.0, ReadU32(packet + block + 8));
+        }
+      }
+    }
+    offset += length;
+  }
+}
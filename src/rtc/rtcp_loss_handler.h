@@ -0,0 +1,29 @@
+#ifndef RTCP_LOSS_HANDLER_H_
+#define RTCP_LOSS_HANDLER_H_
+
+#include <functional>
+
+#include "rtc/rtc.hpp"
+
+/*
+ * Reads the report blocks of incoming RTCP sender/receiver reports and passes
+ * the loss fraction the remote side saw on our SSRC, with the extended highest
+ * sequence number received so reports can be weighted by packets. The messages
+ * themselves are left in place for the rest of the media handler chain.
+ */
+class RtcpLossHandler : public rtc::MediaHandler {
+public:
+  using OnLossFunc = std::function<void(uint32_t ssrc, double fraction_lost, uint32_t highest_seq)>;
+
+  RtcpLossHandler(uint32_t ssrc, OnLossFunc on_loss);
+
+  void incoming(rtc::message_vector &messages, const rtc::message_callback &send) override;
+
+private:
+  void ParseCompound(const rtc::byte *data, size_t size);
+
+  const uint32_t ssrc_;
+  OnLossFunc on_loss_fn_;
+};
+
+#endif // RTCP_LOSS_HANDLER_H_
@@ -0,0 +1,70 @@
+#include "rtc/vpx_rtp_packetizer.h"
+
+#include <algorithm>
+
+// VP8: X, then I with a 15-bit picture ID (M set).
+static const uint8_t kVp8Extended = 0x80;
+static const uint8_t kVp8StartOfPartition = 0x10;
+static const uint8_t kVp8PictureIdPresent = 0x80;
+static const size_t kVp8DescriptorSize = 4;
+// VP9: I, P, B, E, then a 15-bit picture ID (M set).
+static const uint8_t kVp9PictureIdPresent = 0x80;
+static const uint8_t kVp9InterPicture = 0x40;
+static const uint8_t kVp9StartOfFrame = 0x08;
+static const uint8_t kVp9EndOfFrame = 0x04;
+static const size_t kVp9DescriptorSize = 3;
+static const uint8_t kLongPictureId = 0x80;
+
+VpxRtpPacketizer::VpxRtpPacketizer(VideoCodec codec, std::shared_ptr<rtc::RtpPacketizationConfig> rtp_config,
+                                   size_t max_fragment_size) :
+    rtc::RtpPacketizer(std::move(rtp_config)), codec_(codec), max_fragment_size_(max_fragment_size),
+    picture_id_(0) {}
+
+std::vector<rtc::binary> VpxRtpPacketizer::fragment(rtc::binary data) {
+  if (data.empty()) {
+    return {};
+  }
+  picture_id_ = (picture_id_ + 1) & 0x7fff;
+
+  const bool vp8 = codec_ == VideoCodec::VP8;
+  const size_t descriptor_size = vp8 ? kVp8DescriptorSize : kVp9DescriptorSize;
+  const size_t capacity = std::max<size_t>(max_fragment_size_ - descriptor_size, 1);
+  // Equal payloads rather than full ones and a short tail, so no packet is much smaller than the rest.
+  const size_t count = (data.size() + capacity - 1) / capacity;
+  const size_t payload_size = (data.size() + count - 1) / count;
+  const bool inter = !vp8 && IsVp9InterFrame(data);
+
+  std::vector<rtc::binary> fragments;
+  for (size_t offset = 0; offset < data.size(); offset += payload_size) {
+    const size_t size = std::min(payload_size, data.size() - offset);
+    const bool first = offset == 0;
+    const bool last = offset + size == data.size();
+
+    rtc::binary fragment;
+    fragment.reserve(descriptor_size + size);
+    if (vp8) {
+      fragment.push_back(rtc::byte(kVp8Extended | (first ? kVp8StartOfPartition : 0)));
+      fragment.push_back(rtc::byte(kVp8PictureIdPresent));
+    } else {
+      fragment.push_back(rtc::byte(kVp9PictureIdPresent | (inter ? kVp9InterPicture : 0) |
+                                   (first ? kVp9StartOfFrame : 0) | (last ? kVp9EndOfFrame : 0)));
+    }
+    fragment.push_back(rtc::byte(kLongPictureId | (picture_id_ >> 8)));
+    fragment.push_back(rtc::byte(picture_id_ & 0xff));
+    fragment.insert(fragment.end(), data.begin() + offset, data.begin() + offset + size);
+    fragments.push_back(std::move(fragment));
+  }
+  return fragments;
+}
+
+bool VpxRtpPacketizer::IsVp9InterFrame(const rtc::binary &data) {
+  // frame_marker(2) profile_low_bit(1) profile_high_bit(1) [reserved_zero(1)]
+  // show_existing_frame(1) frame_type(1), MSB first.
+  const uint8_t header = std::to_integer<uint8_t>(data[0]);
+  const int profile = ((header >> 5) & 1) | (((header >> 4) & 1) << 1);
+  int bit = profile == 3 ? 5 : 4;
+  const bool show_existing_frame = (header >> (7 - bit)) & 1;
+  bit++;
+  const bool key_frame = ((header >> (7 - bit)) & 1) == 0;
+  return show_existing_frame || !key_frame;
+}
@@ -0,0 +1,33 @@
+#ifndef VPX_RTP_PACKETIZER_H_
+#define VPX_RTP_PACKETIZER_H_
+
+#include <cstdint>
+
+#include "common/encoded_frame_buffer.h"
+#include "rtc/rtc.hpp"
+
+/*
+ * Splits VP8 (RFC 7741) or VP9 (RFC 9628, non-flexible mode without spatial
+ * layers) frames into equally sized RTP payloads behind a payload descriptor
+ * carrying a 15-bit picture ID, so receivers can tell a lost frame from a
+ * late one. libdatachannel writes the RTP headers and the marker bit.
+ */
+class VpxRtpPacketizer : public rtc::RtpPacketizer {
+public:
+  // `codec` is VideoCodec::VP8 or VideoCodec::VP9.
+  VpxRtpPacketizer(VideoCodec codec, std::shared_ptr<rtc::RtpPacketizationConfig> rtp_config,
+                   size_t max_fragment_size = rtc::RtpPacketizer::DefaultMaxFragmentSize);
+
+protected:
+  std::vector<rtc::binary> fragment(rtc::binary data) override;
+
+private:
+  // Whether a VP9 frame references earlier ones, from its uncompressed header.
+  static bool IsVp9InterFrame(const rtc::binary &data);
+
+  const VideoCodec codec_;
+  const size_t max_fragment_size_;
+  uint16_t picture_id_;
+};
+
+#endif // VPX_RTP_PACKETIZER_H_
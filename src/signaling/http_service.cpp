@@ -2,17 +2,29 @@
 
 #include <iostream>
 #include <regex>
+#include <sstream>
 
+#include "common/frame_tracer.h"
 #include "common/logging.h"
+#include "common/metrics.h"
 
-std::shared_ptr<HttpService> HttpService::Create(Args args, std::shared_ptr<V4L2Webrtc> v4l2_webrtc,
+static const int kDefaultEventSeconds = 30;
+static const int kMaxEventSeconds = 600;
+
+std::shared_ptr<HttpService> HttpService::Create(Args args, std::vector<std::shared_ptr<V4L2Webrtc>> cameras,
                                                  boost::asio::io_context &ioc) {
-  return std::make_shared<HttpService>(args, v4l2_webrtc, ioc);
+  return std::make_shared<HttpService>(args, std::move(cameras), ioc);
 }
 
-HttpService::HttpService(Args args, std::shared_ptr<V4L2Webrtc> v4l2_webrtc, boost::asio::io_context &ioc) :
-    v4l2_webrtc_(v4l2_webrtc), cleaner_stop_(false), port_(args.http_port),
-    acceptor_({ioc, {boost::asio::ip::address_v6::any(), port_}}) {}
+HttpService::HttpService(Args args, std::vector<std::shared_ptr<V4L2Webrtc>> cameras, boost::asio::io_context &ioc) :
+    cleaner_stop_(false), port_(args.http_port), acceptor_({ioc, {boost::asio::ip::address_v6::any(), port_}}) {
+  for (const auto &camera: cameras) {
+    if (!default_camera_) {
+      default_camera_ = camera;
+    }
+    cameras_[camera->config().camera_name] = camera;
+  }
+}
 
 HttpService::~HttpService() {
   cleaner_stop_.store(true);
@@ -36,18 +48,35 @@ void HttpService::Start() {
 
 void HttpService::Connect() {
   INFO_PRINT("Http server is running on http://*:%d", port_);
+  for (const auto &[name, camera]: cameras_) {
+    if (!name.empty()) {
+      INFO_PRINT("  camera %s at /whep/%s", name.c_str(), name.c_str());
+    }
+  }
   AcceptConnection();
 }
 
 void HttpService::Disconnect() {}
 
-std::shared_ptr<RtcPeer> HttpService::CreatePeer(PeerConfig config) {
-  if (!v4l2_webrtc_) {
+std::shared_ptr<RtcPeer> HttpService::CreatePeer(PeerConfig config, const std::vector<std::string> &cameras,
+                                                 const std::string &profile, const std::string &offer) {
+  if (!default_camera_) {
     ERROR_PRINT("V4L2Webrtc is not initialized.");
     return nullptr;
   }
+  std::vector<std::shared_ptr<V4L2Webrtc>> sources;
+  for (const auto &camera: cameras) {
+    auto v4l2_webrtc = GetCamera(camera);
+    if (!v4l2_webrtc) {
+      throw std::invalid_argument("unknown camera: " + camera);
+    }
+    sources.push_back(std::move(v4l2_webrtc));
+  }
+  if (sources.empty()) {
+    sources.push_back(default_camera_);
+  }
 
-  auto peer = v4l2_webrtc_->CreatePeerConnection(config);
+  auto peer = V4L2Webrtc::CreatePeerConnection(sources, config, profile, offer);
   peer_map_[peer->id()] = peer;
   return peer;
 }
@@ -62,6 +91,24 @@ std::shared_ptr<RtcPeer> HttpService::GetPeer(const std::string &peer_id) {
 
 void HttpService::RemovePeerFromMap(const std::string &peer_id) { peer_map_.erase(peer_id); }
 
+std::shared_ptr<V4L2Webrtc> HttpService::GetCamera(const std::string &camera) {
+  if (camera.empty()) {
+    return default_camera_;
+  }
+  auto it = cameras_.find(camera);
+  return it != cameras_.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<Encoder> HttpService::GetEncoder(const std::string &camera) {
+  auto v4l2_webrtc = GetCamera(camera);
+  return v4l2_webrtc ? v4l2_webrtc->encoder() : nullptr;
+}
+
+std::shared_ptr<EventRecorder> HttpService::GetEventRecorder(const std::string &camera) {
+  auto v4l2_webrtc = GetCamera(camera);
+  return v4l2_webrtc ? v4l2_webrtc->event_recorder() : nullptr;
+}
+
 void HttpService::AcceptConnection() {
   acceptor_.async_accept([this](beast::error_code ec, tcp::socket socket) {
     if (!ec) {
@@ -129,6 +176,26 @@ void HttpSession::CloseConnection() {
 
 void HttpSession::HandleRequest() {
   DEBUG_PRINT("Receive http method: %d", static_cast<int>(req_.method()));
+  auto routes = ParseRoutes(std::string(req_.target().data(), req_.target().size()));
+  if (!routes.empty() && routes[0] == "trace") {
+    HandleTraceRequest(routes);
+    return;
+  } else if (!routes.empty() && routes[0] == "metrics") {
+    HandleMetricsRequest();
+    return;
+  } else if (!routes.empty() && (routes[0] == "encoder" || routes[0] == "event")) {
+    // e.g. `/encoder/front`, without a camera the first one.
+    const std::string camera = routes.size() > 1 ? routes[1] : "";
+    if (!http_service_->GetCamera(camera)) {
+      ResponseUnprocessableEntity("The camera does not exist.");
+    } else if (routes[0] == "encoder") {
+      HandleEncoderRequest(camera);
+    } else {
+      HandleEventRequest(camera);
+    }
+    return;
+  }
+
   if (req_.method() != http::verb::options && req_.find("Content-Type") == req_.end()) {
     ResponseUnprocessableEntity("Without content type.");
     return;
@@ -159,22 +226,57 @@ void HttpSession::HandlePostRequest() {
   if (content_type_ == "application/sdp") {
     PeerConfig config;
     config.has_candidates_in_sdp = true;
-    auto peer = http_service_->CreatePeer(config);
-    peer->OnLocalSdp([self = shared_from_this()](const std::string &peer_id, const std::string &sdp,
-                                                 [[maybe_unused]] const std::string &type) {
-      std::string host(self->req_["Host"].begin(), self->req_["Host"].size());
-      std::string location = "https://" + host + "/resource/" + peer_id;
-      self->res_ = std::make_shared<http::response<http::string_body>>(http::status::created, self->req_.version());
-      self->SetCommonHeader(self->res_);
-      self->res_->set(http::field::content_type, "application/sdp");
-      self->res_->set(http::field::location, location);
-      self->res_->body() = sdp;
-      self->res_->prepare_payload();
-      self->WriteResponse();
-    });
-
+    auto target = std::string(req_.target().data(), req_.target().size());
+    auto routes = ParseRoutes(target);
+    auto query = ParseQuery(target);
+    // `/whep/<camera>`, or `/whep/front,rear` for a track per camera in one session.
+    // Any other path reaches the first camera.
+    std::vector<std::string> cameras;
+    if (routes.size() > 1 && routes[0] == "whep") {
+      std::string camera;
+      std::stringstream ss(routes[1]);
+      while (std::getline(ss, camera, ',')) {
+        cameras.push_back(camera);
+      }
+    }
     auto sdp = std::string(req_.body());
-    peer->SetRemoteSdp(sdp, "offer");
+    std::shared_ptr<RtcPeer> peer;
+    try {
+      peer = http_service_->CreatePeer(config, cameras, query["profile"], sdp);
+      if (!peer) {
+        ResponseUnprocessableEntity("The peer can not be created.");
+        return;
+      }
+      peer->OnLocalSdp([self = shared_from_this()](const std::string &peer_id, const std::string &sdp,
+                                                   [[maybe_unused]] const std::string &type) {
+        std::string host(self->req_["Host"].begin(), self->req_["Host"].size());
+        std::string location = "https://" + host + "/resource/" + peer_id;
+        self->res_ =
+            std::make_shared<http::response<http::string_body>>(http::status::created, self->req_.version());
+        self->SetCommonHeader(self->res_);
+        self->res_->set(http::field::content_type, "application/sdp");
+        self->res_->set(http::field::location, location);
+        self->res_->body() = sdp;
+        self->res_->prepare_payload();
+        self->WriteResponse();
+      });
+
+      peer->SetRemoteSdp(sdp, "offer");
+    } catch (const std::exception &e) {
+      // A half built peer would linger in the map until the cleaner found it disconnected.
+      if (peer) {
+        peer->Terminate();
+        http_service_->RemovePeerFromMap(peer->id());
+      }
+      // The offer itself is at fault for an unknown camera, profile or codec, or SDP that does not parse.
+      if (dynamic_cast<const std::invalid_argument *>(&e)) {
+        ResponseUnprocessableEntity(e.what());
+      } else {
+        ERROR_PRINT("Failed to answer an offer: %s", e.what());
+        ResponseInternalServerError(e.what());
+      }
+      return;
+    }
   } else {
     ResponseUnprocessableEntity("The Content-Type only allow `application/sdp`.");
   }
@@ -231,7 +333,7 @@ void HttpSession::HandleOptionsRequest() {
   res_ = std::make_shared<http::response<http::string_body>>(http::status::no_content, req_.version());
   SetCommonHeader(res_);
   res_->set(http::field::access_control_allow_headers, "Origin, X-Requested-With, Content-Type, Accept, Authorization");
-  res_->set(http::field::access_control_allow_methods, "DELETE, OPTIONS, PATCH, POST");
+  res_->set(http::field::access_control_allow_methods, "DELETE, GET, OPTIONS, PATCH, POST");
   res_->set(http::field::access_control_allow_origin, "*");
   res_->prepare_payload();
   WriteResponse();
@@ -262,6 +364,134 @@ void HttpSession::HandleDeleteRequest() {
   WriteResponse();
 }
 
+void HttpSession::HandleTraceRequest(const std::vector<std::string> &routes) {
+  auto &tracer = FrameTracer::Instance();
+  const std::string action = routes.size() > 1 ? routes[1] : "";
+
+  if (req_.method() == http::verb::get && action.empty()) {
+    res_ = std::make_shared<http::response<http::string_body>>(http::status::ok, req_.version());
+    SetCommonHeader(res_);
+    res_->set(http::field::content_type, "application/json");
+    res_->body() = tracer.ExportChromeTrace();
+  } else if (req_.method() == http::verb::post && action == "start") {
+    tracer.Start();
+    res_ = std::make_shared<http::response<http::string_body>>(http::status::no_content, req_.version());
+    SetCommonHeader(res_);
+  } else if (req_.method() == http::verb::post && action == "stop") {
+    tracer.Stop();
+    res_ = std::make_shared<http::response<http::string_body>>(http::status::no_content, req_.version());
+    SetCommonHeader(res_);
+  } else if (req_.method() == http::verb::delete_ && action.empty()) {
+    tracer.Clear();
+    res_ = std::make_shared<http::response<http::string_body>>(http::status::no_content, req_.version());
+    SetCommonHeader(res_);
+  } else {
+    ResponseUnprocessableEntity("Use GET /trace, DELETE /trace, POST /trace/start or POST /trace/stop.");
+    return;
+  }
+
+  res_->prepare_payload();
+  WriteResponse();
+}
+
+void HttpSession::HandleMetricsRequest() {
+  if (req_.method() != http::verb::get) {
+    ResponseMethodNotAllowed();
+    return;
+  }
+
+  res_ = std::make_shared<http::response<http::string_body>>(http::status::ok, req_.version());
+  SetCommonHeader(res_);
+  res_->set(http::field::content_type, "text/plain; version=0.0.4");
+  res_->body() = Metrics::Instance().RenderPrometheus();
+  res_->prepare_payload();
+  WriteResponse();
+}
+
+void HttpSession::HandleEncoderRequest(const std::string &camera) {
+  auto encoder = http_service_->GetEncoder(camera);
+  if (!encoder) {
+    ResponseUnprocessableEntity("The encoder is not initialized.");
+    return;
+  }
+
+  if (req_.method() == http::verb::post) {
+    // e.g. `POST /encoder?bitrate=500&width=640&height=360&fps=15&gop=30`
+    auto query = ParseQuery(std::string(req_.target().data(), req_.target().size()));
+    EncoderSettings settings;
+    try {
+      for (const auto &[key, value]: query) {
+        if (key == "bitrate") {
+          settings.bitrate = std::stoi(value);
+        } else if (key == "width") {
+          settings.width = std::stoi(value);
+        } else if (key == "height") {
+          settings.height = std::stoi(value);
+        } else if (key == "fps") {
+          settings.fps = std::stoi(value);
+        } else if (key == "gop") {
+          settings.gop = std::stoi(value);
+        } else {
+          throw std::invalid_argument("unknown encoder setting: " + key);
+        }
+      }
+      encoder->Reconfigure(settings);
+    } catch (const std::exception &e) {
+      ResponseUnprocessableEntity(e.what());
+      return;
+    }
+  } else if (req_.method() != http::verb::get) {
+    ResponseMethodNotAllowed();
+    return;
+  }
+
+  // Reports the settings in effect, a POST is applied with the next frame.
+  auto current = encoder->settings();
+  res_ = std::make_shared<http::response<http::string_body>>(
+          req_.method() == http::verb::post ? http::status::accepted : http::status::ok, req_.version());
+  SetCommonHeader(res_);
+  res_->set(http::field::content_type, "application/json");
+  res_->body() = "{\"bitrate\":" + std::to_string(current.bitrate) + ",\"width\":" + std::to_string(current.width) +
+                 ",\"height\":" + std::to_string(current.height) + ",\"fps\":" + std::to_string(current.fps) +
+                 ",\"gop\":" + std::to_string(current.gop) + "}";
+  res_->prepare_payload();
+  WriteResponse();
+}
+
+void HttpSession::HandleEventRequest(const std::string &camera) {
+  if (req_.method() != http::verb::post) {
+    ResponseMethodNotAllowed();
+    return;
+  }
+  auto event_recorder = http_service_->GetEventRecorder(camera);
+  if (!event_recorder) {
+    ResponseUnprocessableEntity("Event recording is not enabled, see --event-dir.");
+    return;
+  }
+
+  // e.g. `POST /event?seconds=60`, the clip holds the pre-roll plus this many seconds.
+  auto query = ParseQuery(std::string(req_.target().data(), req_.target().size()));
+  EventRecorder::Event event;
+  try {
+    int seconds = query.count("seconds") ? std::stoi(query["seconds"]) : kDefaultEventSeconds;
+    if (seconds < 0 || seconds > kMaxEventSeconds) {
+      throw std::invalid_argument("seconds should be between 0 and " + std::to_string(kMaxEventSeconds));
+    }
+    event = event_recorder->Trigger(seconds);
+  } catch (const std::exception &e) {
+    ResponseUnprocessableEntity(e.what());
+    return;
+  }
+
+  res_ = std::make_shared<http::response<http::string_body>>(http::status::accepted, req_.version());
+  SetCommonHeader(res_);
+  res_->set(http::field::content_type, "application/json");
+  res_->body() = "{\"path\":\"" + event.path + "\",\"preroll_frames\":" + std::to_string(event.preroll_frames) +
+                 ",\"started\":" + (event.started ? "true" : "false") + "}";
+  res_->prepare_payload();
+  WriteResponse();
+}
+
 void HttpSession::ResponseUnprocessableEntity(const char *message) {
   res_ = std::make_shared<http::response<http::string_body>>(http::status::unprocessable_entity, req_.version());
   SetCommonHeader(res_);
@@ -271,11 +501,20 @@ void HttpSession::ResponseUnprocessableEntity(const char *message) {
   WriteResponse();
 }
 
+void HttpSession::ResponseInternalServerError(const char *message) {
+  res_ = std::make_shared<http::response<http::string_body>>(http::status::internal_server_error, req_.version());
+  SetCommonHeader(res_);
+  res_->set(http::field::content_type, "text/plain");
+  res_->body() = message;
+  res_->prepare_payload();
+  WriteResponse();
+}
+
 void HttpSession::ResponseMethodNotAllowed() {
   res_ = std::make_shared<http::response<http::string_body>>(http::status::method_not_allowed, req_.version());
   SetCommonHeader(res_);
   res_->set(http::field::content_type, "text/plain");
-  res_->body() = "Only POST, DELETE, OPTIONS and PATCH method are allowed.";
+  res_->body() = "Only GET, POST, DELETE, OPTIONS and PATCH method are allowed.";
   res_->prepare_payload();
   WriteResponse();
 }
@@ -295,7 +534,7 @@ void HttpSession::SetCommonHeader(std::shared_ptr<boost::beast::http::response<b
 std::vector<std::string> HttpSession::ParseRoutes(std::string target) {
   std::string tmp;
   std::vector<std::string> routes;
-  std::stringstream ss(target);
+  std::stringstream ss(target.substr(0, target.find('?')));
   while (std::getline(ss, tmp, '/')) {
     if (!tmp.empty()) {
       routes.push_back(tmp);
@@ -304,6 +543,26 @@ std::vector<std::string> HttpSession::ParseRoutes(std::string target) {
   return routes;
 }
 
+std::unordered_map<std::string, std::string> HttpSession::ParseQuery(const std::string &target) {
+  std::unordered_map<std::string, std::string> query;
+  size_t pos = target.find('?');
+  if (pos == std::string::npos) {
+    return query;
+  }
+
+  std::string tmp;
+  std::stringstream ss(target.substr(pos + 1));
+  while (std::getline(ss, tmp, '&')) {
+    size_t eq = tmp.find('=');
+    if (eq == std::string::npos) {
+      query[tmp] = "";
+    } else {
+      query[tmp.substr(0, eq)] = tmp.substr(eq + 1);
+    }
+  }
+  return query;
+}
+
 IceCandidates HttpSession::ParseCandidates(const std::string &sdp) {
   std::regex midRegex(R"(a=mid:(\d+))");
   std::regex iceUfragRegex(R"(a=ice-ufrag:([^\s]+))");
@@ -3,6 +3,7 @@
 
 #include <atomic>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <thread>
 #include <unordered_map>
@@ -27,10 +28,11 @@ struct IceCandidates {
 
 class HttpService : public std::enable_shared_from_this<HttpService> {
 public:
-  static std::shared_ptr<HttpService> Create(Args args, std::shared_ptr<V4L2Webrtc> v4l2_webrtc,
+  static std::shared_ptr<HttpService> Create(Args args, std::vector<std::shared_ptr<V4L2Webrtc>> cameras,
                                              boost::asio::io_context &ioc);
 
-  HttpService(Args args, std::shared_ptr<V4L2Webrtc> v4l2_webrtc, boost::asio::io_context &ioc);
+  // Every pipeline is served at `/whep/<camera_name>`, the first one at `/whep` too.
+  HttpService(Args args, std::vector<std::shared_ptr<V4L2Webrtc>> cameras, boost::asio::io_context &ioc);
   ~HttpService();
 
   void Start();
@@ -38,14 +40,24 @@ public:
   void Connect();
   void Disconnect();
 
-  std::shared_ptr<RtcPeer> CreatePeer(PeerConfig config = PeerConfig{});
+  // A peer with one video track per camera, the first camera when `cameras` is empty,
+  // encoded in a codec the remote `offer` supports. Throws std::invalid_argument for an
+  // unknown camera or profile, or an offer without any codec the cameras encode.
+  std::shared_ptr<RtcPeer> CreatePeer(PeerConfig config = PeerConfig{}, const std::vector<std::string> &cameras = {},
+                                      const std::string &profile = "", const std::string &offer = "");
 
   std::shared_ptr<RtcPeer> GetPeer(const std::string &peer_id);
 
   void RemovePeerFromMap(const std::string &peer_id);
 
+  // An empty `camera` selects the first one, an unknown one returns null.
+  std::shared_ptr<V4L2Webrtc> GetCamera(const std::string &camera);
+  std::shared_ptr<Encoder> GetEncoder(const std::string &camera = "");
+  std::shared_ptr<EventRecorder> GetEventRecorder(const std::string &camera = "");
+
 protected:
-  std::shared_ptr<V4L2Webrtc> v4l2_webrtc_;
+  std::shared_ptr<V4L2Webrtc> default_camera_;
+  std::map<std::string, std::shared_ptr<V4L2Webrtc>> cameras_;
 
   void RefreshPeerMap();
 
@@ -71,6 +83,10 @@ public:
 
   void Start() { ReadRequest(); }
 
+  static std::vector<std::string> ParseRoutes(std::string target);
+  static IceCandidates ParseCandidates(const std::string &sdp);
+  static std::unordered_map<std::string, std::string> ParseQuery(const std::string &target);
+
 private:
   std::shared_ptr<HttpService> http_service_;
 
@@ -89,12 +105,15 @@ private:
   void HandlePatchRequest();
   void HandleOptionsRequest();
   void HandleDeleteRequest();
+  void HandleTraceRequest(const std::vector<std::string> &routes);
+  void HandleMetricsRequest();
+  void HandleEncoderRequest(const std::string &camera);
+  void HandleEventRequest(const std::string &camera);
   void ResponseUnprocessableEntity(const char *message);
+  void ResponseInternalServerError(const char *message);
   void ResponseMethodNotAllowed();
   void ResponsePreconditionFailed();
   void SetCommonHeader(std::shared_ptr<boost::beast::http::response<boost::beast::http::string_body>> req);
-  std::vector<std::string> ParseRoutes(std::string target);
-  IceCandidates ParseCandidates(const std::string &sdp);
 };
 
 #endif
@@ -1,22 +1,193 @@
 #include "v4l2_webrtc.h"
 
+#include <algorithm>
+
+#include "capturer/shm_capturer.h"
+#include "capturer/synthetic_capturer.h"
 #include "capturer/v4l2_capturer.h"
+#include "common/logging.h"
+#include "common/metrics.h"
 #include "encoder/libav_encoder.hpp"
 
 std::shared_ptr<V4L2Webrtc> V4L2Webrtc::Create(Args args) { return std::make_shared<V4L2Webrtc>(args); }
 
 V4L2Webrtc::V4L2Webrtc(Args args) : args_(args) {
-  video_capture_ = V4L2Capturer::Create(args);
-  encoder_ = LibAvEncoder::Create(video_capture_, args);
+  if (args.device_type == "synthetic") {
+    video_capture_ = SyntheticCapturer::Create(args);
+  } else if (args.device_type == "shm") {
+    video_capture_ = ShmCapturer::Create(args);
+  } else {
+    video_capture_ = V4L2Capturer::Create(args);
+  }
+  // Encoders, recorders and profiles see the frames after the capturer's crop and rotation.
+  args.width = video_capture_->width();
+  args.height = video_capture_->height();
+  args_ = args;
+  if (args.simulcast_layers > 1) {
+    simulcast_ = SimulcastEncoder::Create(video_capture_, args);
+    layers_ = simulcast_->layers();
+  } else {
+    layers_.push_back(LibAvEncoder::Create(video_capture_, args));
+  }
+  encoder_ = layers_.front();
+  // With simulcast or temporal layers every peer picks what it can carry instead of
+  // pulling the shared encoder down.
+  if (args.adaptive_bitrate && !simulcast_ && args.temporal_layers < 2) {
+    bitrate_allocator_ =
+            BitrateAllocator::Create(encoder_, args.bitrate, Metrics::WithLabel("", "camera", args.camera_name));
+  }
+  if (!args.record_dir.empty()) {
+    recorder_ = Recorder::Create(encoder_, args);
+  }
+  if (!args.event_dir.empty()) {
+    event_recorder_ = EventRecorder::Create(encoder_, args);
+  }
+  if (!args.export_socket.empty()) {
+    exporter_ = FrameExporter::Create(video_capture_, encoder_, args);
+  }
+  if (args.nack_history_ms > 0) {
+    rtx_cache_ = RetransmissionCache::Create(args.nack_history_ms, static_cast<size_t>(args.nack_history_kb) * 1024);
+  }
 }
 
 Args V4L2Webrtc::config() const { return args_; }
 
+std::shared_ptr<Encoder> V4L2Webrtc::encoder() const { return encoder_; }
+
+std::shared_ptr<EventRecorder> V4L2Webrtc::event_recorder() const { return event_recorder_; }
+
+std::shared_ptr<Encoder> V4L2Webrtc::SharedEncoder(const std::string &profile, const std::string &codec) {
+  Args args = args_;
+  std::string labels;
+  if (!profile.empty()) {
+    auto it = args_.profiles.find(profile);
+    if (it == args_.profiles.end()) {
+      throw std::invalid_argument("unknown profile: " + profile);
+    }
+    args.width = it->second.width;
+    args.height = it->second.height;
+    args.bitrate = it->second.bitrate;
+    labels = "{profile=\"" + profile + "\"}";
+  }
+  if (codec != args_.codec) {
+    args.codec = codec;
+    // The options only H.264 supports are checked against the main codec.
+    if (codec != "h264") {
+      args.temporal_layers = 1;
+      args.intra_refresh = false;
+    }
+    labels = Metrics::WithLabel(labels, "codec", codec);
+  }
+
+  const std::string key = (profile.empty() ? "main" : profile) + "/" + codec;
+  std::lock_guard<std::mutex> lock(shared_mtx_);
+  if (auto encoder = shared_encoders_[key].lock()) {
+    return encoder;
+  }
+
+  INFO_PRINT("Starting encoder for %s%s%s: %dx%d, %d kbps", args_.camera_name.c_str(),
+             args_.camera_name.empty() ? "" : "/", key.c_str(), args.width, args.height, args.bitrate);
+  Metrics::Instance().AddCounter("webrtc_profile_encoders_started_total" +
+                                 Metrics::WithLabel(labels, "camera", args_.camera_name));
+
+  auto encoder = LibAvEncoder::Create(video_capture_, args, labels);
+  shared_encoders_[key] = encoder;
+  return encoder;
+}
+
+RtcPeer::CodecOffer V4L2Webrtc::SelectCodec(const std::string &offer) const {
+  VideoCodec codec;
+  ParseVideoCodec(args_.codec, codec);
+  if (offer.empty()) {
+    return {codec, 96};
+  }
+
+  // Our preference decides, browsers tend to list VP8 first.
+  const auto offered = RtcPeer::OfferedCodecs(offer);
+  std::vector<std::string> codecs = {args_.codec};
+  codecs.insert(codecs.end(), args_.fallback_codecs.begin(), args_.fallback_codecs.end());
+  std::string names;
+  for (const auto &name: codecs) {
+    ParseVideoCodec(name, codec);
+    for (const auto &candidate: offered) {
+      if (candidate.codec == codec) {
+        return candidate;
+      }
+    }
+    names += (names.empty() ? "" : ", ") + name;
+  }
+  throw std::invalid_argument("The offer has none of the video codecs " + names + ".");
+}
 
-std::shared_ptr<RtcPeer> V4L2Webrtc::CreatePeerConnection(PeerConfig peer_config) {
-  std::string stun_server = args_.stun_url;
-  peer_config.iceServers.emplace_back(stun_server);
+PeerConfig V4L2Webrtc::ConfigurePeer(PeerConfig peer_config) const {
+  if (!args_.stun_url.empty()) {
+    peer_config.iceServers.emplace_back(args_.stun_url);
+  }
   peer_config.disableAutoNegotiation = true;
-  auto peer = RtcPeer::Create(encoder_, peer_config);
-  return peer;
+  peer_config.adaptive_bitrate = args_.adaptive_bitrate;
+  peer_config.min_bitrate = std::min(args_.min_bitrate, args_.bitrate);
+  peer_config.max_bitrate = args_.bitrate;
+  peer_config.temporal_layers = args_.temporal_layers;
+  peer_config.fps = args_.fps;
+  peer_config.pacing_factor = args_.pacing_factor;
+  peer_config.rtx_cache = rtx_cache_;
+  peer_config.playout_delay_ms = args_.playout_delay_ms;
+  peer_config.abs_capture_time = args_.abs_capture_time;
+  peer_config.send_policy = args_.send_policy;
+  return peer_config;
+}
+
+RtcPeer::TrackConfig V4L2Webrtc::CreateTrack(const std::string &profile, const std::string &offer) {
+  const RtcPeer::CodecOffer codec = SelectCodec(offer);
+  RtcPeer::TrackConfig track;
+  track.name = args_.camera_name;
+  track.fps = args_.fps;
+  track.rtx_cache = rtx_cache_;
+  track.payload_type = codec.payload_type;
+  if (!profile.empty() || codec.codec != encoder_->codec()) {
+    auto encoder = SharedEncoder(profile, VideoCodecName(codec.codec));
+    track.max_bitrate = encoder->settings().bitrate;
+    track.layers.push_back(std::move(encoder));
+    return track;
+  }
+
+  track.layers = layers_;
+  track.max_bitrate = args_.bitrate;
+  if (bitrate_allocator_) {
+    auto allocator = bitrate_allocator_;
+    track.on_target_bitrate = [allocator](const std::string &peer_id, int kbps) { allocator->Update(peer_id, kbps); };
+  }
+  return track;
+}
+
+std::shared_ptr<RtcPeer> V4L2Webrtc::CreatePeerConnection(PeerConfig peer_config, const std::string &profile,
+                                                          const std::string &offer) {
+  auto track = CreateTrack(profile, offer);
+  peer_config = ConfigurePeer(peer_config);
+  peer_config.max_bitrate = track.max_bitrate;
+  peer_config.min_bitrate = std::min(peer_config.min_bitrate, peer_config.max_bitrate);
+  return RtcPeer::Create(std::vector<RtcPeer::TrackConfig>{std::move(track)}, peer_config);
+}
+
+std::shared_ptr<RtcPeer> V4L2Webrtc::CreatePeerConnection(const std::vector<std::shared_ptr<V4L2Webrtc>> &cameras,
+                                                          PeerConfig peer_config, const std::string &profile,
+                                                          const std::string &offer) {
+  if (cameras.empty()) {
+    throw std::invalid_argument("no camera requested");
+  }
+  if (cameras.size() == 1) {
+    return cameras.front()->CreatePeerConnection(peer_config, profile, offer);
+  }
+
+  // The transport options are process-wide, only the bitrate range adds up over the tracks.
+  peer_config = cameras.front()->ConfigurePeer(peer_config);
+  peer_config.min_bitrate = 0;
+  peer_config.max_bitrate = 0;
+  std::vector<RtcPeer::TrackConfig> tracks;
+  for (const auto &camera: cameras) {
+    tracks.push_back(camera->CreateTrack(profile, offer));
+    peer_config.max_bitrate += tracks.back().max_bitrate;
+    peer_config.min_bitrate += std::min(camera->args_.min_bitrate, tracks.back().max_bitrate);
+  }
+  return RtcPeer::Create(std::move(tracks), peer_config);
 }
@@ -1,11 +1,20 @@
 #ifndef V4L2_WEBRTC_H
 #define V4L2_WEBRTC_H
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "args.h"
 #include "capturer/video_capturer.h"
 #include "encoder/encoder.hpp"
+#include "encoder/simulcast_encoder.h"
+#include "exporter/frame_exporter.h"
+#include "rtc/bitrate_allocator.h"
+#include "rtc/retransmission_cache.h"
+#include "recorder/event_recorder.h"
+#include "recorder/recorder.h"
 #include "rtc/rtc_peer.h"
 
 class V4L2Webrtc {
@@ -16,13 +25,43 @@ public:
   ~V4L2Webrtc() = default;
 
   Args config() const;
-  std::shared_ptr<RtcPeer> CreatePeerConnection(PeerConfig peer_config);
+  std::shared_ptr<Encoder> encoder() const;
+  // Null unless event recording is enabled.
+  std::shared_ptr<EventRecorder> event_recorder() const;
+  // An empty `profile` attaches the peer to the main encoder, otherwise to the shared
+  // encoder of that profile. The codec is the first of `--codec` the remote `offer`
+  // lists, the main one without an offer. Throws std::invalid_argument for an unknown
+  // profile or an offer without any of the codecs.
+  std::shared_ptr<RtcPeer> CreatePeerConnection(PeerConfig peer_config, const std::string &profile = "",
+                                                const std::string &offer = "");
+  // One peer with a video track per camera, in this order, over a single transport.
+  // `profile` and `offer` apply to every camera.
+  static std::shared_ptr<RtcPeer> CreatePeerConnection(const std::vector<std::shared_ptr<V4L2Webrtc>> &cameras,
+                                                       PeerConfig peer_config, const std::string &profile = "",
+                                                       const std::string &offer = "");
 
 private:
+  // The encoder of a profile and/or a codec other than the main one, started on demand.
+  std::shared_ptr<Encoder> SharedEncoder(const std::string &profile, const std::string &codec);
+  RtcPeer::CodecOffer SelectCodec(const std::string &offer) const;
+  PeerConfig ConfigurePeer(PeerConfig peer_config) const;
+  RtcPeer::TrackConfig CreateTrack(const std::string &profile, const std::string &offer);
+
   Args args_;
 
   std::shared_ptr<VideoCapturer> video_capture_;
   std::shared_ptr<Encoder> encoder_;
+  std::shared_ptr<SimulcastEncoder> simulcast_;
+  std::vector<std::shared_ptr<Encoder>> layers_;
+  std::shared_ptr<BitrateAllocator> bitrate_allocator_;
+  std::shared_ptr<RetransmissionCache> rtx_cache_;
+  std::shared_ptr<Recorder> recorder_;
+  std::shared_ptr<EventRecorder> event_recorder_;
+  std::shared_ptr<FrameExporter> exporter_;
+
+  // Shared encoders are owned by their peers and die with the last one.
+  std::mutex shared_mtx_;
+  std::map<std::string, std::weak_ptr<Encoder>> shared_encoders_;
 };
 
 #endif // V4L2_WEBRTC_H
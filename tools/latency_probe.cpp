@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/frame_tracer.h"
+#include "common/latency_probe.h"
+#include "rtc/header_extension_writer.h"
+#include "rtc/rtc.hpp"
+
+/*
+ * Pulls the stream of a server started with `--latency-probe` over WHEP, on the
+ * same host so both sides share CLOCK_MONOTONIC, and reports how long each frame
+ * took from capture to arriving depacketized here. When the server sends
+ * `abs-capture-time` the time to the first RTP packet of each frame is reported
+ * as well, and the `playout-delay` it asks for is shown: libdatachannel has no
+ * jitter buffer, so the effect of that one is only visible in a browser.
+ */
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace bpo = boost::program_options;
+using tcp = boost::asio::ip::tcp;
+
+namespace {
+
+const int kPlayoutDelayId = 6;
+const int kAbsCaptureTimeId = 7;
+const uint64_t kNtpUnixOffset = 2208988800ULL;
+
+int64_t RealtimeUs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Reads the header extensions of incoming RTP before the depacketizer drops the headers.
+class ExtensionReader : public rtc::MediaHandler {
+public:
+  void incoming(rtc::message_vector &messages, const rtc::message_callback &) override {
+    for (const auto &message: messages) {
+      if (message && message->type != rtc::Message::Control) {
+        Read(reinterpret_cast<const uint8_t *>(message->data()), message->size());
+      }
+    }
+  }
+
+  std::vector<double> TakeLatencies() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return latencies_ms_;
+  }
+
+  // -1 until the first packet carrying the extension arrives.
+  int playout_delay_max_ms() const { return playout_delay_max_ms_.load(); }
+
+private:
+  void Read(const uint8_t *p, size_t size) {
+    const size_t csrc_end = 12 + 4 * size_t(p[0] & 0x0f);
+    if (size < csrc_end + 4 || !(p[0] & 0x10) || ((p[csrc_end] << 8) | p[csrc_end + 1]) != 0xBEDE) {
+      return;
+    }
+    const size_t end = std::min(size, csrc_end + 4 + 4 * size_t((p[csrc_end + 2] << 8) | p[csrc_end + 3]));
+    for (size_t i = csrc_end + 4; i < end;) {
+      if (p[i] == 0) {
+        i++;
+        continue;
+      }
+      const int id = p[i] >> 4;
+      const size_t length = (p[i] & 0x0f) + 1;
+      if (id == 15 || i + 1 + length > end) {
+        return;
+      }
+      const uint8_t *data = p + i + 1;
+      if (id == kPlayoutDelayId && length == 3) {
+        playout_delay_max_ms_.store((((data[1] & 0x0f) << 8) | data[2]) * 10);
+      } else if (id == kAbsCaptureTimeId && length >= 8) {
+        uint64_t ntp = 0;
+        for (int b = 0; b < 8; b++) {
+          ntp = (ntp << 8) | data[b];
+        }
+        const int64_t capture_us = static_cast<int64_t>((ntp >> 32) - kNtpUnixOffset) * 1000000 +
+                                   static_cast<int64_t>(((ntp & 0xffffffff) * 1000000) >> 32);
+        std::lock_guard<std::mutex> lock(mtx_);
+        latencies_ms_.push_back((RealtimeUs() - capture_us) / 1000.0);
+      }
+      i += 1 + length;
+    }
+  }
+
+  std::mutex mtx_;
+  std::vector<double> latencies_ms_;
+  std::atomic<int> playout_delay_max_ms_{-1};
+};
+
+struct WhepResponse {
+  int status = 0;
+  std::string location;
+  std::string body;
+};
+
+WhepResponse HttpRequest(const std::string &host, const std::string &port, http::verb method,
+                         const std::string &target, const std::string &body = "") {
+  boost::asio::io_context ioc;
+  tcp::resolver resolver(ioc);
+  beast::tcp_stream stream(ioc);
+  stream.connect(resolver.resolve(host, port));
+
+  http::request<http::string_body> req{method, target, 11};
+  req.set(http::field::host, host);
+  if (!body.empty()) {
+    req.set(http::field::content_type, "application/sdp");
+    req.body() = body;
+  }
+  req.prepare_payload();
+  http::write(stream, req);
+
+  beast::flat_buffer buffer;
+  http::response<http::string_body> res;
+  http::read(stream, buffer, res);
+  beast::error_code ec;
+  stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+
+  WhepResponse response;
+  response.status = res.result_int();
+  response.location = std::string(res[http::field::location]);
+  response.body = res.body();
+  return response;
+}
+
+double Percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p / 100 * sorted.size()));
+  return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string host = "127.0.0.1";
+  std::string port = "8000";
+  std::string path = "/whep";
+  int seconds = 10;
+  double max_p99_ms = 0;
+  bool extensions = true;
+
+  bpo::options_description opts("Options");
+  // clang-format off
+    opts.add_options()
+        ("help,h", "Display the help message")
+        ("host", bpo::value<std::string>(&host)->default_value(host), "The WHEP server, on this machine.")
+        ("port", bpo::value<std::string>(&port)->default_value(port), "The WHEP server's http port.")
+        ("path", bpo::value<std::string>(&path)->default_value(path),
+            "The WHEP endpoint, e.g. `/whep?profile=thumb`.")
+        ("seconds", bpo::value<int>(&seconds)->default_value(seconds), "How long to measure.")
+        ("max-p99-ms", bpo::value<double>(&max_p99_ms)->default_value(max_p99_ms),
+            "Exit with an error when the 99th percentile exceeds this, 0 only reports.")
+        ("extensions", bpo::value<bool>(&extensions)->default_value(extensions),
+            "Offer the `playout-delay` and `abs-capture-time` RTP header extensions.");
+  // clang-format on
+
+  bpo::variables_map vm;
+  try {
+    bpo::store(bpo::parse_command_line(argc, argv, opts), vm);
+    bpo::notify(vm);
+  } catch (const bpo::error &ex) {
+    std::cerr << "Error parsing arguments: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  if (vm.count("help")) {
+    std::cout << opts << std::endl;
+    return 1;
+  }
+
+  auto pc = std::make_shared<rtc::PeerConnection>(rtc::Configuration());
+  rtc::Description::Video video("0", rtc::Description::Direction::RecvOnly);
+  video.addH264Codec(96);
+  if (extensions) {
+    video.addExtMap(rtc::Description::Media::ExtMap(kPlayoutDelayId, HeaderExtensionWriter::kPlayoutDelayUri));
+    video.addExtMap(rtc::Description::Media::ExtMap(kAbsCaptureTimeId, HeaderExtensionWriter::kAbsCaptureTimeUri));
+  }
+  auto track = pc->addTrack(video);
+
+  // Incoming packets pass the chain from its end, so the reader sees them first.
+  auto extension_reader = std::make_shared<ExtensionReader>();
+  auto depacketizer = std::make_shared<rtc::H264RtpDepacketizer>(rtc::NalUnit::Separator::StartSequence);
+  depacketizer->addToChain(std::make_shared<rtc::RtcpReceivingSession>());
+  depacketizer->addToChain(extension_reader);
+  track->setMediaHandler(depacketizer);
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool gathered = false;
+  std::vector<double> latencies_ms;
+  std::atomic<uint64_t> frames{0};
+  uint64_t last_frame_id = 0;
+  uint64_t skipped = 0;
+
+  track->onFrame([&](rtc::binary data, rtc::FrameInfo) {
+    const int64_t now_us = FrameTracer::NowUs();
+    frames++;
+    LatencyProbe probe;
+    if (!LatencyProbe::Parse(reinterpret_cast<const uint8_t *>(data.data()), data.size(), probe)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    latencies_ms.push_back((now_us - probe.capture_us) / 1000.0);
+    // Frame IDs count captured frames, gaps are frames the encoder or network dropped.
+    if (last_frame_id && probe.frame_id > last_frame_id + 1) {
+      skipped += probe.frame_id - last_frame_id - 1;
+    }
+    last_frame_id = std::max(last_frame_id, probe.frame_id);
+  });
+
+  // Post the offer once all candidates are in it, the server does not need trickle ICE then.
+  pc->onGatheringStateChange([&](rtc::PeerConnection::GatheringState state) {
+    if (state == rtc::PeerConnection::GatheringState::Complete) {
+      std::lock_guard<std::mutex> lock(mtx);
+      gathered = true;
+      cv.notify_all();
+    }
+  });
+  pc->setLocalDescription();
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!cv.wait_for(lock, std::chrono::seconds(5), [&] { return gathered; })) {
+      std::cerr << "ICE gathering did not complete" << std::endl;
+      return 1;
+    }
+  }
+
+  WhepResponse answer;
+  try {
+    answer = HttpRequest(host, port, http::verb::post, path, std::string(*pc->localDescription()));
+  } catch (const std::exception &e) {
+    std::cerr << "WHEP request failed: " << e.what() << std::endl;
+    return 1;
+  }
+  if (answer.status != 201) {
+    std::cerr << "WHEP request failed with " << answer.status << ": " << answer.body << std::endl;
+    return 1;
+  }
+  pc->setRemoteDescription(rtc::Description(answer.body, "answer"));
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+  if (!answer.location.empty()) {
+    // The Location is absolute, only its path is needed.
+    std::string resource = answer.location;
+    const size_t scheme = resource.find("://");
+    const size_t slash = resource.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    try {
+      HttpRequest(host, port, http::verb::delete_, slash == std::string::npos ? resource : resource.substr(slash));
+    } catch (const std::exception &e) {
+      std::cerr << "WHEP teardown failed: " << e.what() << std::endl;
+    }
+  }
+  pc->close();
+
+  std::vector<double> sorted;
+  uint64_t missing;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    sorted = latencies_ms;
+    missing = skipped;
+  }
+  std::sort(sorted.begin(), sorted.end());
+  if (sorted.empty()) {
+    std::cerr << "No probe received in " << frames.load()
+              << " frames, was the server started with --latency-probe?" << std::endl;
+    return 1;
+  }
+
+  const double p99 = Percentile(sorted, 99);
+  printf("frames %zu, skipped %" PRIu64 "\n", sorted.size(), missing);
+  printf("latency ms: min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", sorted.front(), Percentile(sorted, 50),
+         Percentile(sorted, 90), p99, sorted.back());
+
+  auto first_packet = extension_reader->TakeLatencies();
+  std::sort(first_packet.begin(), first_packet.end());
+  if (!first_packet.empty()) {
+    printf("abs-capture-time to first packet ms: p50 %.2f  p99 %.2f\n", Percentile(first_packet, 50),
+           Percentile(first_packet, 99));
+  }
+  if (extension_reader->playout_delay_max_ms() >= 0) {
+    printf("playout-delay max %d ms\n", extension_reader->playout_delay_max_ms());
+  }
+  if (max_p99_ms > 0 && p99 > max_p99_ms) {
+    std::cerr << "p99 latency " << p99 << " ms exceeds " << max_p99_ms << " ms" << std::endl;
+    return 1;
+  }
+  return 0;
+}
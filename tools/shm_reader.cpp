@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <iostream>
+#include <linux/videodev2.h>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "common/frame_tracer.h"
+#include "common/shm_frame_ring.h"
+
+/*
+ * A reference reader of the rings published by `--export-socket`: it maps
+ * them, waits on its eventfd and reads every new frame in place, the way an
+ * analytics or ROS node would, then reports how many frames it got, how many
+ * the writer overwrote before they could be read, and their age on arrival.
+ */
+
+namespace bpo = boost::program_options;
+
+namespace {
+
+struct RingStats {
+  uint64_t next = 0;
+  uint64_t read = 0;
+  uint64_t lost = 0;
+  uint64_t torn = 0;
+  uint64_t bytes = 0;
+  double luma_sum = 0;
+  std::vector<double> age_ms;
+};
+
+// Reads every frame published since the last call, or the newest ones if the writer lapped us.
+void Drain(const ShmRingReader &ring, uint32_t slot_count, RingStats &stats) {
+  const uint64_t published = ring.published();
+  if (stats.next == 0 && published > 0) {
+    stats.next = published - 1;
+  }
+  if (published > stats.next + slot_count) {
+    stats.lost += published - slot_count - stats.next;
+    stats.next = published - slot_count;
+  }
+
+  for (; stats.next < published; stats.next++) {
+    ShmFrameMeta meta;
+    const uint8_t *data = ring.Peek(stats.next, &meta);
+    if (!data) {
+      stats.lost++;
+      continue;
+    }
+    // Use the frame in place as a consumer would, and only keep the result if the writer did
+    // not come by meanwhile. For I420 that is a sampled mean of the Y plane.
+    double luma = 0;
+    if (meta.pixel_format == V4L2_PIX_FMT_YUV420 && meta.width && meta.height) {
+      uint64_t sum = 0;
+      uint64_t samples = 0;
+      for (uint32_t y = 0; y < meta.height; y += 16) {
+        for (uint32_t x = 0; x < meta.width; x += 16, samples++) {
+          sum += data[static_cast<size_t>(y) * meta.stride_y + x];
+        }
+      }
+      luma = static_cast<double>(sum) / samples;
+    }
+    if (!ring.Valid(stats.next)) {
+      stats.torn++;
+      continue;
+    }
+    stats.read++;
+    stats.bytes += meta.size;
+    stats.luma_sum += luma;
+    stats.age_ms.push_back((FrameTracer::NowUs() - meta.capture_us) / 1000.0);
+  }
+}
+
+double Percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, static_cast<size_t>(p / 100 * values.size()))];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string socket_path;
+  int seconds = 10;
+
+  bpo::options_description opts("Options");
+  // clang-format off
+  opts.add_options()
+    ("help,h", "Display the help message")
+    ("socket", bpo::value<std::string>(&socket_path)->required(), "The server's --export-socket.")
+    ("seconds", bpo::value<int>(&seconds)->default_value(seconds), "How long to read.");
+  // clang-format on
+
+  bpo::variables_map vm;
+  try {
+    bpo::store(bpo::parse_command_line(argc, argv, opts), vm);
+    if (vm.count("help")) {
+      std::cout << opts << std::endl;
+      return 1;
+    }
+    bpo::notify(vm);
+  } catch (const bpo::error &ex) {
+    std::cerr << "Error parsing arguments: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  if (sock < 0 || connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    std::cerr << "Cannot connect to " << socket_path << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::vector<int> ring_fds;
+  int event_fd = -1;
+  if (!ReceiveRings(sock, &ring_fds, &event_fd)) {
+    std::cerr << "Unexpected reply from " << socket_path << std::endl;
+    return 1;
+  }
+  std::vector<std::unique_ptr<ShmRingReader>> rings;
+  try {
+    for (int fd: ring_fds) {
+      rings.push_back(std::make_unique<ShmRingReader>(fd));
+      close(fd);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<RingStats> stats(rings.size());
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  while (std::chrono::steady_clock::now() < deadline) {
+    pollfd pfd = {event_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    uint64_t count;
+    if (read(event_fd, &count, sizeof(count)) != sizeof(count)) {
+      continue;
+    }
+    for (size_t i = 0; i < rings.size(); i++) {
+      Drain(*rings[i], rings[i]->slot_count(), stats[i]);
+    }
+  }
+  close(event_fd);
+  close(sock);
+
+  for (size_t i = 0; i < rings.size(); i++) {
+    const char *name = rings[i]->format() == ShmFrameFormat::Raw ? "raw" : "h264";
+    printf("%s: read %" PRIu64 " (%" PRIu64 " bytes), lost %" PRIu64 ", torn %" PRIu64 ", age ms p50 %.2f  p99 %.2f\n",
+           name, stats[i].read, stats[i].bytes, stats[i].lost, stats[i].torn, Percentile(stats[i].age_ms, 50),
+           Percentile(stats[i].age_ms, 99));
+    if (rings[i]->format() == ShmFrameFormat::Raw && stats[i].read) {
+      printf("%s: mean luma %.1f\n", name, stats[i].luma_sum / stats[i].read);
+    }
+  }
+  return 0;
+}